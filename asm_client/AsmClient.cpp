@@ -7,7 +7,14 @@
 #include "Hardware/Hardware.h"
 #include "Network/Network.h"
 #include "Sensor/Sensor.h"
+#include "Utils/AllocationCheck.h"
 #include "Utils/Config.h"
+#include "Utils/Pipeline.h"
+#include "Utils/Reactor.h"
+#include "Utils/Utils.h"
+
+#include <atomic>
+#include <thread>
 
 // Supported hardware types
 #if defined TARGET_RPI
@@ -29,7 +36,16 @@
 
 INITIALIZE_EASYLOGGINGPP
 
-static int global_shutdown = 0;
+// Longest time in milliseconds to wait for an event before running the loop anyway
+#define MAX_WAIT_MS 1000
+
+struct PipelineConfig
+{
+    int hardwarePeriod;     // Milliseconds between hardware status updates
+    double statsInterval;   // Seconds between logging the pipeline counters
+};
+
+static std::atomic<int> global_shutdown( 0 );
 #ifdef __unix__
 static void main_signal_handler( int signal )
 {
@@ -45,12 +61,279 @@ BOOL WINAPI main_signal_handler( _In_ DWORD dwCtrlType )
 }
 #endif
 
-int main( int argc, char* argv[] )
+// Runs hardware, sensor and network one after another on the calling thread,
+// sleeping in the reactor until one of them has something to do
+static int RunSingleThreaded( Reactor *reactor, Hardware *hardware, Sensor *sensor, Network *network )
 {
     struct AsmClientStatus status = { 0 };
     struct AsmClientData data = { 0 };
     struct AsmClientTask task = { 0 };
+    AllocationCheck allocationCheck( "main" );
+
+    while (!global_shutdown)
+    {
+        allocationCheck.BeginPass();
+        try
+        {
+            hardware->Loop( status, data );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running hardware: " << msg;
+            break;
+        }
+        try
+        {
+            network->DispatchSensorMessages();
+            sensor->Loop( task, data );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running sensor: " << msg;
+            break;
+        }
+        try
+        {
+            network->Loop( status, data, task );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running network: " << msg;
+            break;
+        }
+        try
+        {
+            allocationCheck.EndPass();
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << msg;
+            break;
+        }
+        reactor->Wait( MAX_WAIT_MS );
+    }
+    return global_shutdown ? 0 : 5;
+}
+
+// Snapshots passed between the threads of the pipeline. Each thread owns its own
+// copy of the structures it writes and only exchanges copies through these.
+struct Pipeline
+{
+    SnapshotBuffer<AsmClientData> data;             // Sensor -> Network
+    SnapshotBuffer<AsmClientData> hardwareData;     // Sensor -> Hardware
+    SnapshotBuffer<AsmClientStatus> status;         // Hardware -> Network
+    SnapshotBuffer<AsmClientTask> task;             // Network -> Sensor
+    std::atomic<bool> hardwareNewStatus;            // Hardware -> Network
+
+    PipelineCounters hardwareCounters;
+    PipelineCounters sensorCounters;
+    PipelineCounters networkCounters;
 
+    Reactor *sensorReactor;
+    Reactor *networkReactor;
+
+    std::atomic<int> failed;
+    int hardwarePeriod;
+};
+
+static void LogPipelineCounters( const char *stage, const PipelineCounters &counters )
+{
+    LOG( INFO ) << "Pipeline " << stage << ": " << counters.passes << " passes, "
+        << counters.inputWaits << " input waits, " << counters.outputWaits << " output waits";
+}
+
+static bool TaskChanged( const AsmClientTask &a, const AsmClientTask &b )
+{
+    return a.newTask != b.newTask || ulid::CompareULIDs( a.taskID, b.taskID ) != 0 ||
+        a.bearing != b.bearing || a.horizontalExtent != b.horizontalExtent ||
+        a.minRange != b.minRange || a.maxRange != b.maxRange || a.command != b.command;
+}
+
+static void RunHardwareStage( Pipeline *pipeline, Hardware *hardware )
+{
+    struct AsmClientStatus status = { 0 };
+    struct AsmClientData data = { 0 };
+    AllocationCheck allocationCheck( "hardware" );
+
+    while (!global_shutdown)
+    {
+        pipeline->hardwareCounters.passes++;
+        allocationCheck.BeginPass();
+        if (!pipeline->hardwareData.Fetch( data )) pipeline->hardwareCounters.inputWaits++;
+        try
+        {
+            hardware->Loop( status, data );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running hardware: " << msg;
+            break;
+        }
+        // The status flag is passed separately so that it is never lost when a snapshot is overwritten
+        if (!pipeline->status.Publish( status )) pipeline->hardwareCounters.outputWaits++;
+        if (status.newStatus)
+        {
+            pipeline->hardwareNewStatus = true;
+            pipeline->networkReactor->Notify();
+            status.newStatus = false;
+        }
+        try
+        {
+            allocationCheck.EndPass();
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << msg;
+            break;
+        }
+        Sleep_ms( pipeline->hardwarePeriod );
+    }
+    if (!global_shutdown) pipeline->failed = 1;
+    global_shutdown = 1;
+}
+
+static void RunSensorStage( Pipeline *pipeline, Sensor *sensor, Network *network )
+{
+    struct AsmClientData data = { 0 };
+    struct AsmClientTask task = { 0 };
+    AllocationCheck allocationCheck( "sensor" );
+
+    while (!global_shutdown)
+    {
+        pipeline->sensorCounters.passes++;
+        allocationCheck.BeginPass();
+        if (!pipeline->task.Fetch( task )) pipeline->sensorCounters.inputWaits++;
+        try
+        {
+            network->DispatchSensorMessages();
+            sensor->Loop( task, data );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running sensor: " << msg;
+            break;
+        }
+        // Never block on the network: after a stall it reports the latest detections, and the
+        // snapshots it missed are counted
+        if (!pipeline->data.Publish( data )) pipeline->sensorCounters.outputWaits++;
+        pipeline->hardwareData.Publish( data );
+        pipeline->networkReactor->Notify();
+        try
+        {
+            allocationCheck.EndPass();
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << msg;
+            break;
+        }
+        pipeline->sensorReactor->Wait( MAX_WAIT_MS );
+    }
+    if (!global_shutdown) pipeline->failed = 1;
+    global_shutdown = 1;
+}
+
+static void RunNetworkStage( Pipeline *pipeline, Network *network )
+{
+    struct AsmClientStatus status = { 0 };
+    struct AsmClientStatus hardwareStatus = { 0 };
+    struct AsmClientData data = { 0 };
+    struct AsmClientTask task = { 0 };
+    struct AsmClientTask publishedTask = { 0 };
+    AllocationCheck allocationCheck( "network" );
+
+    while (!global_shutdown)
+    {
+        pipeline->networkCounters.passes++;
+        allocationCheck.BeginPass();
+        if (pipeline->status.Fetch( hardwareStatus ))
+        {
+            // Take everything from the hardware except the fields owned by the network
+            AsmClientStatus::NetworkStatus networkStatus = status.network;
+            bool newStatus = status.newStatus;
+            int detectionsReported = status.detectionsReported;
+            status = hardwareStatus;
+            status.network = networkStatus;
+            status.newStatus = newStatus;
+            status.detectionsReported = detectionsReported;
+        }
+        if (pipeline->hardwareNewStatus.exchange( false )) status.newStatus = true;
+        if (!pipeline->data.Fetch( data )) pipeline->networkCounters.inputWaits++;
+        try
+        {
+            network->Loop( status, data, task );
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << "Exception caught while running network: " << msg;
+            break;
+        }
+        if (TaskChanged( task, publishedTask ))
+        {
+            publishedTask = task;
+            if (!pipeline->task.Publish( task )) pipeline->networkCounters.outputWaits++;
+            pipeline->sensorReactor->Notify();
+        }
+        try
+        {
+            allocationCheck.EndPass();
+        }
+        catch (const char *msg)
+        {
+            LOG( ERROR ) << msg;
+            break;
+        }
+        pipeline->networkReactor->Wait( MAX_WAIT_MS );
+    }
+    if (!global_shutdown) pipeline->failed = 1;
+    global_shutdown = 1;
+}
+
+// Runs hardware, sensor and network on separate threads so that a stall in one
+// (e.g. a blocking network write) does not delay the others
+static int RunThreaded( const PipelineConfig &config, Reactor *sensorReactor, Reactor *networkReactor,
+                        Hardware *hardware, Sensor *sensor, Network *network )
+{
+    Pipeline *pipeline = new Pipeline();
+    pipeline->sensorReactor = sensorReactor;
+    pipeline->networkReactor = networkReactor;
+    pipeline->hardwareNewStatus = false;
+    pipeline->failed = 0;
+    pipeline->hardwarePeriod = config.hardwarePeriod;
+
+    LOG( INFO ) << "Starting pipeline threads";
+    std::thread hardwareThread( RunHardwareStage, pipeline, hardware );
+    std::thread sensorThread( RunSensorStage, pipeline, sensor, network );
+    std::thread networkThread( RunNetworkStage, pipeline, network );
+
+    double lastStatsTime = Get_Time_Monotonic();
+    while (!global_shutdown)
+    {
+        Sleep_ms( 100 );
+        if (config.statsInterval > 0 && Get_Time_Monotonic() > lastStatsTime + config.statsInterval)
+        {
+            lastStatsTime = Get_Time_Monotonic();
+            LogPipelineCounters( "hardware", pipeline->hardwareCounters );
+            LogPipelineCounters( "sensor", pipeline->sensorCounters );
+            LogPipelineCounters( "network", pipeline->networkCounters );
+        }
+    }
+
+    hardwareThread.join();
+    sensorThread.join();
+    networkThread.join();
+
+    LogPipelineCounters( "hardware", pipeline->hardwareCounters );
+    LogPipelineCounters( "sensor", pipeline->sensorCounters );
+    LogPipelineCounters( "network", pipeline->networkCounters );
+
+    int result = pipeline->failed ? 5 : 0;
+    delete pipeline;
+    return result;
+}
+
+int main( int argc, char* argv[] )
+{
     Hardware *hardware = nullptr;
     Network *network = nullptr;
     Sensor *sensor = nullptr;
@@ -103,6 +386,14 @@ int main( int argc, char* argv[] )
         return 1;
     }
 
+    // The threaded pipeline gives the sensor and network a reactor each, otherwise they share one
+    bool threaded = config.GetLongValue( "pipeline", "threaded", 0 ) != 0;
+    Reactor *sensorReactor = new Reactor();
+    Reactor *networkReactor = threaded ? new Reactor() : sensorReactor;
+    sensor->AttachReactor( sensorReactor );
+    network->AttachReactor( networkReactor );
+    network->AttachSensorReactor( sensorReactor );
+
     LOG( INFO ) << "Initialising...";
     try
     {
@@ -125,6 +416,7 @@ int main( int argc, char* argv[] )
     try
     {
         sensor->Initialise( configFilename );
+        sensor->Subscribe( network->GetSensorDispatcher() );
     }
     catch (const char *msg)
     {
@@ -140,43 +432,27 @@ int main( int argc, char* argv[] )
 #endif
 
     LOG( INFO ) << "Running...";
-    while (!global_shutdown)
+    int result;
+    if (threaded)
     {
-        try
-        {
-            hardware->Loop( status, data );
-        }
-        catch (const char *msg)
-        {
-            LOG( ERROR ) << "Exception caught while running hardware: " << msg;
-            break;
-        }
-        try
-        {
-            sensor->Loop( task, data );
-        }
-        catch (const char *msg)
-        {
-            LOG( ERROR ) << "Exception caught while running sensor: " << msg;
-            break;
-        }
-        try
-        {
-            network->Loop( status, data, task );
-        }
-        catch (const char *msg)
-        {
-            LOG( ERROR ) << "Exception caught while running network: " << msg;
-            break;
-        }
+        struct PipelineConfig pipelineConfig;
+        pipelineConfig.hardwarePeriod = (int)config.GetLongValue( "pipeline", "hardwarePeriod_ms", 100 );
+        pipelineConfig.statsInterval = config.GetDoubleValue( "pipeline", "statsInterval", 60.0 );
+        result = RunThreaded( pipelineConfig, sensorReactor, networkReactor, hardware, sensor, network );
+    }
+    else
+    {
+        result = RunSingleThreaded( sensorReactor, hardware, sensor, network );
     }
     LOG( INFO ) << "Terminating...";
 
     delete hardware;
     delete network;
     delete sensor;
+    if (networkReactor != sensorReactor) delete networkReactor;
+    delete sensorReactor;
 
     el::Loggers::flushAll();
 
-    return global_shutdown ? 0 : 5;
+    return result;
 }
@@ -45,11 +45,12 @@ struct AsmClientData
 {
     bool fault;
     bool clutter;
-    std::string timestamp;
+    int64_t timestamp; // UTC nanoseconds since the epoch, when the detections were acquired
 
     struct Detection
     {
         ulid::ULID id;
+        char idText[26];    // The sensor sets this with the id, marshalled once rather than for every report
         bool updated;
         float range;
         float direction;
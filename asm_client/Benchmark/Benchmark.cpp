@@ -0,0 +1,54 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Benchmark.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <string.h>
+
+INITIALIZE_EASYLOGGINGPP
+
+struct Benchmark
+{
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] =
+{
+    { "reports", BenchmarkDetectionReports },
+    { "gating", BenchmarkDetectionGating },
+    { "ulids", BenchmarkUlids },
+    { "tracker", BenchmarkTracker },
+};
+
+// Runs the benchmarks named on the command line, or all of them
+int main( int argc, char **argv )
+{
+    START_EASYLOGGINGPP( argc, argv );
+    el::Loggers::getLogger( "main" );
+
+    int count = (int)(sizeof( benchmarks ) / sizeof( benchmarks[0] ));
+    for (int a = 1; a < argc; a++)
+    {
+        int b = 0;
+        while (b < count && strcmp( argv[a], benchmarks[b].name ) != 0) b++;
+        if (b == count)
+        {
+            LOG( ERROR ) << "Unknown benchmark '" << argv[a] << "'";
+            return 1;
+        }
+    }
+
+    for (int b = 0; b < count; b++)
+    {
+        bool wanted = argc == 1;
+        for (int a = 1; a < argc; a++) wanted |= strcmp( argv[a], benchmarks[b].name ) == 0;
+        if (wanted) benchmarks[b].run();
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+// Each logs the time taken by the current code and by what it replaced.
+// They are built into a program of their own with 'scons target=linux benchmark'.
+
+// Encoding detection reports from strings, from typed fields and straight to the wire format
+void BenchmarkDetectionReports();
+
+// Gating a batch of detections with and without SIMD
+void BenchmarkDetectionGating();
+
+// Making and marshalling IDs as the library does and with the generator
+void BenchmarkUlids();
+
+// Tracking thousands of crossing targets among clutter, and the error in their range rates
+void BenchmarkTracker();
@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Benchmark.h"
+#include "../AsmClient.h"
+#include "../Network/DetectionBatch.h"
+#include "../Utils/Utils.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <math.h>
+#include <vector>
+
+void BenchmarkDetectionGating()
+{
+    const int detections = 512;
+    const int passes = 2000;
+
+    std::vector<AsmClientData::Detection> plots( detections, AsmClientData::Detection() );
+    for (int i = 0; i < detections; i++)
+    {
+        plots[i].range = (float)(i % 200) * 0.75f;
+        plots[i].direction = (float)((i * 37) % 720) - 360.0f;
+    }
+    float compassBearing = 350.0f, taskBearing = 20.0f, horizontalExtent = 60.0f, minRange = 0.3f, maxRange = 100.0f;
+
+    // As Network used to: one detection at a time through fmodf
+    int reference = 0;
+    double start = Get_Time_Monotonic();
+    for (int p = 0; p < passes; p++)
+    {
+        reference = 0;
+        for (int i = 0; i < detections; i++)
+        {
+            float b = fmodf( compassBearing + plots[i].direction + 360.0f, 360.0f );
+            float offsetAngle = fmodf( b - taskBearing + 540.0f, 360.0f ) - 180.0f;
+            if (plots[i].range < minRange || plots[i].range > maxRange) continue;
+            if (fabs( offsetAngle ) > horizontalExtent / 2.0) continue;
+            reference++;
+        }
+    }
+    double fmodTime = Get_Time_Monotonic() - start;
+
+    DetectionBatch batch;
+    int gated = 0;
+    start = Get_Time_Monotonic();
+    for (int p = 0; p < passes; p++)
+    {
+        batch.Load( plots );
+        batch.Gate( compassBearing, taskBearing, horizontalExtent, minRange, maxRange );
+        gated = 0;
+        for (size_t i = 0; i < batch.Size(); i++) gated += batch.Selected()[i];
+    }
+    double batchTime = Get_Time_Monotonic() - start;
+
+    LOG( INFO ) << "Detection gating benchmark (" << detections << " detections): fmodf "
+        << fmodTime * 1e6 / passes << " us, batch " << batchTime * 1e6 / passes << " us per pass, selected "
+        << gated << " of " << reference;
+}
@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Benchmark.h"
+#include "../AsmClient.h"
+#include "../Network/DetectionReport.h"
+#include "../Network/DetectionReportEncoder.h"
+#include "../Network/ProtobufInterface/Writer.h"
+#include "../Utils/UlidGenerator.h"
+#include "../Utils/Utils.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <google/protobuf/arena.h>
+
+// Takes frames and throws them away, so that only building and encoding is timed
+class DiscardStream : public IOutputStream
+{
+public:
+    virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote ) { iWrote = iOctets; return true; }
+    virtual bool Send( bool bTerminator ) { return true; }
+    virtual void Close() {}
+    virtual unsigned char *Reserve( size_t iOctets ) { return iOctets <= sizeof( buffer ) ? buffer : NULL; }
+    virtual bool Commit( size_t iOctets ) { return true; }
+
+private:
+    unsigned char buffer[4096];
+};
+
+
+void BenchmarkDetectionReports()
+{
+    const int reports = 20000;
+
+    DiscardStream discard;
+    google::protobuf::Arena arena;
+    ProtobufInterface::Writer w;
+    w.setArena( &arena );
+    w.open( &discard );
+
+    int64_t timestamp = Get_Time_UTC_ns();
+    std::string nodeID = "benchmark-node";
+    std::string destID = "benchmark-dest";
+    ulid::ULID taskID;
+    Generate_Ulid( taskID );
+
+    // A detection with everything a sensor fills in
+    AsmClientData::Detection d = AsmClientData::Detection();
+    Generate_Ulid( d.id, d.idText );
+    d.range = 12.345f;
+    d.direction = 123.4f;
+    d.directionError = 5.0f;
+    d.dopplerSpeed = -1.25f;
+    d.detectionConfidence = 0.9f;
+    d.humanConfidence = 0.7f;
+    d.vehicleConfidence = 0.2f;
+    d.unknownConfidence = 0.1f;
+    d.vehicleTwoWheelConfidence = 0.05f;
+    d.vehicleFourWheelConfidence = 0.15f;
+    d.vehicleFourWheelLightConfidence = 0.15f;
+    d.humanWalkingConfidence = 0.6f;
+    d.humanRunningConfidence = 0.1f;
+
+    // As Network used to: every value converted to text, then parsed back when the message is built
+    DetectionReportData data;
+    data.timestamp = timestamp;
+    data.nodeID = nodeID;
+    data.destID = destID;
+    data.taskID = taskID;
+    data.rangeBearing = new DetectionReportLocationRB();
+    data.objectDopplerSpeed = new DetectionReportValue();
+
+    double start = Get_Time_Monotonic();
+    for (int i = 0; i < reports; i++)
+    {
+        data.objectID = d.id;
+        data.rangeBearing->r = std::to_string( d.range );
+        data.rangeBearing->er = "1.0";
+        data.rangeBearing->az = std::to_string( d.direction );
+        data.rangeBearing->eaz = std::to_string( d.directionError );
+        data.objectDopplerSpeed->value = std::to_string( d.dopplerSpeed );
+        data.objectDopplerSpeed->e = "0.25";
+        data.detectionConfidence = std::to_string( d.detectionConfidence );
+        data.humanConfidence = std::to_string( d.humanConfidence );
+        data.vehicleConfidence = std::to_string( d.vehicleConfidence );
+        data.unknownConfidence = std::to_string( d.unknownConfidence );
+        data.vehicleTwoWheelConfidence = std::to_string( d.vehicleTwoWheelConfidence );
+        data.vehicleFourWheelConfidence = std::to_string( d.vehicleFourWheelConfidence );
+        data.vehicleFourWheelHeavyConfidence = std::to_string( d.vehicleFourWheelHeavyConfidence );
+        data.vehicleFourWheelMediumConfidence = std::to_string( d.vehicleFourWheelMediumConfidence );
+        data.vehicleFourWheelLightConfidence = std::to_string( d.vehicleFourWheelLightConfidence );
+        data.humanWalkingConfidence = std::to_string( d.humanWalkingConfidence );
+        data.humanRunningConfidence = std::to_string( d.humanRunningConfidence );
+        data.humanLoiteringConfidence = std::to_string( d.humanLoiteringConfidence );
+        data.humanCrawlingConfidence = std::to_string( d.humanCrawlingConfidence );
+        data.staticObjectConfidence = std::to_string( d.staticObjectConfidence );
+
+        DetectionReport report( &data );
+        report.Write( &w );
+        if (i % 100 == 99) arena.Reset();
+    }
+    double stringTime = Get_Time_Monotonic() - start;
+
+    delete data.rangeBearing;
+    delete data.objectDopplerSpeed;
+    arena.Reset();
+
+    // The typed path, as Network now does it
+    DetectionReportBuilder builder;
+    builder.Begin( timestamp, nodeID, destID, taskID );
+
+    DetectionReportFields f;
+    double typedTime = 0.0;
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < reports; i++)
+    {
+        Generate_Ulid( f.reportID );
+        f.objectID = d.idText;
+        f.present = DetectionReportFields::DOPPLER_SPEED | DetectionReportFields::HUMAN | DetectionReportFields::VEHICLE |
+            DetectionReportFields::VEHICLE_TWO_WHEEL | DetectionReportFields::VEHICLE_FOUR_WHEEL |
+            DetectionReportFields::VEHICLE_HEAVY | DetectionReportFields::VEHICLE_MEDIUM | DetectionReportFields::VEHICLE_LIGHT |
+            DetectionReportFields::STATIC_OBJECT | DetectionReportFields::UNKNOWN | DetectionReportFields::WALKING |
+            DetectionReportFields::RUNNING | DetectionReportFields::LOITERING | DetectionReportFields::CRAWLING;
+        f.range = d.range;
+        f.rangeError = 1.0f;
+        f.azimuth = d.direction;
+        f.azimuthError = d.directionError;
+        f.detectionConfidence = d.detectionConfidence;
+        f.dopplerSpeed = d.dopplerSpeed;
+        f.dopplerSpeedError = 0.25f;
+        f.humanConfidence = d.humanConfidence;
+        f.vehicleConfidence = d.vehicleConfidence;
+        f.vehicleTwoWheelConfidence = d.vehicleTwoWheelConfidence;
+        f.vehicleFourWheelConfidence = d.vehicleFourWheelConfidence;
+        f.vehicleFourWheelHeavyConfidence = d.vehicleFourWheelHeavyConfidence;
+        f.vehicleFourWheelMediumConfidence = d.vehicleFourWheelMediumConfidence;
+        f.vehicleFourWheelLightConfidence = d.vehicleFourWheelLightConfidence;
+        f.staticObjectConfidence = d.staticObjectConfidence;
+        f.unknownConfidence = d.unknownConfidence;
+        f.humanWalkingConfidence = d.humanWalkingConfidence;
+        f.humanRunningConfidence = d.humanRunningConfidence;
+        f.humanLoiteringConfidence = d.humanLoiteringConfidence;
+        f.humanCrawlingConfidence = d.humanCrawlingConfidence;
+
+        builder.Write( &w, f );
+        if (i % 100 == 99) arena.Reset();
+    }
+    typedTime = Get_Time_Monotonic() - start;
+
+    // Straight to the wire format from the same fields
+    DetectionReportEncoder encoder;
+    encoder.Begin( timestamp, nodeID, destID, taskID );
+
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < reports; i++)
+    {
+        Generate_Ulid( f.reportID );
+        encoder.Write( &discard, f );
+    }
+    double encoderTime = Get_Time_Monotonic() - start;
+
+    LOG( INFO ) << "Detection report benchmark (" << reports << " reports): strings "
+        << stringTime * 1e6 / reports << " us, typed " << typedTime * 1e6 / reports << " us, encoder "
+        << encoderTime * 1e6 / reports << " us per report";
+}
@@ -0,0 +1,109 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Benchmark.h"
+#include "../Sensor/Tracker/Tracker.h"
+#include "../Utils/Angles.h"
+#include "../Utils/Utils.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+
+void BenchmarkTracker()
+{
+    const int targets = 2000;
+    const int clutter = 500;
+    const int frames = 100;
+    const int64_t frameInterval = 100000000;
+    const float rangeNoise = 1.0f;
+    const float azimuthNoise = 0.1f;
+
+    TrackerConfig config;
+    config.rangeGate = 10.0f;
+    config.azimuthGate = 1.0f;
+    config.confirmScore = 3;
+    config.maxTracks = 8192;
+    config.maxPlots = 4096;
+    Tracker tracker( config );
+
+    // Targets spread over 5km all round, closing or opening at up to 30m/s, so many cross in range
+    std::mt19937 generator( 1 );
+    std::uniform_real_distribution<float> uniform( 0.0f, 1.0f );
+    std::normal_distribution<float> normal( 0.0f, 1.0f );
+    std::vector<float> range( targets ), rangeRate( targets ), azimuth( targets ), azimuthRate( targets );
+    for (int i = 0; i < targets; i++)
+    {
+        range[i] = 500.0f + 4500.0f * uniform( generator );
+        rangeRate[i] = -30.0f + 60.0f * uniform( generator );
+        azimuth[i] = 360.0f * uniform( generator );
+        azimuthRate[i] = -0.5f + uniform( generator );
+    }
+
+    std::vector<TrackerPlot> plots;
+    plots.reserve( targets + clutter );
+    int64_t timestamp = Get_Time_UTC_ns();
+    double updateTime = 0.0;
+    for (int f = 0; f < frames; f++)
+    {
+        // Nine in ten targets are seen each frame, among plots of clutter
+        plots.clear();
+        for (int i = 0; i < targets; i++)
+        {
+            range[i] += rangeRate[i] * frameInterval * 1e-9f;
+            azimuth[i] += azimuthRate[i] * frameInterval * 1e-9f;
+            if (uniform( generator ) >= 0.9f) continue;
+            TrackerPlot plot;
+            plot.range = range[i] + rangeNoise * normal( generator );
+            plot.azimuth = azimuth[i] + azimuthNoise * normal( generator );
+            plots.push_back( plot );
+        }
+        for (int i = 0; i < clutter; i++)
+        {
+            TrackerPlot plot;
+            plot.range = 5500.0f * uniform( generator );
+            plot.azimuth = 360.0f * uniform( generator );
+            plots.push_back( plot );
+        }
+
+        timestamp += frameInterval;
+        double start = Get_Time_Monotonic();
+        tracker.Update( timestamp, &plots[0], plots.size() );
+        updateTime += Get_Time_Monotonic() - start;
+    }
+
+    // Match each confirmed track to the nearest target to measure its range rate
+    int confirmed = 0, matched = 0;
+    double squaredError = 0.0;
+    for (size_t t = 0; t < tracker.Size(); t++)
+    {
+        const TrackerTrack &track = tracker.Track( t );
+        if (!track.confirmed) continue;
+        confirmed++;
+
+        int nearest = -1;
+        float nearestDistance = 1.0f;
+        for (int i = 0; i < targets; i++)
+        {
+            float distance = fabsf( track.range - range[i] ) / config.rangeGate + fabsf( DifferenceDegrees( track.azimuth, azimuth[i] ) ) / config.azimuthGate;
+            if (distance < nearestDistance)
+            {
+                nearestDistance = distance;
+                nearest = i;
+            }
+        }
+        if (nearest < 0) continue;
+        matched++;
+        squaredError += (track.rangeRate - rangeRate[nearest]) * (track.rangeRate - rangeRate[nearest]);
+    }
+
+    LOG( INFO ) << "Tracker benchmark (" << targets << " targets, " << clutter << " clutter plots, " << frames << " frames): "
+        << updateTime * 1e3 / frames << " ms per frame, " << confirmed << " confirmed tracks, " << matched
+        << " on a target, range rate error " << (matched ? sqrt( squaredError / matched ) : 0.0) << " m/s RMS";
+}
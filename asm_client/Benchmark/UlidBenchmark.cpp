@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Benchmark.h"
+#include "../Utils/UlidGenerator.h"
+#include "../Utils/Utils.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <string.h>
+#include <string>
+
+void BenchmarkUlids()
+{
+    const int ids = 100000;
+    volatile char sink = 0;
+
+    // As the reports used to: the time in seconds, with no entropy, marshalled to a new string
+    double start = Get_Time_Monotonic();
+    for (int i = 0; i < ids; i++)
+    {
+        ulid::ULID id;
+        ulid::EncodeTimeNow( id );
+        std::string text = ulid::Marshal( id );
+        sink ^= text[25];
+    }
+    double libraryTime = Get_Time_Monotonic() - start;
+
+    // The library's time and entropy, from std::rand
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < ids; i++)
+    {
+        ulid::ULID id;
+        ulid::EncodeTimeSystemClockNow( id );
+        ulid::EncodeEntropyRand( id );
+        char text[26];
+        ulid::MarshalTo( id, text );
+        sink ^= text[25];
+    }
+    double randTime = Get_Time_Monotonic() - start;
+
+    // The thread's generator, marshalled into a fixed buffer
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < ids; i++)
+    {
+        ulid::ULID id;
+        char text[26];
+        Generate_Ulid( id, text );
+        sink ^= text[25];
+    }
+    double generatorTime = Get_Time_Monotonic() - start;
+
+    // As for a pass's detection reports, with the clock read once
+    UlidGenerator &generator = UlidGenerator::ThisThread();
+    int64_t now = Get_Time_UTC_ns();
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < ids; i++)
+    {
+        ulid::ULID id;
+        char text[26];
+        generator.Generate( now, id );
+        ulid::MarshalTo( id, text );
+        sink ^= text[25];
+    }
+    double passTime = Get_Time_Monotonic() - start;
+
+    // An unchanged track's ID, marshalled once and copied for each report
+    ulid::ULID track;
+    char trackText[26];
+    Generate_Ulid( track, trackText );
+    start = Get_Time_Monotonic();
+    for (int i = 0; i < ids; i++)
+    {
+        char text[26];
+        memcpy( text, trackText, sizeof( text ) );
+        sink ^= text[i % 26];
+    }
+    double cachedTime = Get_Time_Monotonic() - start;
+
+    LOG( INFO ) << "ULID benchmark (" << ids << " IDs): library " << libraryTime * 1e9 / ids << " ns, rand "
+        << randTime * 1e9 / ids << " ns, generator " << generatorTime * 1e9 / ids << " ns, generator in a pass "
+        << passTime * 1e9 / ids << " ns, cached text "
+        << cachedTime * 1e9 / ids << " ns per ID";
+}
@@ -0,0 +1,204 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "DetectionBatch.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The vector paths round after each multiply and subtract, so the scalar path must not be
+// contracted into fused multiply-adds, which GCC does by default where the target has them
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if !defined(WANT_SCALAR_GATING) && defined(__SSE2__)
+#include <emmintrin.h>
+#define GATE_SSE2
+#elif !defined(WANT_SCALAR_GATING) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GATE_NEON
+#endif
+
+// Arrays are aligned and sized in whole vectors
+#define BATCH_ALIGNMENT 16
+#define BATCH_LANES 4
+
+
+DetectionBatch::DetectionBatch()
+{
+    size = 0;
+    capacity = 0;
+    range = NULL;
+    direction = NULL;
+    bearing = NULL;
+    selected = NULL;
+}
+
+
+DetectionBatch::~DetectionBatch()
+{
+    free( range );
+    free( direction );
+    free( bearing );
+    free( selected );
+}
+
+
+void DetectionBatch::Reserve( size_t count )
+{
+    if (count <= capacity)
+    {
+        return;
+    }
+
+    capacity = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    free( range );
+    free( direction );
+    free( bearing );
+    free( selected );
+    if (posix_memalign( (void **)&range, BATCH_ALIGNMENT, capacity * sizeof(float) ) != 0 ||
+        posix_memalign( (void **)&direction, BATCH_ALIGNMENT, capacity * sizeof(float) ) != 0 ||
+        posix_memalign( (void **)&bearing, BATCH_ALIGNMENT, capacity * sizeof(float) ) != 0 ||
+        posix_memalign( (void **)&selected, BATCH_ALIGNMENT, capacity ) != 0)
+    {
+        throw "DetectionBatch failed to allocate its arrays";
+    }
+}
+
+
+void DetectionBatch::Load( const std::vector<AsmClientData::Detection> &detections )
+{
+    size = detections.size();
+    Reserve( size );
+    for (size_t i = 0; i < size; i++)
+    {
+        range[i] = detections[i].range;
+        direction[i] = detections[i].direction;
+    }
+}
+
+
+// The vector paths below do exactly these operations, so select the same detections
+void DetectionBatch::GateScalar( size_t from, float compassBearing, float taskBearing, float halfExtent, float minRange, float maxRange )
+{
+    for (size_t i = from; i < size; i++)
+    {
+        float b = compassBearing + direction[i];
+        b -= 360.0f * floorf( b * (1.0f / 360.0f) );
+        if (b < 0.0f) b += 360.0f;
+        if (b >= 360.0f) b -= 360.0f;
+
+        float offset = b - taskBearing + 180.0f;
+        offset -= 360.0f * floorf( offset * (1.0f / 360.0f) );
+        offset -= 180.0f;
+
+        bearing[i] = b;
+        selected[i] = range[i] >= minRange && range[i] <= maxRange && fabsf( offset ) <= halfExtent;
+    }
+}
+
+
+#ifdef GATE_SSE2
+// SSE2 only converts by truncation, so step down where that rounded a negative value up
+static inline __m128 Floor( __m128 x )
+{
+    __m128 t = _mm_cvtepi32_ps( _mm_cvttps_epi32( x ) );
+    return _mm_sub_ps( t, _mm_and_ps( _mm_cmpgt_ps( t, x ), _mm_set1_ps( 1.0f ) ) );
+}
+#endif
+
+#ifdef GATE_NEON
+static inline float32x4_t Floor( float32x4_t x )
+{
+    float32x4_t t = vcvtq_f32_s32( vcvtq_s32_f32( x ) );
+    return vsubq_f32( t, vreinterpretq_f32_u32( vandq_u32( vcgtq_f32( t, x ), vreinterpretq_u32_f32( vdupq_n_f32( 1.0f ) ) ) ) );
+}
+#endif
+
+
+void DetectionBatch::Gate( float compassBearing, float taskBearing, float horizontalExtent, float minRange, float maxRange )
+{
+    float halfExtent = horizontalExtent / 2.0f;
+    size_t i = 0;
+
+#ifdef GATE_SSE2
+    const __m128 compass = _mm_set1_ps( compassBearing );
+    const __m128 task = _mm_set1_ps( taskBearing );
+    const __m128 half = _mm_set1_ps( halfExtent );
+    const __m128 rmin = _mm_set1_ps( minRange );
+    const __m128 rmax = _mm_set1_ps( maxRange );
+    const __m128 full = _mm_set1_ps( 360.0f );
+    const __m128 perTurn = _mm_set1_ps( 1.0f / 360.0f );
+    const __m128 halfTurn = _mm_set1_ps( 180.0f );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7fffffff ) );
+
+    for (; i + BATCH_LANES <= size; i += BATCH_LANES)
+    {
+        __m128 r = _mm_load_ps( range + i );
+        __m128 b = _mm_add_ps( compass, _mm_load_ps( direction + i ) );
+        b = _mm_sub_ps( b, _mm_mul_ps( full, Floor( _mm_mul_ps( b, perTurn ) ) ) );
+        b = _mm_add_ps( b, _mm_and_ps( _mm_cmplt_ps( b, zero ), full ) );
+        b = _mm_sub_ps( b, _mm_and_ps( _mm_cmpge_ps( b, full ), full ) );
+
+        __m128 offset = _mm_add_ps( _mm_sub_ps( b, task ), halfTurn );
+        offset = _mm_sub_ps( offset, _mm_mul_ps( full, Floor( _mm_mul_ps( offset, perTurn ) ) ) );
+        offset = _mm_sub_ps( offset, halfTurn );
+
+        __m128 in = _mm_and_ps( _mm_cmpge_ps( r, rmin ), _mm_cmple_ps( r, rmax ) );
+        in = _mm_and_ps( in, _mm_cmple_ps( _mm_and_ps( offset, absMask ), half ) );
+
+        _mm_store_ps( bearing + i, b );
+        int bits = _mm_movemask_ps( in );
+        selected[i]     = bits & 1;
+        selected[i + 1] = (bits >> 1) & 1;
+        selected[i + 2] = (bits >> 2) & 1;
+        selected[i + 3] = (bits >> 3) & 1;
+    }
+#endif
+
+#ifdef GATE_NEON
+    const float32x4_t compass = vdupq_n_f32( compassBearing );
+    const float32x4_t task = vdupq_n_f32( taskBearing );
+    const float32x4_t half = vdupq_n_f32( halfExtent );
+    const float32x4_t rmin = vdupq_n_f32( minRange );
+    const float32x4_t rmax = vdupq_n_f32( maxRange );
+    const float32x4_t full = vdupq_n_f32( 360.0f );
+    const float32x4_t perTurn = vdupq_n_f32( 1.0f / 360.0f );
+    const float32x4_t halfTurn = vdupq_n_f32( 180.0f );
+    const float32x4_t zero = vdupq_n_f32( 0.0f );
+    const uint32x4_t fullBits = vreinterpretq_u32_f32( full );
+
+    for (; i + BATCH_LANES <= size; i += BATCH_LANES)
+    {
+        float32x4_t r = vld1q_f32( range + i );
+        float32x4_t b = vaddq_f32( compass, vld1q_f32( direction + i ) );
+        b = vsubq_f32( b, vmulq_f32( full, Floor( vmulq_f32( b, perTurn ) ) ) );
+        b = vaddq_f32( b, vreinterpretq_f32_u32( vandq_u32( vcltq_f32( b, zero ), fullBits ) ) );
+        b = vsubq_f32( b, vreinterpretq_f32_u32( vandq_u32( vcgeq_f32( b, full ), fullBits ) ) );
+
+        float32x4_t offset = vaddq_f32( vsubq_f32( b, task ), halfTurn );
+        offset = vsubq_f32( offset, vmulq_f32( full, Floor( vmulq_f32( offset, perTurn ) ) ) );
+        offset = vsubq_f32( offset, halfTurn );
+
+        uint32x4_t in = vandq_u32( vcgeq_f32( r, rmin ), vcleq_f32( r, rmax ) );
+        in = vandq_u32( in, vcleq_f32( vabsq_f32( offset ), half ) );
+
+        vst1q_f32( bearing + i, b );
+        uint32_t lanes[BATCH_LANES];
+        vst1q_u32( lanes, in );
+        selected[i]     = lanes[0] & 1;
+        selected[i + 1] = lanes[1] & 1;
+        selected[i + 2] = lanes[2] & 1;
+        selected[i + 3] = lanes[3] & 1;
+    }
+#endif
+
+    GateScalar( i, compassBearing, taskBearing, halfExtent, minRange, maxRange );
+}
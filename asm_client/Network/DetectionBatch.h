@@ -0,0 +1,51 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "../AsmClient.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// The columns of a pass's detections that decide whether each is reported, held as
+// separate aligned arrays so the gate can test four detections at a time with SSE2 or
+// NEON. Built with WANT_SCALAR_GATING, or for a target with neither, the same arithmetic
+// is done one detection at a time. The arrays are kept between passes and only grow.
+class DetectionBatch
+{
+public:
+    DetectionBatch();
+    ~DetectionBatch();
+
+    void Load( const std::vector<AsmClientData::Detection> &detections );
+
+    // Computes each detection's bearing from north, and selects those within the range
+    // limits and within half the horizontal extent of the task's bearing
+    void Gate( float compassBearing, float taskBearing, float horizontalExtent, float minRange, float maxRange );
+
+    // Gate done one detection at a time, whatever the target, which the vector paths must agree with
+    void GateEach( float compassBearing, float taskBearing, float horizontalExtent, float minRange, float maxRange )
+    {
+        GateScalar( 0, compassBearing, taskBearing, horizontalExtent / 2.0f, minRange, maxRange );
+    }
+
+    size_t Size() const { return size; }
+    const float *Range() const { return range; }
+    const float *Bearing() const { return bearing; }
+    const uint8_t *Selected() const { return selected; }
+
+private:
+    void Reserve( size_t count );
+    void GateScalar( size_t from, float compassBearing, float taskBearing, float halfExtent, float minRange, float maxRange );
+
+    size_t size;
+    size_t capacity;
+    float *range;
+    float *direction;
+    float *bearing;
+    uint8_t *selected;
+};
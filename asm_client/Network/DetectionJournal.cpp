@@ -0,0 +1,422 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "DetectionJournal.h"
+
+#define ELPP_DEFAULT_LOGGER "network"
+#include "../Utils/Log.h"
+
+#include <string.h>
+#include <time.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define JOURNAL_MAGIC 0x4A4D5341   // "ASMJ"
+#define JOURNAL_VERSION 1
+
+// Marks the end of the used part of the ring before it wraps back to the start
+#define RECORD_WRAP 0xFFFFFFFF
+
+// Frames start with a 4 byte little-endian length, see bsi-flex-335.pdf section 4.2
+#define FRAME_HEADER 4
+
+// SapientMessage.destination_id, length delimited
+#define DESTINATION_ID_FIELD 3
+#define TAG_DESTINATION_ID ((DESTINATION_ID_FIELD << 3) | 2)
+
+// Kept at the start of the file, so the ring survives restarts
+struct JournalHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t head;      // Offset of the oldest record
+    uint64_t tail;      // Offset the next record is written at
+    uint64_t used;      // Bytes between head and tail, including any skipped at the end of the ring
+    uint64_t frames;
+};
+
+// Each frame is preceded by its length and the time it was written. Records are 8 byte aligned.
+struct JournalRecord
+{
+    uint32_t length;
+    uint32_t reserved;
+    int64_t time;
+};
+
+static uint64_t RecordSize( size_t length )
+{
+    return (sizeof( JournalRecord ) + length + 7) & ~(uint64_t)7;
+}
+
+
+static bool ReadVarint( const unsigned char *p, const unsigned char *end, const unsigned char **next, uint64_t *value )
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7)
+    {
+        unsigned char byte = *p++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *next = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static unsigned char *PutVarint( unsigned char *p, uint64_t value )
+{
+    while (value >= 0x80)
+    {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+
+// Finds where the destination field of a frame's payload starts and ends. The top level fields are in
+// field number order, so when there is no destination both are where it would go. Returns false if the
+// payload is not well formed.
+static bool FindDestination( const unsigned char *payload, size_t length, size_t *start, size_t *end )
+{
+    const unsigned char *p = payload;
+    const unsigned char *stop = payload + length;
+    while (p < stop)
+    {
+        const unsigned char *field = p;
+        uint64_t tag, value;
+        if (!ReadVarint( p, stop, &p, &tag )) return false;
+
+        switch (tag & 0x07)
+        {
+            case 0:     // Varint
+                if (!ReadVarint( p, stop, &p, &value )) return false;
+                break;
+            case 1:     // Fixed 64
+                p += 8;
+                break;
+            case 2:     // Length delimited
+                if (!ReadVarint( p, stop, &p, &value ) || value > (uint64_t)(stop - p)) return false;
+                p += value;
+                break;
+            case 5:     // Fixed 32
+                p += 4;
+                break;
+            default:
+                return false;
+        }
+        if (p > stop) return false;
+
+        if ((tag >> 3) == DESTINATION_ID_FIELD)
+        {
+            *start = field - payload;
+            *end = p - payload;
+            return true;
+        }
+        if ((tag >> 3) > DESTINATION_ID_FIELD)
+        {
+            *start = *end = field - payload;
+            return true;
+        }
+    }
+    *start = *end = length;
+    return true;
+}
+
+
+DetectionJournal::DetectionJournal()
+{
+    fd = -1;
+    mapping = nullptr;
+    mappingSize = 0;
+    header = nullptr;
+    ring = nullptr;
+    capacity = 0;
+    reserved = 0;
+    dropped = 0;
+    warnedFull = false;
+}
+
+DetectionJournal::~DetectionJournal()
+{
+#ifdef __unix__
+    if (mapping != nullptr)
+    {
+        msync( mapping, mappingSize, MS_SYNC );
+        munmap( mapping, mappingSize );
+    }
+    if (fd >= 0) close( fd );
+#else
+    delete[] mapping;
+#endif
+}
+
+bool DetectionJournal::Open( const std::string &filename, size_t size )
+{
+    mappingSize = (sizeof( JournalHeader ) + size + 7) & ~(size_t)7;
+
+#ifdef __unix__
+    fd = open( filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+    if (fd < 0)
+    {
+        LOG( ERROR ) << "Failed to open detection journal '" << filename << "'";
+        return false;
+    }
+    if (ftruncate( fd, mappingSize ) != 0)
+    {
+        LOG( ERROR ) << "Failed to size detection journal '" << filename << "'";
+        return false;
+    }
+    void *p = mmap( NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if (p == MAP_FAILED)
+    {
+        LOG( ERROR ) << "Failed to map detection journal '" << filename << "'";
+        return false;
+    }
+    mapping = (unsigned char *)p;
+#else
+    // No persistence, but the ring still covers outages while running
+    mapping = new unsigned char[mappingSize]();
+#endif
+
+    header = (JournalHeader *)mapping;
+    ring = mapping + sizeof( JournalHeader );
+    capacity = mappingSize - sizeof( JournalHeader );
+
+    if (header->magic != JOURNAL_MAGIC || header->version != JOURNAL_VERSION || header->capacity != capacity ||
+        header->head >= capacity || header->tail >= capacity || header->used > capacity)
+    {
+        memset( header, 0, sizeof( JournalHeader ) );
+        header->magic = JOURNAL_MAGIC;
+        header->version = JOURNAL_VERSION;
+        header->capacity = capacity;
+    }
+    else if (header->frames > 0)
+    {
+        LOG( INFO ) << "Detection journal holds " << header->frames << " frames from before restarting";
+    }
+    return true;
+}
+
+bool DetectionJournal::Empty()
+{
+    return header == nullptr || header->frames == 0;
+}
+
+unsigned long DetectionJournal::Frames()
+{
+    return header == nullptr ? 0 : (unsigned long)header->frames;
+}
+
+bool DetectionJournal::AtWrap( uint64_t offset )
+{
+    return offset + sizeof( JournalRecord ) > capacity ||
+        ((JournalRecord *)&ring[offset])->length == RECORD_WRAP;
+}
+
+void DetectionJournal::DropOldest()
+{
+    if (header->used == 0) return;
+
+    if (AtWrap( header->head ))
+    {
+        header->used -= capacity - header->head;
+        header->head = 0;
+        return;
+    }
+
+    uint64_t size = RecordSize( ((JournalRecord *)&ring[header->head])->length );
+    if (size > header->used || header->head + size > capacity)
+    {
+        LOG( WARNING ) << "Detection journal is corrupt, discarding it";
+        header->head = header->tail = header->used = header->frames = 0;
+        return;
+    }
+    header->head += size;
+    header->used -= size;
+    header->frames--;
+    if (header->head == capacity) header->head = 0;
+}
+
+void DetectionJournal::MakeRoom( uint64_t bytes )
+{
+    uint64_t frames = header->frames;
+    while (capacity - header->used < bytes && header->used > 0)
+    {
+        DropOldest();
+    }
+    dropped += (unsigned long)(frames - header->frames);
+    if (header->used == 0)
+    {
+        header->head = 0;
+        header->tail = 0;
+    }
+}
+
+unsigned char *DetectionJournal::Reserve( size_t iOctets )
+{
+    if (header == nullptr) return NULL;
+
+    uint64_t size = RecordSize( iOctets );
+    if (size > capacity / 2) return NULL;
+
+    // Records are contiguous, so skip the end of the ring if the record will not fit there
+    if (header->tail + size > capacity)
+    {
+        uint64_t skip = capacity - header->tail;
+        MakeRoom( skip );
+        if (header->used != 0)
+        {
+            if (skip >= sizeof( JournalRecord )) ((JournalRecord *)&ring[header->tail])->length = RECORD_WRAP;
+            header->used += skip;
+            header->tail = 0;
+        }
+    }
+    MakeRoom( size );
+
+    reserved = size;
+    return &ring[header->tail + sizeof( JournalRecord )];
+}
+
+bool DetectionJournal::Commit( size_t iOctets )
+{
+    if (header == nullptr || RecordSize( iOctets ) != reserved) return false;
+
+    // The header is only updated after the frame is in place
+    JournalRecord *record = (JournalRecord *)&ring[header->tail];
+    record->length = (uint32_t)iOctets;
+    record->reserved = 0;
+    record->time = (int64_t)time( NULL );
+
+    header->tail += reserved;
+    if (header->tail == capacity) header->tail = 0;
+    header->used += reserved;
+    header->frames++;
+    reserved = 0;
+
+    // Warn once, then report the total when the journal has been emptied
+    if (dropped > 0 && !warnedFull)
+    {
+        LOG( WARNING ) << "Detection journal full, dropping the oldest frames";
+        warnedFull = true;
+    }
+    return true;
+}
+
+bool DetectionJournal::Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote )
+{
+    unsigned char *p = Reserve( iOctets );
+    if (p == NULL) return false;
+
+    memcpy( p, pOctets, iOctets );
+    iWrote = iOctets;
+    return Commit( iOctets );
+}
+
+void DetectionJournal::Close()
+{
+    // Nothing to close until destroyed, but make sure the file is up to date
+#ifdef __unix__
+    if (mapping != nullptr) msync( mapping, mappingSize, MS_ASYNC );
+#endif
+}
+
+// Writes a journalled frame to out with its destination replaced by destID
+bool DetectionJournal::ReplayFrame( IOutputStream *out, const unsigned char *frame, size_t length, const std::string &destID )
+{
+    size_t start, end;
+    if (length < FRAME_HEADER || !FindDestination( frame + FRAME_HEADER, length - FRAME_HEADER, &start, &end ))
+    {
+        LOG( WARNING ) << "Discarding a malformed journalled detection";
+        return true;
+    }
+    start += FRAME_HEADER;
+    end += FRAME_HEADER;
+
+    unsigned char field[11];
+    field[0] = TAG_DESTINATION_ID;
+    size_t fieldLength = PutVarint( &field[1], destID.length() ) - field;
+    size_t messageSize = length - FRAME_HEADER - (end - start) + fieldLength + destID.length();
+    size_t frameSize = FRAME_HEADER + messageSize;
+
+    unsigned char *p = out->Reserve( frameSize );
+    bool inPlace = (p != NULL);
+    if (!inPlace)
+    {
+        scratch.resize( frameSize );
+        p = (unsigned char *)&scratch[0];
+    }
+
+    unsigned char *q = p;
+    *q++ = (unsigned char)messageSize;
+    *q++ = (unsigned char)(messageSize >> 8);
+    *q++ = (unsigned char)(messageSize >> 16);
+    *q++ = (unsigned char)(messageSize >> 24);
+    memcpy( q, frame + FRAME_HEADER, start - FRAME_HEADER );
+    q += start - FRAME_HEADER;
+    memcpy( q, field, fieldLength );
+    q += fieldLength;
+    memcpy( q, destID.data(), destID.length() );
+    q += destID.length();
+    memcpy( q, frame + end, length - end );
+
+    if (inPlace)
+    {
+        return out->Commit( frameSize );
+    }
+    size_t wrote;
+    return out->Write( p, frameSize, wrote );
+}
+
+int DetectionJournal::Replay( IOutputStream *out, int maxFrames, double maxAge, const std::string &destID )
+{
+    if (header == nullptr) return 0;
+
+    int64_t now = (int64_t)time( NULL );
+    int sent = 0;
+    unsigned long expired = 0;
+    while (header->frames > 0 && sent < maxFrames)
+    {
+        if (AtWrap( header->head ))
+        {
+            DropOldest();
+            continue;
+        }
+
+        JournalRecord *record = (JournalRecord *)&ring[header->head];
+        unsigned char *frame = &ring[header->head + sizeof( JournalRecord )];
+        if (maxAge > 0 && now - record->time > maxAge)
+        {
+            expired++;
+        }
+        else
+        {
+            if (!ReplayFrame( out, frame, record->length, destID )) break;
+            sent++;
+        }
+        DropOldest();
+    }
+
+    if (expired > 0)
+    {
+        LOG( INFO ) << "Discarded " << expired << " journalled detections older than " << maxAge << "s";
+    }
+    if (header->frames == 0 && dropped > 0)
+    {
+        LOG( INFO ) << "Dropped " << dropped << " detections while the journal was full";
+        dropped = 0;
+        warnedFull = false;
+    }
+    return sent;
+}
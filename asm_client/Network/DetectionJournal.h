@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "ProtobufInterface/Stream.h"
+
+#include <stdint.h>
+#include <string>
+
+struct JournalHeader;
+
+// Append-only ring of encoded frames in a memory mapped file, used to keep detection
+// reports while the DMM cannot be reached and send them once it can. When the ring is
+// full the oldest frames are dropped. Messages are written into it through a Writer,
+// which serializes each frame straight into the mapping.
+class DetectionJournal : public IOutputStream
+{
+public:
+    DetectionJournal();
+    virtual ~DetectionJournal();
+
+    // Maps (creating if necessary) a journal file of the given size. Frames already in
+    // a journal of the same size are kept. Returns false if the file could not be mapped.
+    bool Open( const std::string &filename, size_t size );
+
+    bool Empty();
+    unsigned long Frames();
+
+    // Writes up to maxFrames of the oldest frames to out, discarding any older than maxAge seconds.
+    // Each frame is addressed to destID, as the destination may have changed since it was journalled.
+    // Returns the number of frames written.
+    int Replay( IOutputStream *out, int maxFrames, double maxAge, const std::string &destID );
+
+    // IOutputStream, used by the Writer to append a frame
+    virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote );
+    virtual bool Send( bool bTerminator ) { return true; }
+    virtual void Close();
+    virtual unsigned char *Reserve( size_t iOctets );
+    virtual bool Commit( size_t iOctets );
+
+private:
+    void MakeRoom( uint64_t bytes );
+    void DropOldest();
+    bool AtWrap( uint64_t offset );
+    bool ReplayFrame( IOutputStream *out, const unsigned char *frame, size_t length, const std::string &destID );
+
+    int fd;
+    unsigned char *mapping;
+    size_t mappingSize;
+    struct JournalHeader *header;
+    unsigned char *ring;
+    uint64_t capacity;
+    uint64_t reserved;
+    unsigned long dropped;
+    bool warnedFull;
+
+    // Holds a readdressed frame when the output stream cannot be written in place
+    std::string scratch;
+};
@@ -5,6 +5,7 @@
 
 #include "DetectionReport.h"
 #include "ProtobufInterface/Writer.h"
+#include "../Utils/UlidGenerator.h"
 
 #define ELPP_DEFAULT_LOGGER "network"
 #include "../Utils/Log.h"
@@ -12,21 +13,21 @@
 #include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
 namespace sap = sapient_msg::bsi_flex_335_v2_0;
 
-#include <google/protobuf/util/time_util.h>
 #include <google/protobuf/util/json_util.h>
 
+#include <stdio.h>
+
 
 static bool SetTimestamp( google::protobuf::Timestamp* timestamp, DetectionReportData* data )
 {
-    google::protobuf::Timestamp ts;
-    if( !google::protobuf::util::TimeUtil::FromString( data->timestamp, &ts ) )
+    if( data->timestamp <= 0 )
     {
-        LOG( ERROR ) << "DetectionReport failed to convert timestamp.";
+        LOG( ERROR ) << "DetectionReport has no timestamp.";
         return false;
     }
 
-    timestamp->set_seconds( ts.seconds() );
-    timestamp->set_nanos(0);
+    timestamp->set_seconds( data->timestamp / 1000000000 );
+    timestamp->set_nanos( (int32_t)(data->timestamp % 1000000000) );
     return true;
 }
 
@@ -43,7 +44,7 @@ static void SetRangeBearing( sap::RangeBearing* rb, const DetectionReportLocatio
 }
 
 
-static void SetTrackInfo( sap::DetectionReport* det, std::string type, const DetectionReportValue *v )
+static void SetTrackInfo( sap::DetectionReport* det, const char *type, const DetectionReportValue *v )
 {
     if( v )
     {
@@ -55,7 +56,7 @@ static void SetTrackInfo( sap::DetectionReport* det, std::string type, const Det
 }
 
 
-static void SetObjectInfo( sap::DetectionReport* det, std::string type, const DetectionReportValue *v )
+static void SetObjectInfo( sap::DetectionReport* det, const char *type, const DetectionReportValue *v )
 {
     if( v )
     {
@@ -69,18 +70,20 @@ static void SetObjectInfo( sap::DetectionReport* det, std::string type, const De
 
 static bool SetDetectionReport( sap::DetectionReport* det, DetectionReportData* data )
 {
+    // Marshal the IDs straight into the fields rather than through temporary strings
+    char str_id[26];
+
     ulid::ULID rep_id;
-    ulid::EncodeTimeNow( rep_id );
-    std::string str_rep_id = ulid::Marshal( rep_id );
-    det->set_report_id( str_rep_id );
+    Generate_Ulid( rep_id, str_id );
+    det->set_report_id( str_id, sizeof( str_id ) );
 
-    std::string str_obj_id = ulid::Marshal( data->objectID );
-    det->set_object_id( str_obj_id );
+    ulid::MarshalTo( data->objectID, str_id );
+    det->set_object_id( str_id, sizeof( str_id ) );
 
     if( !data->taskID.IsZero() )
     {
-        std::string str_task_id = ulid::Marshal( data->taskID );
-        det->set_task_id( str_task_id );
+        ulid::MarshalTo( data->taskID, str_id );
+        det->set_task_id( str_id, sizeof( str_id ) );
     }
 
     if( data->state.length() )
@@ -209,53 +212,205 @@ static bool SetDetectionReport( sap::DetectionReport* det, DetectionReportData*
 }
 
 
-bool DetectionReport::Write( ProtobufInterface::Writer *w )
+DetectionReportBuilder::DetectionReportBuilder()
+{
+    timestamp = 0;
+    nodeID = nullptr;
+    destID = nullptr;
+}
+
+
+void DetectionReportBuilder::Begin( int64_t ts, const std::string &node, const std::string &dest, const ulid::ULID &task )
+{
+    timestamp = ts;
+    nodeID = &node;
+    destID = &dest;
+    taskID = task;
+}
+
+
+static sap::DetectionReport::DetectionReportClassification* AddClassification( sap::DetectionReport* det, const char *type, float confidence )
+{
+    sap::DetectionReport::DetectionReportClassification* dr = det->add_classification();
+    dr->set_type( type );
+    dr->set_confidence( confidence );
+    return dr;
+}
+
+
+static void AddSubClass( sap::DetectionReport::DetectionReportClassification* dr, int level, const char *type, float confidence )
+{
+    sap::DetectionReport_SubClass* sdr = dr->add_sub_class();
+    sdr->set_level( level );
+    sdr->set_type( type );
+    sdr->set_confidence( confidence );
+}
+
+
+static void AddBehaviour( sap::DetectionReport* det, const char *type, float confidence )
 {
-    sap::SapientMessage msg;
+    sap::DetectionReport_Behaviour* beh = det->add_behaviour();
+    beh->set_type( type );
+    beh->set_confidence( confidence );
+}
+
 
-    if( !SetTimestamp( msg.mutable_timestamp(), data ) )
+bool DetectionReportBuilder::Write( ProtobufInterface::Writer *w, const DetectionReportFields &f )
+{
+    if( nodeID == nullptr )
     {
+        LOG( ERROR ) << "DetectionReportBuilder written before Begin.";
         return false;
     }
 
-    msg.set_node_id( data->nodeID );
-    msg.set_destination_id( data->destID );
+    ArenaMessage<sap::SapientMessage> msg( w->arena() );
+
+    msg->mutable_timestamp()->set_seconds( timestamp / 1000000000 );
+    msg->mutable_timestamp()->set_nanos( (int32_t)(timestamp % 1000000000) );
+    msg->set_node_id( *nodeID );
+    msg->set_destination_id( *destID );
+
+    // Fields are added in the same order as SetDetectionReport, so both paths encode alike
+    sap::DetectionReport* det = msg->mutable_detection_report();
 
-    if( !SetDetectionReport( msg.mutable_detection_report(), data ) )
+    char str_id[26];
+    ulid::MarshalTo( f.reportID, str_id );
+    det->set_report_id( str_id, sizeof( str_id ) );
+
+    det->set_object_id( f.objectID, sizeof( str_id ) );
+
+    if( !taskID.IsZero() )
     {
-        return false;
+        ulid::MarshalTo( taskID, str_id );
+        det->set_task_id( str_id, sizeof( str_id ) );
     }
 
-    if( msg.IsInitialized() )
+    sap::RangeBearing* rb = det->mutable_range_bearing();
+    rb->set_range( f.range );
+    rb->set_azimuth( f.azimuth );
+    rb->set_range_error( f.rangeError );
+    rb->set_azimuth_error( f.azimuthError );
+    rb->set_coordinate_system( sap::RANGE_BEARING_COORDINATE_SYSTEM_DEGREES_M );
+    rb->set_datum( sap::RANGE_BEARING_DATUM_PLATFORM );
+
+    det->set_detection_confidence( f.detectionConfidence );
+
+    if( f.present & DetectionReportFields::DOPPLER_SPEED )
     {
-#ifdef WANT_PROTOBUF_DEBUG_JSON
-        std::string json;
-        google::protobuf::util::MessageToJsonString( msg, &json );
-        LOG( INFO ) << json;
-#endif
+        // The SAPIENT value is text, formatted as std::to_string would, which for the largest float is 47 characters
+        char value[64];
+        int length = snprintf( value, sizeof( value ), "%f", f.dopplerSpeed );
 
-        uint32_t len = msg.ByteSizeLong();
-        uint8_t *p_bytes = new uint8_t[ len + 4 ];
-        if( p_bytes != nullptr )
+        sap::DetectionReport::TrackObjectInfo *obj = det->add_object_info();
+        obj->set_type( "dopplerSpeed" );
+        obj->set_value( value, length );
+        obj->set_error( f.dopplerSpeedError );
+    }
+
+    if( f.present & DetectionReportFields::HUMAN )
+    {
+        AddClassification( det, "Human", f.humanConfidence );
+    }
+
+    if( f.present & DetectionReportFields::VEHICLE )
+    {
+        sap::DetectionReport::DetectionReportClassification* dr = AddClassification( det, "Vehicle", f.vehicleConfidence );
+
+        if( f.present & DetectionReportFields::VEHICLE_TWO_WHEEL )
         {
-            uint8_t *p = p_bytes;
-            *p++ = len & 0xFF;
-            *p++ = (len >> 8) & 0xFF;
-            *p++ = (len >> 16) & 0xFF;
-            *p++ = (len >> 24) & 0xFF;
-            if( msg.SerializeToArray( p_bytes + 4, len ) )
+            AddSubClass( dr, 1, "Vehicle Class 2 Wheel", f.vehicleTwoWheelConfidence );
+        }
+
+        if( f.present & DetectionReportFields::VEHICLE_FOUR_WHEEL )
+        {
+            AddSubClass( dr, 1, "Vehicle Class 4 Wheel", f.vehicleFourWheelConfidence );
+
+            if( f.present & DetectionReportFields::VEHICLE_HEAVY )
             {
-                w->writeBytes( p_bytes, len + 4 );
+                AddSubClass( dr, 2, "Heavy", f.vehicleFourWheelHeavyConfidence );
             }
-            else
+            if( f.present & DetectionReportFields::VEHICLE_MEDIUM )
             {
-                LOG( ERROR ) << "Detection Report failed to serialize.";
-                return false;
+                AddSubClass( dr, 2, "Medium", f.vehicleFourWheelMediumConfidence );
+            }
+            if( f.present & DetectionReportFields::VEHICLE_LIGHT )
+            {
+                AddSubClass( dr, 2, "Light", f.vehicleFourWheelLightConfidence );
             }
         }
-        else
+    }
+
+    if( f.present & DetectionReportFields::STATIC_OBJECT )
+    {
+        AddClassification( det, "Static Object", f.staticObjectConfidence );
+    }
+
+    if( f.present & DetectionReportFields::UNKNOWN )
+    {
+        AddClassification( det, "Unknown", f.unknownConfidence );
+    }
+
+    if( f.present & DetectionReportFields::WALKING )
+    {
+        AddBehaviour( det, "Walking", f.humanWalkingConfidence );
+    }
+    if( f.present & DetectionReportFields::RUNNING )
+    {
+        AddBehaviour( det, "Running", f.humanRunningConfidence );
+    }
+    if( f.present & DetectionReportFields::LOITERING )
+    {
+        AddBehaviour( det, "Loitering", f.humanLoiteringConfidence );
+    }
+    if( f.present & DetectionReportFields::CRAWLING )
+    {
+        AddBehaviour( det, "Crawling", f.humanCrawlingConfidence );
+    }
+
+#ifdef WANT_PROTOBUF_DEBUG_JSON
+    std::string json;
+    google::protobuf::util::MessageToJsonString( *msg, &json );
+    LOG( INFO ) << json;
+#endif
+
+    if( !w->writeMessage( *msg ) )
+    {
+        LOG( ERROR ) << "Detection Report failed to serialize.";
+        return false;
+    }
+    return true;
+}
+
+
+bool DetectionReport::Write( ProtobufInterface::Writer *w )
+{
+    // Built on the pass arena, so the nested messages and strings need no heap allocations of their own
+    ArenaMessage<sap::SapientMessage> msg( w->arena() );
+
+    if( !SetTimestamp( msg->mutable_timestamp(), data ) )
+    {
+        return false;
+    }
+
+    msg->set_node_id( data->nodeID );
+    msg->set_destination_id( data->destID );
+
+    if( !SetDetectionReport( msg->mutable_detection_report(), data ) )
+    {
+        return false;
+    }
+
+    if( msg->IsInitialized() )
+    {
+#ifdef WANT_PROTOBUF_DEBUG_JSON
+        std::string json;
+        google::protobuf::util::MessageToJsonString( *msg, &json );
+        LOG( INFO ) << json;
+#endif
+
+        if( !w->writeMessage( *msg ) )
         {
-            LOG( ERROR ) << "Detection Report failed to allocate serialize buffer.";
+            LOG( ERROR ) << "Detection Report failed to serialize.";
             return false;
         }
     }
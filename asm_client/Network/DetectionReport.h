@@ -9,6 +9,7 @@
 #include "ProtobufInterface/Writer.h"
 #include "../Utils/Ulid.h"
 
+#include <stdint.h>
 #include <string>
 
 struct DetectionReportLocationRB
@@ -27,7 +28,7 @@ struct DetectionReportValue
 
 struct DetectionReportData
 {
-    std::string timestamp;
+    int64_t     timestamp; // UTC nanoseconds since the epoch
     std::string nodeID;
     std::string destID;
     ulid::ULID  objectID;
@@ -67,6 +68,8 @@ struct DetectionReportData
 
     DetectionReportData()
     {
+        timestamp = 0;
+
         trackConfidence = nullptr;
         trackSpeed = nullptr;
         trackAZ = nullptr;
@@ -82,6 +85,78 @@ struct DetectionReportData
     }
 };
 
+// Numeric contents of a detection report, filled straight from a sensor's detection so
+// the per-detection path needs no string conversions. Optional values are only reported
+// if their bit is set in present.
+struct DetectionReportFields
+{
+    enum Optional
+    {
+        DOPPLER_SPEED       = 1 << 0,
+        HUMAN               = 1 << 1,
+        VEHICLE             = 1 << 2,
+        VEHICLE_TWO_WHEEL   = 1 << 3,   // Sub-classes are only reported with VEHICLE
+        VEHICLE_FOUR_WHEEL  = 1 << 4,
+        VEHICLE_HEAVY       = 1 << 5,   // Only reported with VEHICLE_FOUR_WHEEL
+        VEHICLE_MEDIUM      = 1 << 6,
+        VEHICLE_LIGHT       = 1 << 7,
+        STATIC_OBJECT       = 1 << 8,
+        UNKNOWN             = 1 << 9,
+        WALKING             = 1 << 10,
+        RUNNING             = 1 << 11,
+        LOITERING           = 1 << 12,
+        CRAWLING            = 1 << 13,
+    };
+
+    ulid::ULID reportID;
+    const char *objectID;   // The 26 characters of the detection's ID, as marshalled by its sensor
+    unsigned present;
+
+    float range;
+    float rangeError;
+    float azimuth;
+    float azimuthError;
+    float detectionConfidence;
+
+    float dopplerSpeed;
+    float dopplerSpeedError;
+
+    float humanConfidence;
+    float vehicleConfidence;
+    float vehicleTwoWheelConfidence;
+    float vehicleFourWheelConfidence;
+    float vehicleFourWheelHeavyConfidence;
+    float vehicleFourWheelMediumConfidence;
+    float vehicleFourWheelLightConfidence;
+    float staticObjectConfidence;
+    float unknownConfidence;
+    float humanWalkingConfidence;
+    float humanRunningConfidence;
+    float humanLoiteringConfidence;
+    float humanCrawlingConfidence;
+};
+
+// Writes detection reports from DetectionReportFields. What is common to every report in
+// a pass (timestamp, IDs) is set once with Begin rather than for each detection.
+class DetectionReportBuilder
+{
+public:
+    DetectionReportBuilder();
+
+    // The timestamp is in UTC nanoseconds since the epoch
+    void Begin( int64_t timestamp, const std::string &nodeID, const std::string &destID, const ulid::ULID &taskID );
+
+    bool Write( ProtobufInterface::Writer *w, const DetectionReportFields &fields );
+
+private:
+    int64_t timestamp;
+    const std::string *nodeID;
+    const std::string *destID;
+    ulid::ULID taskID;
+};
+
+// The string based message, kept for callers that only have text values. Detections
+// from the sensors go through DetectionReportBuilder instead.
 class DetectionReport : public Message
 {
 public:
@@ -97,4 +172,3 @@ public:
 private:
     DetectionReportData *data;
 };
-
@@ -0,0 +1,439 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "DetectionReportEncoder.h"
+
+#define ELPP_DEFAULT_LOGGER "network"
+#include "../Utils/Log.h"
+
+#include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
+namespace sap = sapient_msg::bsi_flex_335_v2_0;
+
+#include <google/protobuf/timestamp.pb.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Field tags (field number << 3 | wire type) of the messages encoded here
+#define TAG_SAPIENT_TIMESTAMP           0x0A
+#define TAG_SAPIENT_NODE_ID             0x12
+#define TAG_SAPIENT_DESTINATION_ID      0x1A
+#define TAG_SAPIENT_DETECTION_REPORT    0x3A
+#define TAG_TIMESTAMP_SECONDS           0x08
+#define TAG_TIMESTAMP_NANOS             0x10
+#define TAG_REPORT_ID                   0x0A
+#define TAG_OBJECT_ID                   0x12
+#define TAG_TASK_ID                     0x1A
+#define TAG_RANGE_BEARING               0x2A
+#define TAG_DETECTION_CONFIDENCE        0x3D
+#define TAG_OBJECT_INFO                 0x52
+#define TAG_CLASSIFICATION              0x5A
+#define TAG_BEHAVIOUR                   0x62
+#define TAG_RB_AZIMUTH                  0x11
+#define TAG_RB_RANGE                    0x19
+#define TAG_RB_AZIMUTH_ERROR            0x29
+#define TAG_RB_RANGE_ERROR              0x31
+#define TAG_RB_COORDINATE_SYSTEM        0x38
+#define TAG_RB_DATUM                    0x40
+#define TAG_TYPE                        0x0A    // Field 1 of TrackObjectInfo, classifications and behaviours
+#define TAG_INFO_VALUE                  0x12
+#define TAG_INFO_ERROR                  0x1D
+#define TAG_CONFIDENCE                  0x15    // Field 2 of classifications, sub-classes and behaviours
+#define TAG_CLASSIFICATION_SUB_CLASS    0x1A
+#define TAG_SUB_CLASS_LEVEL             0x18
+
+#define ULID_LENGTH 26
+#define ID_FIELD_SIZE (2 + ULID_LENGTH)
+#define FLOAT_FIELD_SIZE 5
+#define DOUBLE_FIELD_SIZE 9
+
+// Azimuth, range and their errors, then the coordinate system and datum, neither of which exceeds 127
+#define RANGE_BEARING_SIZE (4 * DOUBLE_FIELD_SIZE + 2 + 2)
+
+// Frames start with a 4 byte little-endian length, see bsi-flex-335.pdf section 4.2
+#define FRAME_HEADER 4
+
+
+static size_t VarintSize( uint64_t value )
+{
+    size_t length = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+
+// Each Put function writes at p and returns the byte after what it wrote, or NULL if that
+// would pass end. A NULL p is passed along, so a sequence of them only needs checking at the end.
+static inline bool Fits( const unsigned char *p, const unsigned char *end, size_t size )
+{
+    return p != NULL && size <= (size_t)(end - p);
+}
+
+
+static inline unsigned char *PutByte( unsigned char *p, const unsigned char *end, unsigned char value )
+{
+    if (!Fits( p, end, 1 )) return NULL;
+    *p = value;
+    return p + 1;
+}
+
+
+static inline unsigned char *PutBytes( unsigned char *p, const unsigned char *end, const void *bytes, size_t length )
+{
+    if (!Fits( p, end, length )) return NULL;
+    memcpy( p, bytes, length );
+    return p + length;
+}
+
+
+static inline unsigned char *PutVarint( unsigned char *p, const unsigned char *end, uint64_t value )
+{
+    if (!Fits( p, end, VarintSize( value ) )) return NULL;
+    while (value >= 0x80)
+    {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+
+// The length and fields of a Timestamp, which leaves out zero seconds or nanoseconds as the generated code does
+static unsigned char *PutTimestamp( unsigned char *p, const unsigned char *end, int64_t seconds, int32_t nanos )
+{
+    if (!Fits( p, end, 1 )) return NULL;
+    unsigned char *length = p++;
+    if (seconds != 0)
+    {
+        p = PutByte( p, end, TAG_TIMESTAMP_SECONDS );
+        p = PutVarint( p, end, (uint64_t)seconds );
+    }
+    if (nanos != 0)
+    {
+        p = PutByte( p, end, TAG_TIMESTAMP_NANOS );
+        p = PutVarint( p, end, (uint64_t)nanos );
+    }
+    if (p == NULL) return NULL;
+    *length = (unsigned char)(p - length - 1);
+    return p;
+}
+
+
+static inline unsigned char *PutFloat( unsigned char *p, const unsigned char *end, unsigned char tag, float value )
+{
+    if (!Fits( p, end, FLOAT_FIELD_SIZE )) return NULL;
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    p[0] = tag;
+    p[1] = (unsigned char)bits;
+    p[2] = (unsigned char)(bits >> 8);
+    p[3] = (unsigned char)(bits >> 16);
+    p[4] = (unsigned char)(bits >> 24);
+    return p + FLOAT_FIELD_SIZE;
+}
+
+
+static inline unsigned char *PutDouble( unsigned char *p, const unsigned char *end, unsigned char tag, double value )
+{
+    if (!Fits( p, end, DOUBLE_FIELD_SIZE )) return NULL;
+    uint64_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    *p++ = tag;
+    for (int i = 0; i < 8; i++)
+    {
+        *p++ = (unsigned char)(bits >> (8 * i));
+    }
+    return p;
+}
+
+
+static inline unsigned char *PutFragment( unsigned char *p, const unsigned char *end, const DetectionReportEncoder::Fragment &fragment )
+{
+    return PutBytes( p, end, fragment.bytes, fragment.length );
+}
+
+
+static inline unsigned char *PutUlid( unsigned char *p, const unsigned char *end, unsigned char tag, const ulid::ULID &id )
+{
+    if (!Fits( p, end, ID_FIELD_SIZE )) return NULL;
+    p[0] = tag;
+    p[1] = ULID_LENGTH;
+    ulid::MarshalTo( id, (char *)&p[2] );
+    return p + ID_FIELD_SIZE;
+}
+
+
+static inline unsigned char *PutUlidText( unsigned char *p, const unsigned char *end, unsigned char tag, const char *text )
+{
+    if (!Fits( p, end, ID_FIELD_SIZE )) return NULL;
+    p[0] = tag;
+    p[1] = ULID_LENGTH;
+    memcpy( &p[2], text, ULID_LENGTH );
+    return p + ID_FIELD_SIZE;
+}
+
+
+static void MakeFragment( DetectionReportEncoder::Fragment &fragment, const char *type )
+{
+    size_t length = strlen( type );
+    fragment.bytes[0] = TAG_TYPE;
+    fragment.bytes[1] = (unsigned char)length;
+    memcpy( &fragment.bytes[2], type, length );
+    fragment.length = 2 + length;
+}
+
+
+static void AppendString( std::string &out, unsigned char tag, const std::string &value )
+{
+    unsigned char prefix[11];
+    prefix[0] = tag;
+    size_t length = PutVarint( &prefix[1], prefix + sizeof( prefix ), value.length() ) - prefix;
+    out.append( (const char *)prefix, length );
+    out.append( value );
+}
+
+
+// Size of a classification, behaviour or sub-class: its type, its confidence and, for a sub-class, its level
+static inline size_t TypedSize( const DetectionReportEncoder::Fragment &type, bool level )
+{
+    return type.length + FLOAT_FIELD_SIZE + (level ? 2 : 0);
+}
+
+
+// Size of a message field holding a value of the given size
+static inline size_t FieldSize( size_t size )
+{
+    return 1 + VarintSize( size ) + size;
+}
+
+
+static inline unsigned char *PutTyped( unsigned char *p, const unsigned char *end, unsigned char tag, const DetectionReportEncoder::Fragment &type, float confidence )
+{
+    p = PutByte( p, end, tag );
+    p = PutByte( p, end, (unsigned char)TypedSize( type, false ) );
+    p = PutFragment( p, end, type );
+    return PutFloat( p, end, TAG_CONFIDENCE, confidence );
+}
+
+
+static inline unsigned char *PutSubClass( unsigned char *p, const unsigned char *end, const DetectionReportEncoder::Fragment &type, float confidence, int level )
+{
+    p = PutByte( p, end, TAG_CLASSIFICATION_SUB_CLASS );
+    p = PutByte( p, end, (unsigned char)TypedSize( type, true ) );
+    p = PutFragment( p, end, type );
+    p = PutFloat( p, end, TAG_CONFIDENCE, confidence );
+    p = PutByte( p, end, TAG_SUB_CLASS_LEVEL );
+    return PutByte( p, end, (unsigned char)level );
+}
+
+
+DetectionReportEncoder::DetectionReportEncoder()
+{
+    began = false;
+
+    MakeFragment( human, "Human" );
+    MakeFragment( vehicle, "Vehicle" );
+    MakeFragment( staticObject, "Static Object" );
+    MakeFragment( unknown, "Unknown" );
+    MakeFragment( twoWheel, "Vehicle Class 2 Wheel" );
+    MakeFragment( fourWheel, "Vehicle Class 4 Wheel" );
+    MakeFragment( heavy, "Heavy" );
+    MakeFragment( medium, "Medium" );
+    MakeFragment( light, "Light" );
+    MakeFragment( walking, "Walking" );
+    MakeFragment( running, "Running" );
+    MakeFragment( loitering, "Loitering" );
+    MakeFragment( crawling, "Crawling" );
+    MakeFragment( dopplerSpeed, "dopplerSpeed" );
+}
+
+
+void DetectionReportEncoder::Begin( int64_t ts, const std::string &node, const std::string &dest, const ulid::ULID &task )
+{
+    unsigned char field[24];
+    unsigned char *end = field + sizeof( field );
+    unsigned char *p = PutByte( field, end, TAG_SAPIENT_TIMESTAMP );
+    p = PutTimestamp( p, end, ts / 1000000000, (int32_t)(ts % 1000000000) );
+
+    header.assign( (const char *)field, p - field );
+    AppendString( header, TAG_SAPIENT_NODE_ID, node );
+    AppendString( header, TAG_SAPIENT_DESTINATION_ID, dest );
+    taskID = task;
+    began = true;
+}
+
+
+size_t DetectionReportEncoder::ReportSize( const DetectionReportFields &f, size_t dopplerLength ) const
+{
+    size_t size = 2 * ID_FIELD_SIZE;
+    if (!taskID.IsZero()) size += ID_FIELD_SIZE;
+    size += FieldSize( RANGE_BEARING_SIZE );
+    size += FLOAT_FIELD_SIZE;
+
+    if (f.present & DetectionReportFields::DOPPLER_SPEED)
+    {
+        size += FieldSize( dopplerSpeed.length + FieldSize( dopplerLength ) + FLOAT_FIELD_SIZE );
+    }
+
+    if (f.present & DetectionReportFields::HUMAN) size += FieldSize( TypedSize( human, false ) );
+    if (f.present & DetectionReportFields::VEHICLE)
+    {
+        size_t vehicleSize = TypedSize( vehicle, false );
+        if (f.present & DetectionReportFields::VEHICLE_TWO_WHEEL) vehicleSize += FieldSize( TypedSize( twoWheel, true ) );
+        if (f.present & DetectionReportFields::VEHICLE_FOUR_WHEEL)
+        {
+            vehicleSize += FieldSize( TypedSize( fourWheel, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_HEAVY) vehicleSize += FieldSize( TypedSize( heavy, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_MEDIUM) vehicleSize += FieldSize( TypedSize( medium, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_LIGHT) vehicleSize += FieldSize( TypedSize( light, true ) );
+        }
+        size += FieldSize( vehicleSize );
+    }
+    if (f.present & DetectionReportFields::STATIC_OBJECT) size += FieldSize( TypedSize( staticObject, false ) );
+    if (f.present & DetectionReportFields::UNKNOWN) size += FieldSize( TypedSize( unknown, false ) );
+
+    if (f.present & DetectionReportFields::WALKING) size += FieldSize( TypedSize( walking, false ) );
+    if (f.present & DetectionReportFields::RUNNING) size += FieldSize( TypedSize( running, false ) );
+    if (f.present & DetectionReportFields::LOITERING) size += FieldSize( TypedSize( loitering, false ) );
+    if (f.present & DetectionReportFields::CRAWLING) size += FieldSize( TypedSize( crawling, false ) );
+
+    return size;
+}
+
+
+// Fields are written in field number order, as the generated code does. NULL if they do not fit before end.
+unsigned char *DetectionReportEncoder::EncodeReport( unsigned char *p, const unsigned char *end, const DetectionReportFields &f, const char *doppler, size_t dopplerLength ) const
+{
+    p = PutUlid( p, end, TAG_REPORT_ID, f.reportID );
+    p = PutUlidText( p, end, TAG_OBJECT_ID, f.objectID );
+    if (!taskID.IsZero()) p = PutUlid( p, end, TAG_TASK_ID, taskID );
+
+    p = PutByte( p, end, TAG_RANGE_BEARING );
+    p = PutByte( p, end, RANGE_BEARING_SIZE );
+    p = PutDouble( p, end, TAG_RB_AZIMUTH, f.azimuth );
+    p = PutDouble( p, end, TAG_RB_RANGE, f.range );
+    p = PutDouble( p, end, TAG_RB_AZIMUTH_ERROR, f.azimuthError );
+    p = PutDouble( p, end, TAG_RB_RANGE_ERROR, f.rangeError );
+    p = PutByte( p, end, TAG_RB_COORDINATE_SYSTEM );
+    p = PutByte( p, end, sap::RANGE_BEARING_COORDINATE_SYSTEM_DEGREES_M );
+    p = PutByte( p, end, TAG_RB_DATUM );
+    p = PutByte( p, end, sap::RANGE_BEARING_DATUM_PLATFORM );
+
+    p = PutFloat( p, end, TAG_DETECTION_CONFIDENCE, f.detectionConfidence );
+
+    if (f.present & DetectionReportFields::DOPPLER_SPEED)
+    {
+        p = PutByte( p, end, TAG_OBJECT_INFO );
+        p = PutVarint( p, end, dopplerSpeed.length + FieldSize( dopplerLength ) + FLOAT_FIELD_SIZE );
+        p = PutFragment( p, end, dopplerSpeed );
+        p = PutByte( p, end, TAG_INFO_VALUE );
+        p = PutVarint( p, end, dopplerLength );
+        p = PutBytes( p, end, doppler, dopplerLength );
+        p = PutFloat( p, end, TAG_INFO_ERROR, f.dopplerSpeedError );
+    }
+
+    if (f.present & DetectionReportFields::HUMAN) p = PutTyped( p, end, TAG_CLASSIFICATION, human, f.humanConfidence );
+    if (f.present & DetectionReportFields::VEHICLE)
+    {
+        size_t vehicleSize = TypedSize( vehicle, false );
+        if (f.present & DetectionReportFields::VEHICLE_TWO_WHEEL) vehicleSize += FieldSize( TypedSize( twoWheel, true ) );
+        if (f.present & DetectionReportFields::VEHICLE_FOUR_WHEEL)
+        {
+            vehicleSize += FieldSize( TypedSize( fourWheel, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_HEAVY) vehicleSize += FieldSize( TypedSize( heavy, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_MEDIUM) vehicleSize += FieldSize( TypedSize( medium, true ) );
+            if (f.present & DetectionReportFields::VEHICLE_LIGHT) vehicleSize += FieldSize( TypedSize( light, true ) );
+        }
+
+        p = PutByte( p, end, TAG_CLASSIFICATION );
+        p = PutVarint( p, end, vehicleSize );
+        p = PutFragment( p, end, vehicle );
+        p = PutFloat( p, end, TAG_CONFIDENCE, f.vehicleConfidence );
+        if (f.present & DetectionReportFields::VEHICLE_TWO_WHEEL)
+        {
+            p = PutSubClass( p, end, twoWheel, f.vehicleTwoWheelConfidence, 1 );
+        }
+        if (f.present & DetectionReportFields::VEHICLE_FOUR_WHEEL)
+        {
+            p = PutSubClass( p, end, fourWheel, f.vehicleFourWheelConfidence, 1 );
+            if (f.present & DetectionReportFields::VEHICLE_HEAVY) p = PutSubClass( p, end, heavy, f.vehicleFourWheelHeavyConfidence, 2 );
+            if (f.present & DetectionReportFields::VEHICLE_MEDIUM) p = PutSubClass( p, end, medium, f.vehicleFourWheelMediumConfidence, 2 );
+            if (f.present & DetectionReportFields::VEHICLE_LIGHT) p = PutSubClass( p, end, light, f.vehicleFourWheelLightConfidence, 2 );
+        }
+    }
+    if (f.present & DetectionReportFields::STATIC_OBJECT) p = PutTyped( p, end, TAG_CLASSIFICATION, staticObject, f.staticObjectConfidence );
+    if (f.present & DetectionReportFields::UNKNOWN) p = PutTyped( p, end, TAG_CLASSIFICATION, unknown, f.unknownConfidence );
+
+    if (f.present & DetectionReportFields::WALKING) p = PutTyped( p, end, TAG_BEHAVIOUR, walking, f.humanWalkingConfidence );
+    if (f.present & DetectionReportFields::RUNNING) p = PutTyped( p, end, TAG_BEHAVIOUR, running, f.humanRunningConfidence );
+    if (f.present & DetectionReportFields::LOITERING) p = PutTyped( p, end, TAG_BEHAVIOUR, loitering, f.humanLoiteringConfidence );
+    if (f.present & DetectionReportFields::CRAWLING) p = PutTyped( p, end, TAG_BEHAVIOUR, crawling, f.humanCrawlingConfidence );
+
+    return p;
+}
+
+
+bool DetectionReportEncoder::Write( IOutputStream *out, const DetectionReportFields &f )
+{
+    if (!began)
+    {
+        LOG( ERROR ) << "DetectionReportEncoder written before Begin.";
+        return false;
+    }
+
+    // The SAPIENT value is text, formatted as std::to_string would, which for the largest float is 47 characters
+    char doppler[64];
+    size_t dopplerLength = 0;
+    if (f.present & DetectionReportFields::DOPPLER_SPEED)
+    {
+        dopplerLength = (size_t)snprintf( doppler, sizeof( doppler ), "%f", f.dopplerSpeed );
+        if (dopplerLength >= sizeof( doppler )) dopplerLength = sizeof( doppler ) - 1;
+    }
+
+    // Every length is known before anything is written, so the frame is encoded in one pass
+    size_t reportSize = ReportSize( f, dopplerLength );
+    size_t messageSize = header.length() + FieldSize( reportSize );
+    size_t frameSize = FRAME_HEADER + messageSize;
+
+    unsigned char *start = out->Reserve( frameSize );
+    std::string scratch;
+    if (start == NULL)
+    {
+        scratch.resize( frameSize );
+        start = (unsigned char *)&scratch[0];
+    }
+
+    unsigned char length[FRAME_HEADER];
+    length[0] = (unsigned char)messageSize;
+    length[1] = (unsigned char)(messageSize >> 8);
+    length[2] = (unsigned char)(messageSize >> 16);
+    length[3] = (unsigned char)(messageSize >> 24);
+
+    // Nothing is written past the space reserved, which is left uncommitted if the sizes disagree
+    unsigned char *end = start + frameSize;
+    unsigned char *p = PutBytes( start, end, length, sizeof( length ) );
+    p = PutBytes( p, end, header.data(), header.length() );
+    p = PutByte( p, end, TAG_SAPIENT_DETECTION_REPORT );
+    p = PutVarint( p, end, reportSize );
+    p = EncodeReport( p, end, f, doppler, dopplerLength );
+
+    if (p != end)
+    {
+        LOG( ERROR ) << "Detection report " << (p == NULL ? "overran" : "fell short of") << " the " << frameSize << " bytes expected";
+        return false;
+    }
+
+    if (scratch.empty())
+    {
+        return out->Commit( frameSize );
+    }
+    size_t wrote;
+    return out->Write( start, frameSize, wrote );
+}
@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "DetectionReport.h"
+#include "ProtobufInterface/Stream.h"
+
+#include <stddef.h>
+#include <string>
+
+// Encodes detection report frames directly in the protobuf wire format, in one pass
+// straight into the output stream's buffer, without building a sap::SapientMessage.
+// The frame fields common to a pass are encoded once by Begin, and the constant type
+// strings once on construction. The frames are byte for byte those DetectionReportBuilder
+// would write, which Test/DetectionReportEncoderTest.cpp checks.
+class DetectionReportEncoder
+{
+public:
+    DetectionReportEncoder();
+
+    // The timestamp is in UTC nanoseconds since the epoch
+    void Begin( int64_t timestamp, const std::string &nodeID, const std::string &destID, const ulid::ULID &taskID );
+
+    bool Write( IOutputStream *out, const DetectionReportFields &fields );
+
+    // An encoded string field: tag, length and characters
+    struct Fragment
+    {
+        unsigned char bytes[32];
+        size_t length;
+    };
+
+private:
+    size_t ReportSize( const DetectionReportFields &f, size_t dopplerLength ) const;
+    unsigned char *EncodeReport( unsigned char *p, const unsigned char *end, const DetectionReportFields &f, const char *doppler, size_t dopplerLength ) const;
+
+    // Timestamp, node and destination ID fields, which start every frame of the pass
+    std::string header;
+    ulid::ULID taskID;
+    bool began;
+
+    Fragment human, vehicle, staticObject, unknown;
+    Fragment twoWheel, fourWheel, heavy, medium, light;
+    Fragment walking, running, loitering, crawling;
+    Fragment dopplerSpeed;
+};
@@ -7,6 +7,7 @@
 
 #include "ProtobufInterface/Writer.h"
 
+#include <google/protobuf/arena.h>
 #include <string>
 
 class Message
@@ -21,3 +22,27 @@ public:
 protected:
     std::string _description;
 };
+
+// Holds an outgoing protobuf message created on the writer's arena, which Network
+// resets once per pass. Without an arena the message is on the heap and deleted here.
+template <typename T>
+class ArenaMessage
+{
+public:
+    ArenaMessage( google::protobuf::Arena *arena ) :
+        msg( google::protobuf::Arena::CreateMessage<T>( arena ) ),
+        owned( arena == nullptr )
+    {
+    }
+    ~ArenaMessage() { if (owned) delete msg; }
+
+    T *operator->() { return msg; }
+    T &operator*() { return *msg; }
+
+private:
+    ArenaMessage( const ArenaMessage & );
+    ArenaMessage &operator=( const ArenaMessage & );
+
+    T *msg;
+    bool owned;
+};
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "MessageDispatcher.h"
+
+#define ELPP_DEFAULT_LOGGER "network"
+#include "../Utils/Log.h"
+#include "../Utils/Utils.h"
+
+#include <string.h>
+
+
+MessageDispatcher::MessageDispatcher()
+{
+}
+
+
+void MessageDispatcher::Register( sap::SapientMessage::ContentCase content, const char *name, Handler handler )
+{
+    if (content <= sap::SapientMessage::CONTENT_NOT_SET || (int)content >= MAX_CONTENT_CASES)
+    {
+        throw "MessageDispatcher::Register given an invalid content case";
+    }
+
+    // Registering the same handler again, such as when re-initialising, replaces it rather than calling it twice
+    std::vector<Entry> &entries = table[content];
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (strcmp( entries[i].name, name ) == 0)
+        {
+            entries[i].handler = handler;
+            return;
+        }
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.handler = handler;
+    entry.stats = MessageHandlerStats();
+    entries.push_back( entry );
+}
+
+
+uint32_t MessageDispatcher::ContentMask() const
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < MAX_CONTENT_CASES; i++)
+    {
+        if (!table[i].empty()) mask |= 1u << i;
+    }
+    return mask;
+}
+
+
+bool MessageDispatcher::Dispatch( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )
+{
+    int content = msg.content_case();
+    if (content <= sap::SapientMessage::CONTENT_NOT_SET || content >= MAX_CONTENT_CASES) return false;
+
+    std::vector<Entry> &entries = table[content];
+    if (entries.empty()) return false;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry &entry = entries[i];
+        double start = Get_Time_Monotonic();
+        entry.handler( msg, status, task );
+        double elapsed = Get_Time_Monotonic() - start;
+
+        entry.stats.count++;
+        entry.stats.totalTime += elapsed;
+        if (elapsed > entry.stats.maxTime) entry.stats.maxTime = elapsed;
+    }
+    return true;
+}
+
+
+const MessageHandlerStats &MessageDispatcher::GetStats( sap::SapientMessage::ContentCase content, size_t index ) const
+{
+    static const MessageHandlerStats none = MessageHandlerStats();
+    if (content <= sap::SapientMessage::CONTENT_NOT_SET || (int)content >= MAX_CONTENT_CASES) return none;
+    if (index >= table[content].size()) return none;
+    return table[content][index].stats;
+}
+
+
+void MessageDispatcher::LogStats() const
+{
+    for (int i = 0; i < MAX_CONTENT_CASES; i++)
+    {
+        for (size_t j = 0; j < table[i].size(); j++)
+        {
+            const Entry &entry = table[i][j];
+            if (entry.stats.count == 0) continue;
+
+            const google::protobuf::FieldDescriptor *fd = sap::SapientMessage::descriptor()->FindFieldByNumber( i );
+            LOG( INFO ) << entry.name << " handled " << entry.stats.count << " " << (fd != nullptr ? fd->name() : std::to_string( i ))
+                << " messages, " << entry.stats.totalTime * 1e3 / entry.stats.count << " ms average, " << entry.stats.maxTime * 1e3 << " ms max";
+        }
+    }
+}
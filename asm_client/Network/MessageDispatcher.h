@@ -0,0 +1,65 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
+namespace sap = sapient_msg::bsi_flex_335_v2_0;
+
+struct AsmClientStatus;
+struct AsmClientTask;
+
+// Counts and times the calls to one handler
+struct MessageHandlerStats
+{
+    unsigned long count;
+    double totalTime;
+    double maxTime;
+};
+
+// Hands each received message to the handlers registered for its content (task,
+// registration ack, etc.), found by indexing a table with the content oneof case.
+// Several handlers may register for the same content; they are called in the order
+// they registered, and each is counted and timed separately. Handlers are called on
+// the thread that calls Dispatch.
+class MessageDispatcher
+{
+public:
+    typedef std::function<void( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )> Handler;
+
+    MessageDispatcher();
+
+    // Content cases are the field numbers of SapientMessage's content oneof. The name identifies
+    // the handler in its stats, and must outlive the dispatcher. A name already registered for
+    // the content has its handler replaced.
+    void Register( sap::SapientMessage::ContentCase content, const char *name, Handler handler );
+
+    // Bit n is set if content case n has a handler, for Reader::SetFilter
+    uint32_t ContentMask() const;
+
+    // Returns false if nothing handles the message's content
+    bool Dispatch( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task );
+
+    // Stats for the index'th handler registered for the content
+    const MessageHandlerStats &GetStats( sap::SapientMessage::ContentCase content, size_t index ) const;
+
+    // Logs the count and timings for each handler that has been called
+    void LogStats() const;
+
+private:
+    enum { MAX_CONTENT_CASES = 32 };
+
+    struct Entry
+    {
+        const char *name;
+        Handler handler;
+        MessageHandlerStats stats;
+    };
+    std::vector<Entry> table[MAX_CONTENT_CASES];
+};
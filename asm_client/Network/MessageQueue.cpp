@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "MessageQueue.h"
+#include "../Utils/AllocationCheck.h"
+#include "../Utils/Reactor.h"
+
+#define ELPP_DEFAULT_LOGGER "network"
+#include "../Utils/Log.h"
+
+
+MessageQueue::MessageQueue() :
+    contentMask( 0 ),
+    reactor( nullptr ),
+    anyPosted( false ),
+    numPosted( 0 ),
+    dropped( 0 )
+{
+}
+
+
+bool MessageQueue::Post( const sap::SapientMessage &msg, const struct AsmClientStatus &status, const struct AsmClientTask &task )
+{
+    // Handlers are only registered before messages arrive, so the mask is worked out once
+    if (contentMask == 0) contentMask = dispatcher.ContentMask();
+    int content = msg.content_case();
+    if (content >= 32 || (contentMask & (1u << content)) == 0)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        if (numPosted == MAX_PENDING)
+        {
+            if (dropped++ == 0)
+            {
+                LOG( WARNING ) << "The sensor is not taking its messages, dropping them";
+            }
+            return true;
+        }
+        if (numPosted == posted.size()) posted.resize( numPosted + 1 );
+
+        Pending &pending = posted[numPosted++];
+        pending.msg.CopyFrom( msg );
+        pending.status = status;
+        pending.task = task;
+        anyPosted.store( true, std::memory_order_release );
+    }
+
+    if (reactor != nullptr) reactor->Notify();
+    return true;
+}
+
+
+void MessageQueue::Dispatch()
+{
+    if (!anyPosted.load( std::memory_order_acquire ))
+    {
+        return;
+    }
+    AllocationCheck::Event();
+
+    // Swap the posted messages out so that the network is not held up while the handlers run
+    size_t numTaken;
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        posted.swap( taken );
+        numTaken = numPosted;
+        numPosted = 0;
+        dropped = 0;
+        anyPosted.store( false, std::memory_order_relaxed );
+    }
+
+    for (size_t i = 0; i < numTaken; i++)
+    {
+        dispatcher.Dispatch( taken[i].msg, taken[i].status, taken[i].task );
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "MessageDispatcher.h"
+#include "../AsmClient.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class Reactor;
+
+// Passes received messages from the network's thread to the sensor's, where the handlers that
+// the sensor subscribed are called, so that they never run alongside the sensor's Loop. Each
+// message is copied with the network's status and task as they were when it arrived; changes
+// the handlers make to those copies are not seen by the network. Messages are rare next to
+// detections, so a mutex guards the queue, and Dispatch skips it while nothing is posted.
+class MessageQueue
+{
+public:
+    MessageQueue();
+
+    // Called before any messages are posted with the reactor of the thread that calls Dispatch
+    void AttachReactor( Reactor *reactor ) { this->reactor = reactor; }
+
+    // The sensor registers its handlers here before any messages are posted
+    MessageDispatcher *GetDispatcher() { return &dispatcher; }
+
+    // Network thread: copies the message for the sensor if one of its handlers wants the content.
+    // Returns false if none do.
+    bool Post( const sap::SapientMessage &msg, const struct AsmClientStatus &status, const struct AsmClientTask &task );
+
+    // Sensor thread: calls the handlers for each message posted since the last call
+    void Dispatch();
+
+private:
+    // Messages posted while the sensor is this far behind are dropped
+    enum { MAX_PENDING = 64 };
+
+    struct Pending
+    {
+        sap::SapientMessage msg;
+        struct AsmClientStatus status;
+        struct AsmClientTask task;
+    };
+
+    MessageDispatcher dispatcher;
+    uint32_t contentMask;
+    Reactor *reactor;
+
+    std::mutex lock;
+    std::atomic<bool> anyPosted;
+    std::vector<Pending> posted;
+    size_t numPosted;
+    std::vector<Pending> taken;
+    unsigned long dropped;
+};
@@ -0,0 +1,253 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "MessageTemplate.h"
+#include "../Utils/UlidGenerator.h"
+
+#define ELPP_DEFAULT_LOGGER "network"
+#include "../Utils/Log.h"
+
+// Protobuf wire types
+#define WIRE_VARINT 0
+#define WIRE_FIXED64 1
+#define WIRE_LENGTH 2
+#define WIRE_FIXED32 5
+
+// Frames start with a 4 byte little-endian length, see bsi-flex-335.pdf section 4.2
+#define FRAME_HEADER 4
+
+
+static bool ReadVarint( const unsigned char *buf, size_t end, size_t *pos, uint64_t *value )
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7)
+    {
+        uint8_t byte = buf[(*pos)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+
+static size_t WriteVarint( unsigned char *p, uint64_t value )
+{
+    size_t length = 0;
+    do
+    {
+        p[length++] = (value & 0x7F) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+    } while (value != 0);
+    return length;
+}
+
+
+// Finds the first occurrence of a field between start and end, giving the offset and length of its value.
+// For a varint the length is the number of bytes it is encoded in.
+static bool FindField( const unsigned char *buf, size_t start, size_t end, int field, int wireType, size_t *offset, size_t *length )
+{
+    size_t pos = start;
+    while (pos < end)
+    {
+        uint64_t tag, value;
+        if (!ReadVarint( buf, end, &pos, &tag )) return false;
+
+        size_t valueStart = pos;
+        switch (tag & 0x07)
+        {
+            case WIRE_VARINT:
+                if (!ReadVarint( buf, end, &pos, &value )) return false;
+                break;
+            case WIRE_FIXED64:
+                pos += 8;
+                break;
+            case WIRE_LENGTH:
+                if (!ReadVarint( buf, end, &pos, &value )) return false;
+                valueStart = pos;
+                pos += (size_t)value;
+                break;
+            case WIRE_FIXED32:
+                pos += 4;
+                break;
+            default:
+                return false;
+        }
+        if (pos > end) return false;
+
+        if ((int)(tag >> 3) == field && (int)(tag & 0x07) == wireType)
+        {
+            *offset = valueStart;
+            *length = pos - valueStart;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+MessageTemplate::MessageTemplate()
+{
+    used = 0;
+    valid = false;
+    patchable = false;
+    builtKey = 0;
+    timestampOffset = 0;
+    timestampLength = 0;
+    reportIdOffset = 0;
+    contentOffset = 0;
+    contentLength = 0;
+}
+
+void MessageTemplate::Begin()
+{
+    used = 0;
+    valid = false;
+    patchable = false;
+}
+
+void MessageTemplate::Finish( uint64_t key, bool hasReportId )
+{
+    valid = used > FRAME_HEADER;
+    patchable = false;
+    builtKey = key;
+    reportIdOffset = 0;
+    if (!valid) return;
+
+    // The timestamp is field 1 of the SapientMessage. Its fields are replaced whole, so its length must fit in one byte.
+    const unsigned char *buf = &frame[0];
+    if (!FindField( buf, FRAME_HEADER, used, 1, WIRE_LENGTH, &timestampOffset, &timestampLength ) ||
+        timestampLength >= 0x70)
+    {
+        LOG( WARNING ) << "Cached message has no timestamp to patch";
+        return;
+    }
+
+    // The content is whichever of the oneof fields (4 onwards) is present
+    contentLength = 0;
+    for (int field = 4; field <= 13 && contentLength == 0; field++)
+    {
+        FindField( buf, FRAME_HEADER, used, field, WIRE_LENGTH, &contentOffset, &contentLength );
+    }
+
+    if (hasReportId)
+    {
+        size_t length;
+        if (contentLength == 0 ||
+            !FindField( buf, contentOffset, contentOffset + contentLength, 1, WIRE_LENGTH, &reportIdOffset, &length ) ||
+            length != 26)
+        {
+            LOG( WARNING ) << "Cached message has no report ID to patch";
+            reportIdOffset = 0;
+            return;
+        }
+    }
+
+    // Room for the longest timestamp, so that patching it never reallocates the frame
+    frame.reserve( frame.size() + 24 );
+    patchable = true;
+}
+
+bool MessageTemplate::PatchEnum( int field, int value )
+{
+    if (!valid || !patchable || contentLength == 0 || value < 0 || value >= 0x80) return false;
+
+    size_t offset, length;
+    if (!FindField( &frame[0], contentOffset, contentOffset + contentLength, field, WIRE_VARINT, &offset, &length ) || length != 1)
+    {
+        return false;
+    }
+    frame[offset] = (unsigned char)value;
+    return true;
+}
+
+bool MessageTemplate::WriteTo( IOutputStream *out, int64_t timestamp )
+{
+    if (!valid) return false;
+
+    if (patchable)
+    {
+        // The Timestamp's seconds and nanos, left out when zero as the generated code does
+        unsigned char fields[24];
+        size_t length = 0;
+        int64_t seconds = timestamp / 1000000000;
+        int32_t nanos = (int32_t)(timestamp % 1000000000);
+        if (seconds != 0)
+        {
+            fields[length++] = (1 << 3) | WIRE_VARINT;
+            length += WriteVarint( fields + length, (uint64_t)seconds );
+        }
+        if (nanos != 0)
+        {
+            fields[length++] = (2 << 3) | WIRE_VARINT;
+            length += WriteVarint( fields + length, (uint64_t)nanos );
+        }
+
+        if (length != timestampLength)
+        {
+            // The nanos often need a different number of bytes, so move the rest of the frame
+            // and correct the lengths of the Timestamp and of the frame
+            long delta = (long)length - (long)timestampLength;
+            if (delta > 0)
+            {
+                frame.insert( frame.begin() + timestampOffset, delta, 0 );
+            }
+            else
+            {
+                frame.erase( frame.begin() + timestampOffset, frame.begin() + timestampOffset - delta );
+            }
+            used += delta;
+            frame[timestampOffset - 1] = (unsigned char)length;
+            uint32_t frameLength = (uint32_t)(used - FRAME_HEADER);
+            frame[0] = frameLength & 0xFF;
+            frame[1] = (frameLength >> 8) & 0xFF;
+            frame[2] = (frameLength >> 16) & 0xFF;
+            frame[3] = (frameLength >> 24) & 0xFF;
+            contentOffset += delta;
+            if (reportIdOffset != 0) reportIdOffset += delta;
+            timestampLength = length;
+        }
+        memcpy( &frame[timestampOffset], fields, length );
+
+        if (reportIdOffset != 0)
+        {
+            ulid::ULID reportID;
+            Generate_Ulid( reportID, (char *)&frame[reportIdOffset] );
+        }
+    }
+    else
+    {
+        // Sent as built, so force a rebuild next time
+        valid = false;
+    }
+
+    unsigned char *p = out->Reserve( used );
+    if (p != NULL)
+    {
+        memcpy( p, &frame[0], used );
+        return out->Commit( used );
+    }
+    size_t wrote;
+    return out->Write( &frame[0], used, wrote );
+}
+
+bool MessageTemplate::Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote )
+{
+    unsigned char *p = Reserve( iOctets );
+    memcpy( p, pOctets, iOctets );
+    iWrote = iOctets;
+    return Commit( iOctets );
+}
+
+unsigned char *MessageTemplate::Reserve( size_t iOctets )
+{
+    if (frame.size() < used + iOctets) frame.resize( used + iOctets );
+    return &frame[used];
+}
+
+bool MessageTemplate::Commit( size_t iOctets )
+{
+    used += iOctets;
+    return true;
+}
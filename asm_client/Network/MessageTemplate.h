@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "ProtobufInterface/Stream.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Hash (FNV-1a) of the inputs a cached message was built from
+class TemplateKey
+{
+public:
+    TemplateKey() : hash( 14695981039346656037ULL ) {}
+
+    void Add( const void *data, size_t length )
+    {
+        const uint8_t *p = (const uint8_t *)data;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ p[i]) * 1099511628211ULL;
+        }
+    }
+    void Add( const std::string &s ) { Add( s.c_str(), s.length() + 1 ); }
+    void Add( const char *s ) { Add( s, strlen( s ) + 1 ); }
+    void Add( int value ) { Add( &value, sizeof( value ) ); }
+    void Add( double value ) { Add( &value, sizeof( value ) ); }
+
+    uint64_t Value() const { return hash; }
+
+private:
+    uint64_t hash;
+};
+
+// Keeps the encoded frame of a message that rarely changes, such as a status report,
+// so that it can be sent again by patching the timestamp (and report ID) in place
+// instead of building and serializing the whole message. The message is built by
+// writing it through a Writer opened on the template, between Begin and Finish.
+class MessageTemplate : public IOutputStream
+{
+public:
+    MessageTemplate();
+
+    // Returns true if the frame was built from inputs with this key and can be patched
+    bool Matches( uint64_t key ) const { return valid && patchable && key == builtKey; }
+
+    // Starts building a new frame
+    void Begin();
+
+    // Finishes building, locating the fields to patch. The content message's field 1 is its report ID if hasReportId is set.
+    // A frame that cannot be patched is still sent once, but is rebuilt next time.
+    void Finish( uint64_t key, bool hasReportId );
+
+    // Changes a single byte enum field of the content message, returning false if it cannot be done in place
+    bool PatchEnum( int field, int value );
+
+    // Patches in the timestamp (UTC nanoseconds since the epoch) and a new report ID, then writes the frame to out
+    bool WriteTo( IOutputStream *out, int64_t timestamp );
+
+    // IOutputStream, used by the Writer while building
+    virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote );
+    virtual bool Send( bool bTerminator ) { return true; }
+    virtual void Close() {}
+    virtual unsigned char *Reserve( size_t iOctets );
+    virtual bool Commit( size_t iOctets );
+
+private:
+    std::vector<unsigned char> frame;
+    size_t used;
+    bool valid;
+    bool patchable;
+    uint64_t builtKey;
+
+    size_t timestampOffset;     // Timestamp message's fields
+    size_t timestampLength;
+    size_t reportIdOffset;      // 26 character ULID, or zero if none
+    size_t contentOffset;       // Content message (e.g. status_report) within the frame
+    size_t contentLength;
+};
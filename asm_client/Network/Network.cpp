@@ -12,6 +12,14 @@
 #include "SensorTask.h"
 #include "SensorTaskACK.h"
 #include "DetectionReport.h"
+#include "DetectionReportEncoder.h"
+#include "MessageTemplate.h"
+#include "DetectionJournal.h"
+#include "OutputScheduler.h"
+#include "MessageDispatcher.h"
+#include "MessageQueue.h"
+#include "RegionEngine.h"
+#include "DetectionBatch.h"
 #include "../AsmClient.h"
 
 #define ELPP_DEFAULT_LOGGER "network"
@@ -19,31 +27,108 @@
 #include "../Utils/Config.h"
 #include "../Utils/Utils.h"
 #include "../Utils/Ulid.h"
+#include "../Utils/UlidGenerator.h"
+#include "../Utils/Reactor.h"
+#include "../Utils/AllocationCheck.h"
 
 #include <math.h>
 
 #include <google/protobuf/stubs/common.h>
 
+// Seconds between checks on a connection in progress and on the network link
+#define CONNECT_POLL_INTERVAL 0.05
+#define LINK_CHECK_INTERVAL 1.0
+
+// Seconds before trying again to send frames the socket could not take yet
+#define FLUSH_RETRY_INTERVAL 0.01
+
+// Enough for a pass's messages, so the arena rarely needs to allocate further blocks
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
 
 Network::Network()
 {
     el::Loggers::getLogger( "network" );
     networkStream = nullptr;
+    reactor = nullptr;
+    watchedFd = -1;
+    watchedWritable = false;
+    connectTimer = nullptr;
+    linkCheckTimer = nullptr;
+    registrationTimer = nullptr;
+    heartbeatTimer = nullptr;
+    statusHoldoffTimer = nullptr;
+    detectionTimer = nullptr;
     reader = new ProtobufInterface::Reader();
     writer = new ProtobufInterface::Writer();
+    templateWriter = new ProtobufInterface::Writer();
+    journal = nullptr;
+    replayTimer = nullptr;
+    hasRegistered = false;
+    scheduler = nullptr;
+    flushTimer = nullptr;
+    congestedDetections = 0;
+    statusTemplate = new MessageTemplate();
+    registrationTemplate = new MessageTemplate();
+
+    google::protobuf::ArenaOptions options;
+    arenaBlock = new char[ARENA_BLOCK_SIZE];
+    options.initial_block = arenaBlock;
+    options.initial_block_size = ARENA_BLOCK_SIZE;
+    arena = new google::protobuf::Arena( options );
+    writer->setArena( arena );
+    templateWriter->setArena( arena );
+
     statusReportData = new StatusReportData();
     defaultTask = new AsmClientTask();
+    dispatcher = new MessageDispatcher();
+    sensorMessages = new MessageQueue();
+    regions = new RegionEngine();
+    newRegions = new RegionEngine();
+    batch = new DetectionBatch();
+    encoder = new DetectionReportEncoder();
 }
 
 
 Network::~Network()
 {
     LOG( INFO ) << "Terminating Network...";
+    dispatcher->LogStats();
+    sensorMessages->GetDispatcher()->LogStats();
 
     networkStream->Close();
 
     delete networkStream;
     delete statusReportData;
+    delete dispatcher;
+    delete sensorMessages;
+    delete regions;
+    delete newRegions;
+    delete batch;
+    delete encoder;
+
+    delete arena;
+    delete[] arenaBlock;
+
+    delete statusTemplate;
+    delete registrationTemplate;
+    delete journal;
+    delete replayTimer;
+    delete scheduler;
+    delete flushTimer;
+
+    delete connectTimer;
+    delete linkCheckTimer;
+    delete registrationTimer;
+    delete heartbeatTimer;
+    delete statusHoldoffTimer;
+    delete detectionTimer;
+}
+
+
+void Network::AttachReactor( Reactor *r )
+{
+    reactor = r;
 }
 
 
@@ -66,7 +151,8 @@ void Network::Initialise( const char *configFilename )
     timeout = (int)config.GetLongValue( "network", "timeout_ms", 0 );
 
     delete networkStream;
-    networkStream = new NetworkStream( hostname, port );
+    networkStream = new NetworkStream( hostname, port,
+        (size_t)config.GetLongValue( "network", "outputBuffer_kB", 1024 ) * 1024 );
 
     nodeID = config.GetValue( "network", "nodeID", "" );
     destID = config.GetValue( "network", "destID", "" );
@@ -78,6 +164,30 @@ void Network::Initialise( const char *configFilename )
     suppressDetectionsDuringTamper = (int)config.GetLongValue( "network", "suppressDetectionsDuringTamper", 0 );
     suppressFovDuringTamper = (int)config.GetLongValue( "network", "suppressFovDuringTamper", 0 );
     fieldOfViewType = config.GetValue( "network", "fieldOfViewType", "RangeBearing" );
+    batchOutput = (int)config.GetLongValue( "network", "batchOutput", 1 );
+    batchMaxLatency = config.GetDoubleValue( "network", "batchMaxLatency_ms", 50 ) / 1000.0;
+
+    // Detections are only journalled if a file is given
+    std::string journalFile = config.GetValue( "network", "journalFile", "" );
+    if (!journalFile.empty())
+    {
+        journal = new DetectionJournal();
+        if (!journal->Open( journalFile, (size_t)config.GetLongValue( "network", "journalSize_kB", 1024 ) * 1024 ))
+        {
+            delete journal;
+            journal = nullptr;
+        }
+    }
+    journalMaxAge = config.GetDoubleValue( "network", "journalMaxAge", 3600.0 );
+    journalReplayFrames = (int)config.GetLongValue( "network", "journalReplayFrames", 10 );
+    journalReplayInterval = config.GetDoubleValue( "network", "journalReplayInterval_ms", 100 ) / 1000.0;
+
+    delete scheduler;
+    scheduler = new OutputScheduler(
+        (size_t)config.GetLongValue( "network", "queueControl_kB", 16 ) * 1024,
+        (size_t)config.GetLongValue( "network", "queueHealth_kB", 16 ) * 1024,
+        (size_t)config.GetLongValue( "network", "queueBulk_kB", 256 ) * 1024,
+        (size_t)config.GetLongValue( "network", "sendHighWater_kB", 32 ) * 1024 );
 
     statusReportData->coverage = new StatusReportLocationRBC();
     statusReportData->coverage->r = config.GetValue( "network", "coverageMaxRange", "100.0" );
@@ -87,20 +197,94 @@ void Network::Initialise( const char *configFilename )
     statusReportData->coverage->ve = config.GetValue( "network", "coverageVerticalExtent", "10.0" );
     statusReportData->coverage->eve = config.GetValue( "network", "coverageVerticalExtentError", "1.0" );
 
-    defaultTask->bearing = strtof( statusReportData->coverage->az.c_str(), NULL );
-    defaultTask->horizontalExtent = strtof( statusReportData->coverage->he.c_str(), NULL );
+    // Tasks are checked against the coverage as numbers, rather than parsing its strings each time
+    coverageRange = strtof( statusReportData->coverage->r.c_str(), NULL );
+    coverageBearing = 0.0f;
+    coverageHalfExtent = strtof( statusReportData->coverage->he.c_str(), NULL ) / 2.0f;
+
+    defaultTask->bearing = coverageBearing;
+    defaultTask->horizontalExtent = coverageHalfExtent * 2.0f;
 
     defaultTask->minRange = (float)config.GetDoubleValue( "network", "defaultMinRange", 0.3 );
-    defaultTask->maxRange = strtof( statusReportData->coverage->r.c_str(), NULL );
+    defaultTask->maxRange = coverageRange;
+
+    // The messages Network handles itself. The reader only parses those with a handler.
+    using namespace std::placeholders;
+    dispatcher->Register( sap::SapientMessage::kRegistrationAck, "Network::HandleRegistrationAck", std::bind( &Network::HandleRegistrationAck, this, _1, _2, _3 ) );
+    dispatcher->Register( sap::SapientMessage::kTask, "Network::HandleTask", std::bind( &Network::HandleTask, this, _1, _2, _3 ) );
+    dispatcher->Register( sap::SapientMessage::kAlertAck, "Network::HandleAlertAck", std::bind( &Network::HandleAlertAck, this, _1, _2, _3 ) );
+    dispatcher->Register( sap::SapientMessage::kError, "Network::HandleError", std::bind( &Network::HandleError, this, _1, _2, _3 ) );
+
+    // Timers wake the reactor when they expire. Until first started they read as expired.
+    connectTimer = new ReactorTimer( reactor );
+    linkCheckTimer = new ReactorTimer( reactor );
+    registrationTimer = new ReactorTimer( reactor );
+    heartbeatTimer = new ReactorTimer( reactor );
+    statusHoldoffTimer = new ReactorTimer( reactor );
+    detectionTimer = new ReactorTimer( reactor );
+    replayTimer = new ReactorTimer( reactor );
+    flushTimer = new ReactorTimer( reactor );
+}
+
 
-    reader->setTimeouts( heartbeatInterval * 1000 / 3, heartbeatInterval * 3000 );        // Short and Long in ms
+void Network::KeepUnsentDetections()
+{
+    AllocationCheck::Event();
+    unsigned long bulk = scheduler->Queue( OutputScheduler::BULK )->Frames();
+    unsigned long kept = scheduler->Clear( journal );
+    if (kept > 0)
+    {
+        LOG( INFO ) << "Journalled " << kept << " detections left unsent by the last connection";
+    }
+    if (journal != nullptr && kept < bulk)
+    {
+        LOG( WARNING ) << "Discarded " << bulk - kept << " detections left unsent by the last connection";
+    }
+}
+
+
+void Network::WatchSocket()
+{
+    // The socket descriptor changes on every reconnection, so keep the reactor watching the current one.
+    // While output is waiting for room in the socket, also wake when it becomes writable.
+    int fd = networkStream->GetFd();
+    bool writable = fd >= 0 && networkStream->Pending() > 0;
+    if (reactor == nullptr || (fd == watchedFd && writable == watchedWritable)) return;
+
+    if (watchedFd >= 0 && fd != watchedFd) reactor->Unwatch( watchedFd );
+    if (fd >= 0) reactor->Watch( fd, writable );
+    watchedFd = fd;
+    watchedWritable = writable;
 }
 
 
 void Network::Loop( struct AsmClientStatus &status, struct AsmClientData &data, struct AsmClientTask &task )
 {
+    // Nothing created on the arena outlives a pass
+    arena->Reset();
+
+    // Carry on sending anything the socket could not take last time
+    if (networkStream->IsOpen() && !networkStream->Resume())
+    {
+        LOG( INFO ) << "Failed to send messages. Closing connection.";
+        networkStream->Close();
+    }
+
+    // Detections still queued when the connection closed are journalled before any made since
+    if (!networkStream->IsOpen() && scheduler->Pending())
+    {
+        KeepUnsentDetections();
+    }
+
+    // Everything written during this pass is sent together at the end of it
+    if (batchOutput)
+    {
+        networkStream->BeginBatch( batchMaxLatency );
+    }
+
     if (task.newTask)
     {
+        AllocationCheck::Event();
         task.newTask = false;
         if (task.rejectReason.length() == 0)
         {
@@ -108,115 +292,31 @@ void Network::Loop( struct AsmClientStatus &status, struct AsmClientData &data,
         }
     }
 
-    if( networkStream->IsOpen() )
+    if( networkStream->IsOpen() &&
+        status.network != AsmClientStatus::NETWORK_REGISTERED && registrationTimer->Expired() )
+    {
+        LOG( WARNING ) << "Timeout waiting for registration";
+        networkStream->Close();
+    }
+    else if( networkStream->IsOpen() )
     {
         reader->Attach( networkStream );
-        if( reader->GetMessage() )
-        {
-            // Action the message
-            sap::SapientMessage *msg = &reader->msg;
-            std::string msg_node_id = msg->node_id();
-            std::string msg_dest_id = msg->destination_id();
-
-            // LOG( INFO ) << "Received message from node: " << msg_node_id << " to node: " << msg_dest_id;
-            if( msg_dest_id != nodeID )
-            {
-                // LOG( INFO ) << "A received message was not targetted for our node id.";
-                return;
-            }
-
-            if( msg->has_registration_ack() )
-            {
-                sap::RegistrationAck msg_ra = msg->registration_ack();
-                if( msg_ra.acceptance() )
-                {
-                    LOG( INFO ) << "Received registration ACK";
-
-                    // Set the new dest to this registered node for all subsequent messages going out
-                    destID = msg_node_id;
-
-                    status.network = AsmClientStatus::NETWORK_REGISTERED;
-
-                    task = *defaultTask;
-                    status.newStatus = true;
-                }
-                else
-                {
-                    // NETWORK_NOT_REGISTERED ? Why...
-                    int num_reasons = msg_ra.ack_response_reason_size();
-                    for( int n=0; n<num_reasons; n++ )
-                    {
-                        std::string reason = msg_ra.ack_response_reason(n);
-                        LOG( INFO ) << "Registration denied due to reason: " << reason;
-                    }
-                }
-            }
-            else if( msg->has_task() )
-            {
-                sap::Task msg_task = msg->task();
-
-                LOG( INFO ) << "Received a sensor task message";
-                task.rejectReason = ParseSensorTask( task, msg_task );
+        reader->Receive();
 
-                // Send the acknowledgement
-                SensorTaskACKData data;
-                data.timestamp = Get_Timestamp( std::chrono::system_clock::now() );
-                data.nodeID = nodeID;
-                data.destID = destID;
-                data.taskID = task.taskID;
-                data.status = task.rejectReason.length() ? "Rejected" : "Accepted";
-                data.reason = task.rejectReason;
-
-                SensorTaskACK sensorRegistration( &data );
-                writer->open( networkStream );
-                sensorRegistration.Write( writer );
-                status.newStatus = true;
-            }
-            else if( msg->has_alert_ack() )
-            {
-                LOG( INFO ) << "Received an alert ack message";
-            }
-            else if( msg->has_error() )
-            {
-                sap::Error msg_err = msg->error();
-                int num_error_messages = msg_err.error_message_size();
-                for( int n=0; n<num_error_messages; n++ )
-                {
-                    std::string err_msg = msg_err.error_message(n);
-                    LOG( WARNING ) << "Received an Error Report. Message: " << err_msg;
-                }
-            }
-            else if( msg->has_registration() )
-            {
-                LOG( WARNING ) << "Received a Registration message.";
-            }
-            else if( msg->has_status_report() )
-            {
-                LOG( WARNING ) << "Received a Status Report.";
-            }
-            else if( msg->has_detection_report() )
-            {
-                LOG( WARNING ) << "Received a Detection Report.";
-            }
-            else if( msg->has_task_ack() )
-            {
-                LOG( WARNING ) << "Received a task ack message.";
-            }
-            else if( msg->has_alert() )
-            {
-                LOG( WARNING ) << "Received an alert message.";
-            }
-
-            if (status.network != AsmClientStatus::NETWORK_REGISTERED &&
-                Get_Time_Monotonic() > registrationTime + registrationTimeout)
-            {
-                LOG( WARNING ) << "Timeout waiting for registration";
-                networkStream->Close();
-            }
+        // Action every complete message that has arrived
+        const sap::SapientMessage *msg;
+        while( (msg = reader->GetMessage( arena )) != nullptr )
+        {
+            AllocationCheck::Event();
+            HandleMessage( status, task, *msg );
         }
     }
-    else // Try connecting
+    else if( connectTimer->Expired() ) // Try connecting
     {
+        // Connecting is non-blocking, so check on its progress periodically
+        AllocationCheck::Event();
+        connectTimer->Start( CONNECT_POLL_INTERVAL );
+
         if (status.network != AsmClientStatus::NETWORK_CONNECTING &&
             status.network != AsmClientStatus::NETWORK_NO_LINK)
         {
@@ -226,27 +326,46 @@ void Network::Loop( struct AsmClientStatus &status, struct AsmClientData &data,
         if (networkStream->Open( timeout ))
         {
             LOG( INFO ) << "Connected!";
+            reader->Reset();
+            // Only content that something has registered to handle is worth parsing
+            reader->SetFilter( nodeID, dispatcher->ContentMask() | sensorMessages->GetDispatcher()->ContentMask() );
+            // Nothing queued for the last connection may go ahead of the registration
+            KeepUnsentDetections();
             status.network = AsmClientStatus::NETWORK_NOT_REGISTERED;
 
             Sleep_ms( (int)(registrationDelay * 1000) );
             LOG( INFO ) << "Sending registration message...";
 
-            SensorRegistrationData data;
-            data.timestamp = Get_Timestamp( std::chrono::system_clock::now() );
-            data.nodeID = nodeID;
-            data.sensorType = sensorType;
-            data.heartbeatInterval = std::to_string( heartbeatInterval );
-            data.fieldOfViewType = fieldOfViewType;
-
-            SensorRegistration sensorRegistration( &data );
-            writer->open( networkStream );
-            sensorRegistration.Write( writer );
-            registrationTime = Get_Time_Monotonic();
+            // The registration only changes with the configuration, so it is built once and then just re-stamped
+            TemplateKey key;
+            key.Add( nodeID );
+            key.Add( sensorType );
+            key.Add( heartbeatInterval );
+            key.Add( fieldOfViewType );
+            if (!registrationTemplate->Matches( key.Value() ))
+            {
+                SensorRegistrationData data;
+                data.timestamp = Get_Time_UTC_ns();
+                data.nodeID = nodeID;
+                data.sensorType = sensorType;
+                data.heartbeatInterval = std::to_string( heartbeatInterval );
+                data.fieldOfViewType = fieldOfViewType;
+
+                SensorRegistration sensorRegistration( &data );
+                registrationTemplate->Begin();
+                templateWriter->open( registrationTemplate );
+                if (sensorRegistration.Write( templateWriter ))
+                {
+                    registrationTemplate->Finish( key.Value(), false );
+                }
+            }
+            registrationTemplate->WriteTo( scheduler->Queue( OutputScheduler::CONTROL ), Get_Time_UTC_ns() );
+            registrationTimer->Start( registrationTimeout );
             status.newStatus = true;
         }
-        else if (Get_Time_Monotonic() > lastNetworkCheckTime + 1)
+        else if (linkCheckTimer->Expired())
         {
-            lastNetworkCheckTime = Get_Time_Monotonic();
+            linkCheckTimer->Start( LINK_CHECK_INTERVAL );
             if (Network_Link_Down( hostname ))
             {
                 if (status.network != AsmClientStatus::NETWORK_NO_LINK)
@@ -264,67 +383,104 @@ void Network::Loop( struct AsmClientStatus &status, struct AsmClientData &data,
     }
 
     defaultTask->bearing = status.compassBearing;
-    defaultTask->horizontalExtent = strtof( statusReportData->coverage->he.c_str(), NULL );
+    defaultTask->horizontalExtent = coverageHalfExtent * 2.0f;
 
+    size_t detectionsSent = 0;
     if (status.network == AsmClientStatus::NETWORK_REGISTERED)
     {
-        double currentTime = Get_Time_Monotonic();
-        if ((status.newStatus && currentTime > lastHeartbeatTime + detectionInterval) ||
-            currentTime > lastHeartbeatTime + heartbeatInterval)
+        if ((status.newStatus && statusHoldoffTimer->Expired()) || heartbeatTimer->Expired())
         {
-            statusReportData->nodeID = nodeID;
-            statusReportData->destID = destID;
-            statusReportData->system = status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE ? "Tamper" : "OK";
-            statusReportData->info = status.newStatus ? "New" : "Unchanged";
-            statusReportData->powerSource = status.powerSource;
-            statusReportData->powerStatus = status.powerStatus;
-            statusReportData->powerLevel = status.powerLevel;
-
+            // Only rebuild the status report if something other than its timestamp, report ID or info has changed
+            TemplateKey key;
+            key.Add( nodeID );
+            key.Add( destID );
+            key.Add( &statusReportData->activeTaskID, sizeof( statusReportData->activeTaskID ) );
+            key.Add( status.tamperStatus );
+            key.Add( status.powerSource );
+            key.Add( status.powerStatus );
+            key.Add( status.powerLevel );
+            key.Add( status.gnssValid );
             if (status.gnssValid)
             {
-                if (statusReportData->sensorLocation == nullptr)
-                    statusReportData->sensorLocation = new StatusReportLocationXY();
-                statusReportData->sensorLocation->x = std::to_string( status.gnssEast );
-                statusReportData->sensorLocation->y = std::to_string( status.gnssNorth );
-                statusReportData->sensorLocation->ex = std::to_string( status.gnssError );
-                statusReportData->sensorLocation->ey = std::to_string( status.gnssError );
+                key.Add( status.gnssEast );
+                key.Add( status.gnssNorth );
+                key.Add( status.gnssError );
             }
-
-            if (statusReportData->fieldOfViewRBC == nullptr)
-                statusReportData->fieldOfViewRBC = new StatusReportLocationRBC();
-            statusReportData->fieldOfViewRBC->az = std::to_string( task.bearing );
-            statusReportData->fieldOfViewRBC->eaz = std::to_string( status.compassBearingError );
-            statusReportData->fieldOfViewRBC->r = std::to_string( task.maxRange );
-            statusReportData->fieldOfViewRBC->er = statusReportData->coverage->er;
-            statusReportData->fieldOfViewRBC->he = std::to_string( task.horizontalExtent );
-            statusReportData->fieldOfViewRBC->ehe = statusReportData->coverage->ehe;
-            statusReportData->fieldOfViewRBC->ve = statusReportData->coverage->ve;
-            statusReportData->fieldOfViewRBC->eve = statusReportData->coverage->eve;
-
-            if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressFovDuringTamper)
+            key.Add( task.bearing );
+            key.Add( task.maxRange );
+            key.Add( task.horizontalExtent );
+            key.Add( status.compassValid );
+            key.Add( status.compassBearing );
+            key.Add( status.compassBearingError );
+            key.Add( data.fault );
+            key.Add( status.externalFault );
+            key.Add( data.clutter );
+
+            int info = status.newStatus ? sap::StatusReport::INFO_NEW : sap::StatusReport::INFO_UNCHANGED;
+            if (!statusTemplate->Matches( key.Value() ) ||
+                !statusTemplate->PatchEnum( sap::StatusReport::kInfoFieldNumber, info ))
             {
-                statusReportData->fieldOfViewRBC->r = "0";
-                LOG( INFO ) << "Suppressed field of view while tamper active";
-            }
+                AllocationCheck::Event();
+                statusReportData->nodeID = nodeID;
+                statusReportData->destID = destID;
+                statusReportData->system = status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE ? "Tamper" : "OK";
+                statusReportData->info = status.newStatus ? "New" : "Unchanged";
+                statusReportData->powerSource = status.powerSource;
+                statusReportData->powerStatus = status.powerStatus;
+                statusReportData->powerLevel = status.powerLevel;
+
+                if (status.gnssValid)
+                {
+                    if (statusReportData->sensorLocation == nullptr)
+                        statusReportData->sensorLocation = new StatusReportLocationXY();
+                    statusReportData->sensorLocation->x = std::to_string( status.gnssEast );
+                    statusReportData->sensorLocation->y = std::to_string( status.gnssNorth );
+                    statusReportData->sensorLocation->ex = std::to_string( status.gnssError );
+                    statusReportData->sensorLocation->ey = std::to_string( status.gnssError );
+                }
 
-            if (status.compassValid)
-            {
-                statusReportData->coverage->az = std::to_string( status.compassBearing );
-                statusReportData->coverage->eaz = std::to_string( status.compassBearingError );
-            }
+                if (statusReportData->fieldOfViewRBC == nullptr)
+                    statusReportData->fieldOfViewRBC = new StatusReportLocationRBC();
+                statusReportData->fieldOfViewRBC->az = std::to_string( task.bearing );
+                statusReportData->fieldOfViewRBC->eaz = std::to_string( status.compassBearingError );
+                statusReportData->fieldOfViewRBC->r = std::to_string( task.maxRange );
+                statusReportData->fieldOfViewRBC->er = statusReportData->coverage->er;
+                statusReportData->fieldOfViewRBC->he = std::to_string( task.horizontalExtent );
+                statusReportData->fieldOfViewRBC->ehe = statusReportData->coverage->ehe;
+                statusReportData->fieldOfViewRBC->ve = statusReportData->coverage->ve;
+                statusReportData->fieldOfViewRBC->eve = statusReportData->coverage->eve;
+
+                if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressFovDuringTamper)
+                {
+                    statusReportData->fieldOfViewRBC->r = "0";
+                    LOG( INFO ) << "Suppressed field of view while tamper active";
+                }
+
+                if (status.compassValid)
+                {
+                    statusReportData->coverage->az = std::to_string( status.compassBearing );
+                    coverageBearing = status.compassBearing;
+                    statusReportData->coverage->eaz = std::to_string( status.compassBearingError );
+                }
 
-            statusReportData->internalFault = data.fault ? "Fault" : "OK";
-            statusReportData->externalFault = status.externalFault ? "Fault" : "OK";
-            statusReportData->clutter = data.clutter ? "High" : "Low";
+                statusReportData->internalFault = data.fault ? "Fault" : "OK";
+                statusReportData->externalFault = status.externalFault ? "Fault" : "OK";
+                statusReportData->clutter = data.clutter ? "High" : "Low";
 
-            statusReportData->timestamp = Get_Timestamp( std::chrono::system_clock::now() );
+                statusReportData->timestamp = Get_Time_UTC_ns();
 
-            StatusReport statusReport( statusReportData );
-            writer->open( networkStream );
-            if (statusReport.Write( writer ) == false)
+                StatusReport statusReport( statusReportData );
+                statusTemplate->Begin();
+                templateWriter->open( statusTemplate );
+                if (statusReport.Write( templateWriter ))
+                {
+                    statusTemplate->Finish( key.Value(), true );
+                }
+            }
+
+            if (!statusTemplate->WriteTo( scheduler->Queue( OutputScheduler::HEALTH ), Get_Time_UTC_ns() ))
             {
-                LOG( INFO ) << "Failed to send heartbeat message. Closing connection.";
-                networkStream->Close();
+                LOG( WARNING ) << "Failed to queue heartbeat message";
             }
             else
             {
@@ -332,211 +488,415 @@ void Network::Loop( struct AsmClientStatus &status, struct AsmClientData &data,
             }
 
             status.newStatus = false;
-            lastHeartbeatTime = currentTime;
+            heartbeatTimer->Start( heartbeatInterval );
+            statusHoldoffTimer->Start( detectionInterval );
         }
 
-        if (data.detections.size() > 0 && currentTime > lastDetectionTime + detectionInterval)
+        if (data.detections.size() > 0 && detectionTimer->Expired() && scheduler->Congested())
         {
-            struct DetectionReportData detectionReportData;
-
-            detectionReportData.timestamp = data.timestamp;
-            detectionReportData.nodeID = nodeID;
-            detectionReportData.destID = destID;
-            detectionReportData.taskID = statusReportData->activeTaskID;
+            // The socket is not keeping up, so keep these back rather than let them queue up
+            if (congestedDetections == 0)
+            {
+                LOG( INFO ) << (journal != nullptr ? "Journalling" : "Dropping") << " detections while the network is congested";
+            }
+            if (journal != nullptr)
+            {
+                WriteDetections( status, data, task, journal );
+            }
+            congestedDetections += data.detections.size();
+            status.detectionsReported = 0;
+            detectionTimer->Start( detectionInterval );
+        }
+        else if (data.detections.size() > 0 && detectionTimer->Expired())
+        {
+            if (congestedDetections > 0)
+            {
+                LOG( INFO ) << "Network no longer congested after holding back " << congestedDetections << " detections";
+                congestedDetections = 0;
+            }
+            int written = WriteDetections( status, data, task, scheduler->Queue( OutputScheduler::BULK ) );
+            if (written < 0)
+            {
+                LOG( WARNING ) << "Output queue full, failed to queue all detection messages";
+            }
+            status.detectionsReported = written < 0 ? 0 : written;
 
-            detectionReportData.rangeBearing = new DetectionReportLocationRB();
-            detectionReportData.objectDopplerSpeed = new DetectionReportValue();
+            if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressDetectionsDuringTamper)
+            {
+                VLOG( 1 ) << "Suppressed " << data.detections.size() << " detections while tamper active";
+            }
+            else if (networkStream->IsOpen())
+            {
+                detectionsSent = data.detections.size();
+            }
 
+            detectionTimer->Start( detectionInterval );
+        }
+        else if(detectionTimer->Expired())
+        {
             status.detectionsReported = 0;
-            std::vector<AsmClientData::Detection>::iterator detection;
-            for (detection = data.detections.begin(); detection != data.detections.end(); detection++)
+        }
+
+        // Catch up on detections journalled while we were not registered, a few at a time after the live ones
+        if (journal != nullptr && !journal->Empty() && replayTimer->Expired() && !scheduler->Congested())
+        {
+            journal->Replay( scheduler->Queue( OutputScheduler::BULK ), journalReplayFrames, journalMaxAge, destID );
+            if (journal->Empty())
             {
-                float bearing = fmodf( status.compassBearing + detection->direction + 360.0f, 360.0f );
-                float offsetAngle = fmodf( bearing - task.bearing + 540.0f, 360.0f ) - 180.0f;
+                LOG( INFO ) << "Sent all journalled detections";
+            }
+            replayTimer->Start( journalReplayInterval );
+        }
+    }
+    else if (journal != nullptr && data.detections.size() > 0 && detectionTimer->Expired())
+    {
+        // Keep the detections until they can be sent
+        bool wasEmpty = journal->Empty();
+        // Until the first registration there is no task, so filter with the one registration will give
+        if (WriteDetections( status, data, hasRegistered ? task : *defaultTask, journal ) < 0)
+        {
+            LOG( WARNING ) << "Failed to journal detections";
+        }
+        else if (wasEmpty && !journal->Empty())
+        {
+            LOG( INFO ) << "Journalling detections until registered";
+        }
+        detectionTimer->Start( detectionInterval );
+    }
 
-                if (detection->range < task.minRange || detection->range > task.maxRange) continue;
-                if (fabs( offsetAngle ) > task.horizontalExtent / 2.0) continue;
+    // Hand over whatever the socket can take, most important first
+    if (networkStream->IsOpen())
+    {
+        if (!scheduler->Flush( networkStream ))
+        {
+            LOG( INFO ) << "Failed to send messages. Closing connection.";
+            networkStream->Close();
+        }
+        else if (scheduler->Pending())
+        {
+            flushTimer->Start( FLUSH_RETRY_INTERVAL );
+        }
+    }
+    unsigned long dropped = scheduler->Queue( OutputScheduler::HEALTH )->TakeDropped();
+    if (dropped > 0)
+    {
+        LOG( WARNING ) << "Discarded " << dropped << " unsent status reports";
+    }
+    dropped = scheduler->Queue( OutputScheduler::CONTROL )->TakeDropped();
+    if (dropped > 0)
+    {
+        LOG( WARNING ) << "Discarded " << dropped << " control messages that did not fit in the output queue";
+    }
 
-                if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressDetectionsDuringTamper) continue;
+    if (batchOutput && networkStream->IsOpen() && !networkStream->EndBatch())
+    {
+        LOG( INFO ) << "Failed to send messages. Closing connection.";
+        networkStream->Close();
+    }
+    if (detectionsSent > 0 && batchOutput)
+    {
+        const NetworkStreamStats &stats = networkStream->GetStats();
+        VLOG( 1 ) << "Sent " << status.detectionsReported << " of " << detectionsSent << " detections ("
+            << stats.lastFlushBytes << " bytes in " << stats.lastFlushSends << " sends)";
+    }
+    else if (detectionsSent > 0)
+    {
+        VLOG( 1 ) << "Sent " << status.detectionsReported << " of " << detectionsSent << " detections";
+    }
 
-                detectionReportData.objectID = detection->id;
-                detectionReportData.rangeBearing->r = std::to_string( detection->range );
-                detectionReportData.rangeBearing->er = "1.0";
-                detectionReportData.rangeBearing->az = std::to_string( bearing );
-                detectionReportData.rangeBearing->eaz = std::to_string( detection->directionError );
+    WatchSocket();
+}
 
-                detectionReportData.objectDopplerSpeed->value = std::to_string( detection->dopplerSpeed );
-                detectionReportData.objectDopplerSpeed->e = "0.25";
 
-                detectionReportData.detectionConfidence = std::to_string( detection->detectionConfidence );
-                detectionReportData.humanConfidence = std::to_string( detection->humanConfidence );
-                detectionReportData.vehicleConfidence = std::to_string( detection->vehicleConfidence );
-                detectionReportData.unknownConfidence = std::to_string( detection->unknownConfidence );
+void Network::HandleMessage( struct AsmClientStatus &status, struct AsmClientTask &task, const sap::SapientMessage &msg )
+{
+    // The reader normally drops messages for other nodes before they are parsed
+    if( msg.destination_id() != nodeID )
+    {
+        return;
+    }
+    dispatcher->Dispatch( msg, status, task );
+    sensorMessages->Post( msg, status, task );
+}
 
-                if (detection->vehicleTwoWheelConfidence + detection->vehicleFourWheelConfidence > 0)
-                {
-                    detectionReportData.vehicleTwoWheelConfidence = std::to_string( detection->vehicleTwoWheelConfidence );
-                    detectionReportData.vehicleFourWheelConfidence = std::to_string( detection->vehicleFourWheelConfidence );
-                }
-                if (detection->vehicleFourWheelHeavyConfidence +
-                    detection->vehicleFourWheelMediumConfidence +
-                    detection->vehicleFourWheelLightConfidence > 0)
-                {
-                    detectionReportData.vehicleFourWheelHeavyConfidence = std::to_string( detection->vehicleFourWheelHeavyConfidence );
-                    detectionReportData.vehicleFourWheelMediumConfidence = std::to_string( detection->vehicleFourWheelMediumConfidence );
-                    detectionReportData.vehicleFourWheelLightConfidence = std::to_string( detection->vehicleFourWheelLightConfidence );
-                }
 
-                detectionReportData.humanWalkingConfidence = std::to_string( detection->humanWalkingConfidence );
-                detectionReportData.humanRunningConfidence = std::to_string( detection->humanRunningConfidence );
-                detectionReportData.humanLoiteringConfidence = std::to_string( detection->humanLoiteringConfidence );
-                detectionReportData.humanCrawlingConfidence = std::to_string( detection->humanCrawlingConfidence );
+MessageDispatcher *Network::GetSensorDispatcher()
+{
+    return sensorMessages->GetDispatcher();
+}
 
-                detectionReportData.staticObjectConfidence = std::to_string( detection->staticObjectConfidence );
 
-                status.detectionsReported++;
+void Network::AttachSensorReactor( Reactor *reactor )
+{
+    sensorMessages->AttachReactor( reactor );
+}
 
-                DetectionReport detectionReport( &detectionReportData );
-                writer->open( networkStream );
-                if (detectionReport.Write( writer ) == false)
-                {
-                    LOG( INFO ) << "Failed to send detection messages. Closing connection.";
-                    networkStream->Close();
-                }
-            }
 
-            delete detectionReportData.rangeBearing;
-            delete detectionReportData.objectDopplerSpeed;
+void Network::DispatchSensorMessages()
+{
+    sensorMessages->Dispatch();
+}
 
-            if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressDetectionsDuringTamper)
-            {
-                LOG( INFO ) << "Suppressed " << data.detections.size() << " detections while tamper active";
-            }
-            else if (networkStream->IsOpen())
-            {
-                LOG( INFO ) << "Sent " << status.detectionsReported << " of " << data.detections.size() << " detections";
-            }
 
-            lastDetectionTime = currentTime;
-        }
-        else if(currentTime > lastDetectionTime + detectionInterval)
+void Network::HandleRegistrationAck( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )
+{
+    const sap::RegistrationAck &msg_ra = msg.registration_ack();
+    if( msg_ra.acceptance() )
+    {
+        LOG( INFO ) << "Received registration ACK";
+
+        // Set the new dest to this registered node for all subsequent messages going out
+        destID = msg.node_id();
+
+        status.network = AsmClientStatus::NETWORK_REGISTERED;
+        hasRegistered = true;
+
+        task = *defaultTask;
+        regions->Clear();
+        status.newStatus = true;
+    }
+    else
+    {
+        // NETWORK_NOT_REGISTERED ? Why...
+        int num_reasons = msg_ra.ack_response_reason_size();
+        for( int n=0; n<num_reasons; n++ )
         {
-            status.detectionsReported = 0;
+            const std::string &reason = msg_ra.ack_response_reason(n);
+            LOG( INFO ) << "Registration denied due to reason: " << reason;
         }
     }
 }
 
 
-std::string Network::ParseSensorTask( struct AsmClientTask &task, sap::Task& msg_task )
+void Network::HandleTask( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )
 {
-    SensorTask sensorTask( msg_task );
-    const SensorTaskData taskData = sensorTask.GetSensorTaskData();
+    LOG( INFO ) << "Received a sensor task message";
+    task.rejectReason = ParseSensorTask( status, task, msg.task() );
+
+    // Send the acknowledgement
+    SensorTaskACKData data;
+    data.timestamp = Get_Time_UTC_ns();
+    data.nodeID = nodeID;
+    data.destID = destID;
+    data.taskID = task.taskID;
+    data.status = task.rejectReason.length() ? "Rejected" : "Accepted";
+    data.reason = task.rejectReason;
+
+    SensorTaskACK sensorTaskACK( &data );
+    writer->open( scheduler->Queue( OutputScheduler::CONTROL ) );
+    sensorTaskACK.Write( writer );
+    status.newStatus = true;
+}
 
-    task.newTask = true;
-    task.taskID = taskData.taskID;
 
-    if (taskData.control == "Default")
+void Network::HandleAlertAck( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )
+{
+    LOG( INFO ) << "Received an alert ack message";
+}
+
+
+void Network::HandleError( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task )
+{
+    const sap::Error &msg_err = msg.error();
+    int num_error_messages = msg_err.error_message_size();
+    for( int n=0; n<num_error_messages; n++ )
     {
-        task = *defaultTask;
+        const std::string &err_msg = msg_err.error_message(n);
+        LOG( WARNING ) << "Received an Error Report. Message: " << err_msg;
     }
-    if (taskData.control == "Start")
-    {
-        if (taskData.region.type == "Area of Interest")
-        {
-            float range = strtof( taskData.region.rangeBearingCone.r.c_str(), NULL );
-            float bearing = strtof( taskData.region.rangeBearingCone.az.c_str(), NULL );
-            float horizontalExtent = strtof( taskData.region.rangeBearingCone.he.c_str(), NULL );
-            float coverageExtent = strtof( statusReportData->coverage->he.c_str(), NULL );
-            float direction = bearing - strtof( statusReportData->coverage->az.c_str(), NULL );
+}
 
-            while (direction > 180) direction -= 360;
-            while (direction < -180) direction += 360;
 
-            if (range > strtod( statusReportData->coverage->r.c_str(), NULL ))
-            {
-                return "Out Of Range";
-            }
-            if (horizontalExtent / 2.0 > (coverageExtent / 2.0 - fabs( direction )))
-            {
-                return "Outside Field of View";
-            }
+// Writes a report for each detection within the task's coverage. Returns the number written, or -1 if writing failed.
+int Network::WriteDetections( struct AsmClientStatus &status, struct AsmClientData &data, struct AsmClientTask &task, IOutputStream *out )
+{
+    encoder->Begin( data.timestamp, nodeID, destID, statusReportData->activeTaskID );
 
-            task.maxRange = range;
-            task.bearing = bearing;
-            task.horizontalExtent = horizontalExtent;
-        }
-        else if (!taskData.region.type.empty())
-        {
-            return "Not Supported";
-        }
+    DetectionReportFields fields;
+    fields.rangeError = 1.0f;
+    fields.dopplerSpeedError = 0.25f;
 
-        if (!taskData.command.classificationThreshold.empty())
-        {
-            return "Not Supported";
-        }
-        if (!taskData.command.detectionReportRate.empty())
+    // The pass's report IDs share one reading of the clock, and follow each other in the generator's sequence
+    UlidGenerator &reportIDs = UlidGenerator::ThisThread();
+    int64_t now = Get_Time_UTC_ns();
+
+    batch->Load( data.detections );
+    batch->Gate( status.compassBearing, task.bearing, task.horizontalExtent, task.minRange, task.maxRange );
+    const uint8_t *selected = batch->Selected();
+
+    int written = 0;
+    for (size_t i = 0; i < batch->Size(); i++)
+    {
+        if (!selected[i]) continue;
+
+        const AsmClientData::Detection *detection = &data.detections[i];
+        float bearing = batch->Bearing()[i];
+        if (!regions->Admits( detection->range, bearing )) continue;
+
+        if (status.tamperStatus == AsmClientStatus::TAMPER_ACTIVE && suppressDetectionsDuringTamper) continue;
+
+        reportIDs.Generate( now, fields.reportID );
+        fields.objectID = detection->idText;
+        fields.range = detection->range;
+        fields.azimuth = bearing;
+        fields.azimuthError = detection->directionError;
+        fields.dopplerSpeed = detection->dopplerSpeed;
+        fields.detectionConfidence = detection->detectionConfidence;
+
+        fields.present = DetectionReportFields::DOPPLER_SPEED |
+            DetectionReportFields::HUMAN | DetectionReportFields::VEHICLE |
+            DetectionReportFields::STATIC_OBJECT | DetectionReportFields::UNKNOWN |
+            DetectionReportFields::WALKING | DetectionReportFields::RUNNING |
+            DetectionReportFields::LOITERING | DetectionReportFields::CRAWLING;
+        fields.humanConfidence = detection->humanConfidence;
+        fields.vehicleConfidence = detection->vehicleConfidence;
+        fields.unknownConfidence = detection->unknownConfidence;
+        fields.staticObjectConfidence = detection->staticObjectConfidence;
+
+        if (detection->vehicleTwoWheelConfidence + detection->vehicleFourWheelConfidence > 0)
         {
-            if (taskData.command.detectionReportRate == "Low") detectionInterval = 2.0;
-            else if (taskData.command.detectionReportRate == "Medium") detectionInterval = 0.5;
-            else if (taskData.command.detectionReportRate == "High") detectionInterval = 0.1;
-            else if (taskData.command.detectionReportRate == "Lower") detectionInterval *= 2.0;
-            else if (taskData.command.detectionReportRate == "Higher") detectionInterval *= 0.5;
-            else return "Not Supported";
-            return "";
+            fields.present |= DetectionReportFields::VEHICLE_TWO_WHEEL | DetectionReportFields::VEHICLE_FOUR_WHEEL;
+            fields.vehicleTwoWheelConfidence = detection->vehicleTwoWheelConfidence;
+            fields.vehicleFourWheelConfidence = detection->vehicleFourWheelConfidence;
         }
-        if (!taskData.command.detectionThreshold.empty())
+        if (detection->vehicleFourWheelHeavyConfidence +
+            detection->vehicleFourWheelMediumConfidence +
+            detection->vehicleFourWheelLightConfidence > 0)
         {
-            //TODO Add support for tasking detection threshold
-            /*
-            if (taskData.command.detectionThreshold == "Low") detectionInterval = 2.0;
-            else if (taskData.command.detectionThreshold == "Medium") detectionInterval = 0.5;
-            else if (taskData.command.detectionThreshold == "High") detectionInterval = 0.1;
-            else if (taskData.command.detectionThreshold == "Lower") detectionInterval *= 2.0;
-            else if (taskData.command.detectionThreshold == "Higher") detectionInterval *= 0.5;
-            else return "Not Supported";
-            */
-            return "Not Supported";
+            fields.present |= DetectionReportFields::VEHICLE_HEAVY | DetectionReportFields::VEHICLE_MEDIUM |
+                DetectionReportFields::VEHICLE_LIGHT;
+            fields.vehicleFourWheelHeavyConfidence = detection->vehicleFourWheelHeavyConfidence;
+            fields.vehicleFourWheelMediumConfidence = detection->vehicleFourWheelMediumConfidence;
+            fields.vehicleFourWheelLightConfidence = detection->vehicleFourWheelLightConfidence;
         }
-        if (!taskData.command.mode.empty())
+
+        fields.humanWalkingConfidence = detection->humanWalkingConfidence;
+        fields.humanRunningConfidence = detection->humanRunningConfidence;
+        fields.humanLoiteringConfidence = detection->humanLoiteringConfidence;
+        fields.humanCrawlingConfidence = detection->humanCrawlingConfidence;
+
+        if (encoder->Write( out, fields ) == false)
         {
-            return "Not Supported";
+            written = -1;
+            break;
         }
-        if (!taskData.command.rangeBearingCone.az.empty())
-        {
-            float range = strtof( taskData.command.rangeBearingCone.r.c_str(), NULL );
-            float bearing = strtof( taskData.command.rangeBearingCone.az.c_str(), NULL );
-            float horizontalExtent = strtof( taskData.command.rangeBearingCone.he.c_str(), NULL );
-            float coverageExtent = strtof( statusReportData->coverage->he.c_str(), NULL );
-            float direction = bearing - strtof( statusReportData->coverage->az.c_str(), NULL );
+        written++;
+    }
+
+    return written;
+}
+
+
+// Returns the reason a task for this cone would be rejected, or NULL if it lies within the coverage
+const char *Network::CheckCoverage( const SensorTaskRangeBearingCone &cone ) const
+{
+    float direction = cone.azimuth - coverageBearing;
+
+    while (direction > 180) direction -= 360;
+    while (direction < -180) direction += 360;
+
+    if (cone.range > coverageRange)
+    {
+        return "Out Of Range";
+    }
+    if (cone.horizontalExtent / 2.0f > (coverageHalfExtent - fabsf( direction )))
+    {
+        return "Outside Field of View";
+    }
+    return NULL;
+}
 
-            while (direction > 180) direction -= 360;
-            while (direction < -180) direction += 360;
 
-            if (range > strtod( statusReportData->coverage->r.c_str(), NULL ))
+const char *Network::ParseSensorTask( struct AsmClientStatus &status, struct AsmClientTask &task, const sap::Task& msg_task )
+{
+    SensorTask sensorTask( msg_task );
+    const SensorTaskData &taskData = sensorTask.GetSensorTaskData();
+
+    task.newTask = true;
+    task.taskID = taskData.taskID;
+
+    if (taskData.control == SensorTaskData::START)
+    {
+        if (taskData.regions > 0)
+        {
+            RegionOrigin origin;
+            origin.valid = status.gnssValid;
+            origin.latitude = status.gnssNorth;
+            origin.longitude = status.gnssEast;
+
+            const char *reason = newRegions->Compile( msg_task, origin );
+            if (reason)
             {
-                return "Out Of Range";
+                return reason;
             }
-            if (horizontalExtent / 2.0 > (coverageExtent / 2.0 - fabs( direction )))
+
+            // As for a LOOK_AT, area of interest and boundary cones must lie within the coverage
+            for (size_t n = 0; n < newRegions->Count(); n++)
             {
-                return "Outside Field of View";
+                SensorTaskRangeBearingCone cone;
+                if (newRegions->GetCone( n, RegionEngine::AREA_OF_INTEREST | RegionEngine::BOUNDARY, cone ))
+                {
+                    reason = CheckCoverage( cone );
+                    if (reason)
+                    {
+                        return reason;
+                    }
+                }
             }
-
-            task.maxRange = range;
-            task.bearing = bearing;
-            task.horizontalExtent = horizontalExtent;
         }
 
-        if (taskData.command.request == "Start")
-        {
-            return "";
-        }
-        else if (taskData.command.request == "Stop")
+        switch (taskData.command.type)
         {
-            task = *defaultTask;
+            case SensorTaskCommand::DETECTION_REPORT_RATE:
+                if (taskData.command.threshold == SensorTaskCommand::THRESHOLD_LOW) detectionInterval = 2.0;
+                else if (taskData.command.threshold == SensorTaskCommand::THRESHOLD_MEDIUM) detectionInterval = 0.5;
+                else if (taskData.command.threshold == SensorTaskCommand::THRESHOLD_HIGH) detectionInterval = 0.1;
+                else return "Not Supported";
+                break;
+
+            case SensorTaskCommand::LOOK_AT:
+            {
+                const SensorTaskRangeBearingCone &cone = taskData.command.rangeBearingCone;
+                const char *reason = CheckCoverage( cone );
+                if (reason)
+                {
+                    return reason;
+                }
+
+                task.maxRange = cone.range;
+                task.bearing = cone.azimuth;
+                task.horizontalExtent = cone.horizontalExtent;
+                break;
+            }
+
+            case SensorTaskCommand::REQUEST:
+                if (taskData.command.request == SensorTaskCommand::REQUEST_STOP)
+                {
+                    task = *defaultTask;
+                    regions->Clear();
+                    return "";
+                }
+                else if (taskData.command.request != SensorTaskCommand::REQUEST_START)
+                {
+                    return "Not Supported";
+                }
+                break;
+
+            case SensorTaskCommand::NONE:
+                break;
+
+            //TODO Add support for tasking detection threshold
+            case SensorTaskCommand::DETECTION_THRESHOLD:
+            case SensorTaskCommand::CLASSIFICATION_THRESHOLD:
+            case SensorTaskCommand::MODE_CHANGE:
+            default:
+                return "Not Supported";
         }
-        else if (!taskData.command.request.empty())
+
+        // Only once the task is accepted do its regions replace those of the last
+        if (taskData.regions > 0)
         {
-            return "Not Supported";
+            std::swap( regions, newRegions );
         }
     }
     return "";
@@ -16,6 +16,17 @@ namespace ProtobufInterface
     class Writer;
 }
 class NetworkStream;
+class IOutputStream;
+class MessageTemplate;
+class DetectionJournal;
+class OutputScheduler;
+class MessageDispatcher;
+class MessageQueue;
+class RegionEngine;
+class DetectionBatch;
+class DetectionReportEncoder;
+class Reactor;
+class ReactorTimer;
 struct StatusReportData;
 struct AsmClientTask;
 
@@ -24,35 +35,98 @@ class Network
 public:
     Network();
     virtual ~Network();
+    // Called before Initialise with the reactor that the socket and timers should wake
+    void AttachReactor( Reactor *reactor );
     void Initialise( const char *configFilename );
     void Loop( struct AsmClientStatus &status, struct AsmClientData &data, struct AsmClientTask &task );
 
+    // Sensors subscribe to received messages by registering handlers here, after Initialise.
+    // They are called from DispatchSensorMessages, on the thread that runs the sensor's Loop,
+    // whose reactor is woken when there are messages for them.
+    MessageDispatcher *GetSensorDispatcher();
+    void AttachSensorReactor( Reactor *reactor );
+    void DispatchSensorMessages();
+
 private:
-    std::string ParseSensorTask( struct AsmClientTask &task, sap::Task& msg_task );
+    int WriteDetections( struct AsmClientStatus &status, struct AsmClientData &data, struct AsmClientTask &task, IOutputStream *out );
+    void HandleMessage( struct AsmClientStatus &status, struct AsmClientTask &task, const sap::SapientMessage &msg );
+    void HandleRegistrationAck( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task );
+    void HandleTask( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task );
+    void HandleAlertAck( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task );
+    void HandleError( const sap::SapientMessage &msg, struct AsmClientStatus &status, struct AsmClientTask &task );
+    const char *ParseSensorTask( struct AsmClientStatus &status, struct AsmClientTask &task, const sap::Task& msg_task );
+    const char *CheckCoverage( const struct SensorTaskRangeBearingCone &cone ) const;
+
+    void KeepUnsentDetections();
+    void WatchSocket();
 
     ProtobufInterface::Reader *reader;
     ProtobufInterface::Writer *writer;
+    MessageDispatcher *dispatcher;
+    MessageQueue *sensorMessages;
+
+    // Messages received and sent during a pass are created on this arena, which is reset at the start of each pass
+    google::protobuf::Arena *arena;
+    char *arenaBlock;
+
+    // Encoded status and registration messages, re-sent with only a few bytes patched while their inputs are unchanged
+    ProtobufInterface::Writer *templateWriter;
+    MessageTemplate *statusTemplate;
+    MessageTemplate *registrationTemplate;
+
+    // Detections made while not registered are kept here and replayed once registered
+    DetectionJournal *journal;
+    ReactorTimer *replayTimer;
+    bool hasRegistered;
+    double journalMaxAge;
+    int journalReplayFrames;
+    double journalReplayInterval;
+
+    // Everything sent is queued by priority and handed to the socket at the end of each pass
+    OutputScheduler *scheduler;
+    ReactorTimer *flushTimer;
+    unsigned long congestedDetections;
+
+    Reactor *reactor;
+    int watchedFd;
+    bool watchedWritable;
+    ReactorTimer *connectTimer;
+    ReactorTimer *linkCheckTimer;
+    ReactorTimer *registrationTimer;
+    ReactorTimer *heartbeatTimer;
+    ReactorTimer *statusHoldoffTimer;
+    ReactorTimer *detectionTimer;
 
     NetworkStream *networkStream;
     std::string hostname;
     int port;
     int timeout;
-    double lastNetworkCheckTime;
     double registrationDelay;
-    double registrationTime;
     double registrationTimeout;
     double detectionInterval;
-    double lastDetectionTime;
 
     std::string nodeID;
     std::string destID;
     int heartbeatInterval;
-    double lastHeartbeatTime;
     std::string sensorType;
     int suppressDetectionsDuringTamper;
     int suppressFovDuringTamper;
     std::string fieldOfViewType;
+    int batchOutput;
+    double batchMaxLatency;
 
     struct StatusReportData *statusReportData;
+    float coverageRange;
+    float coverageBearing;
+    float coverageHalfExtent;
     struct AsmClientTask *defaultTask;
+
+    // The current task's regions, and those of a new task until it is accepted
+    RegionEngine *regions;
+    RegionEngine *newRegions;
+
+    // Gates each pass's detections against the task's range and bearing
+    DetectionBatch *batch;
+    // Kept from pass to pass so that its buffers are reused
+    DetectionReportEncoder *encoder;
 };
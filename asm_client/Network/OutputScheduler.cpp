@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "OutputScheduler.h"
+#include "ProtobufInterface/NetworkStream.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Frames start with their payload length as 4 little-endian bytes
+#define FRAME_HEADER_SIZE 4
+
+
+OutputQueue::OutputQueue( size_t budget, Overflow overflow ) :
+    buffer( budget ),
+    head( 0 ),
+    tail( 0 ),
+    frames( 0 ),
+    dropped( 0 ),
+    overflow( overflow )
+{
+}
+
+unsigned long OutputQueue::TakeDropped()
+{
+    unsigned long count = dropped;
+    dropped = 0;
+    return count;
+}
+
+static size_t FrameLength( const unsigned char *p )
+{
+    return FRAME_HEADER_SIZE + (p[0] | (p[1] << 8) | (p[2] << 16) | ((size_t)p[3] << 24));
+}
+
+const unsigned char *OutputQueue::Front( size_t *length ) const
+{
+    if (frames == 0) return NULL;
+
+    const unsigned char *p = &buffer[head];
+    *length = FrameLength( p );
+    return p;
+}
+
+const unsigned char *OutputQueue::Span( size_t maxBytes, bool firstAlways, size_t *length ) const
+{
+    size_t end = head;
+    while (end < tail)
+    {
+        size_t frame = FrameLength( &buffer[end] );
+        if (end - head + frame > maxBytes && !(end == head && firstAlways)) break;
+        end += frame;
+    }
+    *length = end - head;
+    return end > head ? &buffer[head] : NULL;
+}
+
+size_t OutputQueue::Consume( size_t bytes )
+{
+    size_t length;
+    while (Front( &length ) != NULL && length <= bytes)
+    {
+        bytes -= length;
+        Pop();
+    }
+    return bytes;
+}
+
+void OutputQueue::Pop()
+{
+    size_t length;
+    if (Front( &length ) == NULL) return;
+
+    head += length;
+    frames--;
+    if (frames == 0) head = tail = 0;
+}
+
+void OutputQueue::Clear()
+{
+    head = tail = 0;
+    frames = 0;
+}
+
+unsigned char *OutputQueue::Reserve( size_t iOctets )
+{
+    if (iOctets > buffer.size())
+    {
+        dropped++;
+        return NULL;
+    }
+
+    while (Bytes() + iOctets > buffer.size())
+    {
+        if (overflow == REJECT_NEWEST)
+        {
+            dropped++;
+            return NULL;
+        }
+        Pop();
+        dropped++;
+    }
+
+    // Frames are kept contiguous, so move what is queued back to the start when the end is reached
+    if (tail + iOctets > buffer.size())
+    {
+        memmove( &buffer[0], &buffer[head], Bytes() );
+        tail -= head;
+        head = 0;
+    }
+    return &buffer[tail];
+}
+
+bool OutputQueue::Commit( size_t iOctets )
+{
+    tail += iOctets;
+    frames++;
+    return true;
+}
+
+bool OutputQueue::Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote )
+{
+    unsigned char *p = Reserve( iOctets );
+    if (p == NULL) return false;
+
+    memcpy( p, pOctets, iOctets );
+    iWrote = iOctets;
+    return Commit( iOctets );
+}
+
+
+OutputScheduler::OutputScheduler( size_t controlBudget, size_t healthBudget, size_t bulkBudget, size_t sendHighWater ) :
+    sendHighWater( sendHighWater ),
+    heldBack( false )
+{
+    // Only the latest status matters, but acknowledgements and detections must not be lost silently
+    queues[CONTROL] = new OutputQueue( controlBudget, OutputQueue::REJECT_NEWEST );
+    queues[HEALTH] = new OutputQueue( healthBudget, OutputQueue::DROP_OLDEST );
+    queues[BULK] = new OutputQueue( bulkBudget, OutputQueue::REJECT_NEWEST );
+}
+
+OutputScheduler::~OutputScheduler()
+{
+    for (int i = 0; i < PRIORITIES; i++)
+    {
+        delete queues[i];
+    }
+}
+
+bool OutputScheduler::Flush( NetworkStream *out )
+{
+    heldBack = false;
+    if (!Move( queues[CONTROL], out, NULL ) || !Move( queues[HEALTH], out, NULL )) return false;
+
+    // Asking the socket is a system call, so ask once and add on what is moved after
+    size_t unsent = out->Unsent();
+    return Move( queues[BULK], out, &unsent );
+}
+
+// Only sends frames while fewer than sendHighWater bytes are unsent, if unsent is given
+bool OutputScheduler::Move( OutputQueue *queue, NetworkStream *out, size_t *unsent )
+{
+    if (queue->Frames() == 0) return true;
+
+    // While the stream holds bytes the socket would not take, frames wait here rather than being copied in behind them
+    if (out->Pending() > 0)
+    {
+        heldBack = true;
+        return true;
+    }
+
+    // Leave bulk frames queued while the socket is behind, so later control and health frames are not stuck behind them
+    size_t maxBytes = SIZE_MAX;
+    bool firstAlways = true;
+    if (unsent != NULL)
+    {
+        maxBytes = *unsent < sendHighWater ? sendHighWater - *unsent : 0;
+        firstAlways = *unsent == 0;
+    }
+    size_t length;
+    const unsigned char *span = queue->Span( maxBytes, firstAlways, &length );
+    if (span == NULL)
+    {
+        heldBack = true;
+        return true;
+    }
+
+    size_t sent;
+    bool ok = out->SendDirect( span, length, sent );
+    size_t partial = queue->Consume( sent );
+    if (!ok) return false;
+    if (unsent != NULL) *unsent += sent;
+    if (sent == length) return true;
+
+    // The rest of a frame the socket took part of must follow it, so goes to the stream to be sent when it can
+    if (partial > 0)
+    {
+        size_t frameLength;
+        const unsigned char *frame = queue->Front( &frameLength );
+        size_t wrote;
+        if (!out->Write( (unsigned char *)frame + partial, frameLength - partial, wrote )) return false;
+        queue->Pop();
+        if (unsent != NULL) *unsent += frameLength - partial;
+    }
+    heldBack = true;
+    return true;
+}
+
+bool OutputScheduler::Pending() const
+{
+    for (int i = 0; i < PRIORITIES; i++)
+    {
+        if (queues[i]->Frames() > 0) return true;
+    }
+    return false;
+}
+
+bool OutputScheduler::Congested() const
+{
+    return heldBack || queues[BULK]->Bytes() > queues[BULK]->Budget() / 2;
+}
+
+unsigned long OutputScheduler::Clear( IOutputStream *keepBulk )
+{
+    unsigned long kept = 0;
+    const unsigned char *frame;
+    size_t length, wrote;
+    while (keepBulk != NULL && (frame = queues[BULK]->Front( &length )) != NULL)
+    {
+        if (!keepBulk->Write( (unsigned char *)frame, length, wrote )) break;
+        queues[BULK]->Pop();
+        kept++;
+    }
+
+    for (int i = 0; i < PRIORITIES; i++)
+    {
+        queues[i]->Clear();
+    }
+    heldBack = false;
+    return kept;
+}
@@ -0,0 +1,110 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "ProtobufInterface/Stream.h"
+
+#include <stddef.h>
+#include <vector>
+
+class NetworkStream;
+
+// Holds whole encoded frames, up to a byte budget, until they are moved to the socket.
+// Messages are written into it through a Writer.
+class OutputQueue : public IOutputStream
+{
+public:
+    // What to do with a frame that does not fit within the budget
+    enum Overflow
+    {
+        REJECT_NEWEST,      // Refuse the new frame
+        DROP_OLDEST,        // Discard queued frames until it fits, for messages that supersede earlier ones
+    };
+
+    OutputQueue( size_t budget, Overflow overflow );
+
+    size_t Bytes() const { return tail - head; }
+    size_t Budget() const { return buffer.size(); }
+    unsigned long Frames() const { return frames; }
+
+    // Number of frames refused or discarded since last asked
+    unsigned long TakeDropped();
+
+    // The oldest frame, or NULL if there are none
+    const unsigned char *Front( size_t *length ) const;
+    void Pop();
+
+    // The oldest frames, which are contiguous, as many whole ones as fit in maxBytes. The first is
+    // included whatever its size if firstAlways is set. Returns NULL if none are included.
+    const unsigned char *Span( size_t maxBytes, bool firstAlways, size_t *length ) const;
+
+    // Pops the frames wholly within the first bytes of the queue, and returns how many bytes
+    // of the frame after them that leaves, so that they need not be sent again
+    size_t Consume( size_t bytes );
+    void Clear();
+
+    // IOutputStream, used by the Writer to add a frame
+    virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote );
+    virtual bool Send( bool bTerminator ) { return true; }
+    virtual void Close() {}
+    virtual unsigned char *Reserve( size_t iOctets );
+    virtual bool Commit( size_t iOctets );
+
+private:
+    std::vector<unsigned char> buffer;
+    size_t head;
+    size_t tail;
+    unsigned long frames;
+    unsigned long dropped;
+    Overflow overflow;
+};
+
+// Sends outgoing messages by priority rather than in the order they were written, so
+// registration and task acknowledgements go first, then status reports, then detections.
+// Detections are held back while the socket is not keeping up, so the messages the DMM
+// uses to decide whether we are alive never wait behind a burst of them. Frames are sent
+// to the socket straight from the queues; only the rest of a frame the socket took part
+// of is copied into the stream, and the frames behind it wait in their queue.
+class OutputScheduler
+{
+public:
+    enum Priority
+    {
+        CONTROL,            // Registration and task acknowledgements
+        HEALTH,             // Status reports
+        BULK,               // Detection reports
+        PRIORITIES
+    };
+
+    // Each queue holds up to its budget in bytes. Bulk frames are only moved to the socket while
+    // it has less than sendHighWater bytes waiting to go.
+    OutputScheduler( size_t controlBudget, size_t healthBudget, size_t bulkBudget, size_t sendHighWater );
+    ~OutputScheduler();
+
+    OutputQueue *Queue( Priority priority ) { return queues[priority]; }
+
+    // Sends queued frames to out in priority order. Frames the socket has no room for stay queued.
+    // Returns false if writing to out failed.
+    bool Flush( NetworkStream *out );
+
+    // True when frames are still queued after flushing
+    bool Pending() const;
+
+    // True while bulk frames are backing up, so more should not be queued
+    bool Congested() const;
+
+    // Discards everything queued, e.g. when the connection is lost. If keepBulk is given the bulk
+    // frames are written to it first, so detections are kept rather than lost with the connection.
+    // Returns the number of bulk frames kept.
+    unsigned long Clear( IOutputStream *keepBulk = NULL );
+
+private:
+    bool Move( OutputQueue *queue, NetworkStream *out, size_t *unsent );
+
+    OutputQueue *queues[PRIORITIES];
+    size_t sendHighWater;
+    bool heldBack;
+};
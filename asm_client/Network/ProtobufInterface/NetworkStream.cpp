@@ -27,9 +27,19 @@
 #define MSG_NOSIGNAL 0
 #endif
 
-NetworkStream::NetworkStream( std::string hostname, int port )
+// The high water mark is logged each time it doubles past this
+#define HIGH_WATER_REPORT_SIZE 16384
+
+NetworkStream::NetworkStream( std::string hostname, int port, size_t maxOutput ) :
+    output( WRITE_BUFFER_SIZE, maxOutput )
 {
-    writeBufferUsed = 0;
+    reportedHighWater = HIGH_WATER_REPORT_SIZE / 2;
+    warnedFull = false;
+    corked = false;
+    batching = false;
+    batchStart = 0.0;
+    batchMaxLatency = 0.0;
+    memset( &stats, 0, sizeof( stats ) );
     tcpclient = new TcpClient( hostname, port );
 }
 
@@ -44,6 +54,13 @@ bool NetworkStream::Open( int timeout )
     int connected;
     TcpClientErrno returnCode = tcpclient->Connect( timeout, &connected );
 
+    // Anything left unsent belonged to the previous connection
+    if (connected)
+    {
+        output.Clear();
+        corked = false;
+    }
+
     if (returnCode == TCPCLIENT_ERR_OPENING_SOCKET)
         LOG( WARNING ) << "Failed to open socket";
     if (returnCode == TCPCLIENT_ERR_SETTING_SOCKET_OPT)
@@ -61,6 +78,24 @@ bool NetworkStream::IsOpen()
     return (connected != 0);
 }
 
+int NetworkStream::GetFd()
+{
+    if (tcpclient == nullptr) return -1;
+
+    int fd;
+    tcpclient->Get_Socket( &fd );
+    return fd;
+}
+
+size_t NetworkStream::Unsent()
+{
+    if (tcpclient == nullptr) return 0;
+
+    int queued;
+    tcpclient->Get_Unsent( &queued );
+    return output.Size() + queued;
+}
+
 bool NetworkStream::Read( unsigned char *pOctets, size_t iOctets, size_t &iRead )
 {
     if (tcpclient == nullptr) return false;
@@ -99,28 +134,84 @@ bool NetworkStream::ReadWithTimeout( unsigned char *pOctets, size_t iOctets, siz
 
 bool NetworkStream::Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote )
 {
-    size_t toCopy = WRITE_BUFFER_SIZE - writeBufferUsed;
-    if (toCopy > iOctets) toCopy = iOctets;
-    memcpy( &writeBuffer[writeBufferUsed], pOctets, toCopy );
-    writeBufferUsed += (int)toCopy;
+    unsigned char *p = Reserve( iOctets );
+    if (p == NULL) return false;
 
-    // If the buffer is full, send and start again (recursively)
-    if (writeBufferUsed == WRITE_BUFFER_SIZE)
+    memcpy( p, pOctets, iOctets );
+    iWrote = iOctets;
+    return Commit( iOctets );
+}
+
+unsigned char *NetworkStream::Reserve( size_t iOctets )
+{
+    unsigned char *p = output.Reserve( iOctets );
+    if (p == NULL)
     {
-        if (Send( false ))
+        // Writers may keep retrying until the socket takes some, so only say so once
+        if (!warnedFull) LOG( WARNING ) << "Output buffer full with " << output.Size() << " bytes unsent";
+        warnedFull = true;
+    }
+    else
+    {
+        warnedFull = false;
+    }
+    return p;
+}
+
+bool NetworkStream::Commit( size_t iOctets )
+{
+    output.Produce( iOctets );
+
+    stats.queued = output.Size();
+    if (stats.queued > stats.highWater)
+    {
+        stats.highWater = stats.queued;
+        if (stats.highWater >= reportedHighWater * 2)
         {
-            return Write( &pOctets[toCopy], iOctets - toCopy, iWrote );
+            reportedHighWater = stats.highWater;
+            LOG( INFO ) << "Output buffer high water mark now " << stats.highWater << " bytes";
         }
-        return false;
     }
-    else
+    return Written();
+}
+
+// Decides whether newly buffered data should be sent now
+bool NetworkStream::Written()
+{
+    if (!batching)
+    {
+        return Send( false );
+    }
+    else if (output.Size() >= WRITE_BUFFER_SIZE)
     {
-        Send( false );
+        // Enough for a full sized send, so no point holding on to it
+        return SendBuffer( true );
+    }
+    else if (Get_Time_Monotonic() > batchStart + batchMaxLatency)
+    {
+        // Held for too long, so send what we have and start a new batch
+        batchStart = Get_Time_Monotonic();
+        return SendBuffer( false );
     }
 
     return true;
 }
 
+void NetworkStream::BeginBatch( double maxLatency )
+{
+    batching = true;
+    batchStart = Get_Time_Monotonic();
+    batchMaxLatency = maxLatency;
+    stats.lastFlushBytes = 0;
+    stats.lastFlushSends = 0;
+}
+
+bool NetworkStream::EndBatch()
+{
+    batching = false;
+    return SendBuffer( false );
+}
+
 bool NetworkStream::Send( bool bTerminator )
 {
     if (tcpclient == nullptr) return false;
@@ -132,8 +223,36 @@ bool NetworkStream::Send( bool bTerminator )
         Write( &terminator, 1, iWrote );
     }
 
-    TcpClientErrno returnCode = tcpclient->Write( writeBuffer, writeBufferUsed );
-    writeBufferUsed = 0;
+    return SendBuffer( false );
+}
+
+bool NetworkStream::Resume()
+{
+    if (output.Size() == 0) return true;
+
+    stats.resumes++;
+    return SendBuffer( false );
+}
+
+bool NetworkStream::SendDirect( const unsigned char *pOctets, size_t iOctets, size_t &sent )
+{
+    sent = 0;
+    if (tcpclient == nullptr) return false;
+
+    // Anything already in the ring has to go first
+    if (output.Size() > 0) return true;
+
+    int written;
+    int sends = 0;
+    TcpClientErrno returnCode = tcpclient->Write( pOctets, (int)iOctets, &written, batching, &sends );
+    if (written > 0) corked = batching;
+    sent = written;
+    if (returnCode == TCPCLIENT_ERR_NO_ERROR && sent < iOctets) stats.partialFlushes++;
+
+    stats.bytes += sent;
+    stats.sends += sends;
+    stats.lastFlushBytes += sent;
+    stats.lastFlushSends += sends;
 
     if (returnCode == TCPCLIENT_ERR_INVALID_STATE)
         LOG( WARNING ) << "NetworkStream not opened";
@@ -141,27 +260,75 @@ bool NetworkStream::Send( bool bTerminator )
         LOG( WARNING ) << "Not connected";
     if (returnCode == TCPCLIENT_ERR_CONNECTION_LOST)
         LOG( WARNING ) << "Connection lost";
-    if (returnCode == TCPCLIENT_ERR_WRITING_TO_SERVER)
-        LOG( WARNING ) << "Failed to write";
 
     return (returnCode == TCPCLIENT_ERR_NO_ERROR);
 }
 
-void NetworkStream::Close()
+bool NetworkStream::SendBuffer( bool more )
 {
-    if (tcpclient == nullptr) return;
+    if (tcpclient == nullptr) return false;
 
-    tcpclient->Disconnect();
-}
+    // A batch may take more than one flush if the buffer fills, so the last flush counters accumulate until the next batch
+    if (!batching)
+    {
+        stats.lastFlushBytes = 0;
+        stats.lastFlushSends = 0;
+    }
 
-void NetworkStream::Flush()
-{
-    // Flush all the bytes from the input stream and get it into a state where the first byte read is the start of a new message
-    // Used when we have mismatches in the input expected data stream possibly due to data corruption.
+    TcpClientErrno returnCode = TCPCLIENT_ERR_NO_ERROR;
+    int sends = 0;
+    size_t sent = 0;
+    while (output.Size() > 0)
+    {
+        // The ring may wrap, in which case the oldest bytes are sent in two parts
+        size_t length;
+        const uint8_t *p = output.ReadSpace( &length );
+        int written;
+        bool hold = more || length < output.Size();
+        returnCode = tcpclient->Write( p, (int)length, &written, hold, &sends );
+        if (written > 0) corked = hold;
+        output.Consume( written );
+        sent += written;
+        if (returnCode != TCPCLIENT_ERR_NO_ERROR) break;
+        if ((size_t)written < length)
+        {
+            // The socket is full, so the rest waits for Resume
+            stats.partialFlushes++;
+            break;
+        }
+    }
 
-    size_t read = 0;
-    unsigned char black_hole[256];
-    while( Read( black_hole, 256, read ) )
+    // An earlier flush in this batch may have sent everything with MSG_MORE, leaving the tail held back
+    // If the push fails the kernel still sends it, just later
+    if (!more && corked && output.Size() == 0 && returnCode == TCPCLIENT_ERR_NO_ERROR)
     {
+        tcpclient->Push();
+        corked = false;
     }
+
+    stats.flushes++;
+    stats.bytes += sent;
+    stats.sends += sends;
+    stats.lastFlushBytes += sent;
+    stats.lastFlushSends += sends;
+    stats.queued = output.Size();
+
+    if (returnCode == TCPCLIENT_ERR_INVALID_STATE)
+        LOG( WARNING ) << "NetworkStream not opened";
+    if (returnCode == TCPCLIENT_ERR_NOT_CONNECTED)
+        LOG( WARNING ) << "Not connected";
+    if (returnCode == TCPCLIENT_ERR_CONNECTION_LOST)
+        LOG( WARNING ) << "Connection lost";
+
+    return (returnCode == TCPCLIENT_ERR_NO_ERROR);
+}
+
+void NetworkStream::Close()
+{
+    if (tcpclient == nullptr) return;
+
+    tcpclient->Disconnect();
+    output.Clear();
+    corked = false;
+    stats.queued = 0;
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "Stream.h"
+#include "../../Utils/RingBuffer.h"
 
 #include <stddef.h>
 #include <string>
@@ -17,28 +18,78 @@
 #include <Windows.h>
 #endif
 
+// A batch is sent early once this much is waiting, and the output ring starts at this size
 #define WRITE_BUFFER_SIZE 8192
+#define DEFAULT_OUTPUT_BUFFER_SIZE (1024 * 1024)
 
 class TcpClient;
 
+// Counters for the batched output mode and the output ring
+struct NetworkStreamStats
+{
+    unsigned long flushes;          // Number of times a batch has been flushed
+    unsigned long bytes;            // Total bytes flushed
+    unsigned long sends;            // Total send calls made by flushes
+    size_t lastFlushBytes;          // Bytes sent by the most recent flush
+    int lastFlushSends;             // Send calls made by the most recent flush
+    unsigned long partialFlushes;   // Flushes that left bytes for the socket to take later
+    unsigned long resumes;          // Flushes of those bytes once the socket had room
+    size_t queued;                  // Bytes waiting in the output ring
+    size_t highWater;               // Most bytes that have waited in the output ring
+};
+
 class NetworkStream : public IInputStream, public IOutputStream
 {
 public:
-    NetworkStream( std::string hostname, int port );
+    NetworkStream( std::string hostname, int port, size_t maxOutput = DEFAULT_OUTPUT_BUFFER_SIZE );
     virtual ~NetworkStream();
     bool Open( int timeout );
     bool IsOpen();
-    void Flush();
+    int GetFd();
+
+    // Bytes written but not yet sent, whether still buffered here or queued by the socket
+    size_t Unsent();
+
+    // Bytes held here because the socket could not take them yet. Once it can, call Resume.
+    size_t Pending() { return output.Size(); }
+    bool Resume();
+
+    // Sends straight from the caller's buffer, saving the copy into the ring, if nothing is waiting
+    // in it. Sets sent to the bytes the socket took; the caller keeps the rest. Within a batch the
+    // bytes are held back for the rest of the batch. Returns false if the connection failed.
+    bool SendDirect( const unsigned char *pOctets, size_t iOctets, size_t &sent );
     virtual bool Read( unsigned char *pOctets, size_t iOctets, size_t &iRead );
     virtual bool ReadWithTimeout( unsigned char *pOctets, size_t iOctets, size_t &iRead, int millisecs );
     virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote );
     virtual bool Send( bool bTerminator );
     virtual void Close();
+    virtual unsigned char *Reserve( size_t iOctets );
+    virtual bool Commit( size_t iOctets );
+
+    // Collects everything written until EndBatch and sends it with as few send calls as possible
+    // Data is sent early if the buffer fills or it has been held for more than maxLatency seconds
+    void BeginBatch( double maxLatency );
+    bool EndBatch();
+    const NetworkStreamStats &GetStats() { return stats; }
 
 private:
+    bool SendBuffer( bool more );
+    bool Written();
+
     class TcpClient *tcpclient;
     std::string hostname;
 
-    unsigned char writeBuffer[WRITE_BUFFER_SIZE];
-    int writeBufferUsed;
+    // Frames are written whole into the ring and sent from it as fast as the socket takes them,
+    // so a partial send leaves the rest of a frame to follow rather than losing it
+    ByteRing output;
+    size_t reportedHighWater;
+    bool warnedFull;
+
+    // Set while the socket may be holding back bytes sent with MSG_MORE
+    bool corked;
+
+    bool batching;
+    double batchStart;
+    double batchMaxLatency;
+    NetworkStreamStats stats;
 };
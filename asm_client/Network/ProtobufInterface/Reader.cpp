@@ -6,11 +6,14 @@
 #include "Reader.h"
 
 #include <cstdlib>
+#include <cstring>
 
 #define ELPP_DEFAULT_LOGGER "network"
 #include "../../Utils/Log.h"
 
-#define READ_BUFFER_SIZE (1024 * 1024)
+// Frames are received into a ring that starts small and grows to fit the largest frame seen
+#define READ_BUFFER_INITIAL_SIZE 4096
+#define MAX_MESSAGE_SIZE (1024 * 1024)
 
 #include <google/protobuf/util/json_util.h>
 
@@ -18,109 +21,269 @@ namespace ProtobufInterface
 {
 
 
+static uint32_t GetLength( const ByteRing &ring, size_t offset )
+{
+    return (uint32_t)ring.At( offset ) +
+            (((uint32_t)ring.At( offset + 1 )) << 8) +
+            (((uint32_t)ring.At( offset + 2 )) << 16) +
+            (((uint32_t)ring.At( offset + 3 )) << 24);
+}
+
+
 Reader::Reader() :
     network_stream( nullptr ),
-    read_buffer( nullptr ),
-    short_timeout( 0 ),
-    long_timeout( 0 )
+    ring( READ_BUFFER_INITIAL_SIZE, 2 * MAX_MESSAGE_SIZE ),
+    resyncing( false ),
+    wantedContent( 0xFFFFFFFF ),
+    ignoredContent( 0 )
+{
+    memset( &stats, 0, sizeof( stats ) );
+}
+
+
+void Reader::SetFilter( const std::string &nodeID, uint32_t contentMask )
 {
+    filterNodeID = nodeID;
+    wantedContent = contentMask;
+    ignoredContent = 0;
 }
 
 
-bool Reader::GetMessage()
+static bool ReadVarint( const uint8_t *p, const uint8_t *end, const uint8_t **next, uint64_t *value )
 {
-    // Do once, make sure we have a buffer to read into
-    if( read_buffer == nullptr )
+    *value = 0;
+    for( int shift = 0; shift < 64 && p < end; shift += 7 )
     {
-        read_buffer = new uint8_t[ READ_BUFFER_SIZE ];
-        if( read_buffer == nullptr )
+        uint8_t byte = *p++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if( (byte & 0x80) == 0 )
         {
-            LOG( ERROR ) << "Reader failed to allocate buffer.";
-            return false;
+            *next = p;
+            return true;
         }
     }
+    return false;
+}
 
-    if( network_stream == nullptr )
-    {
-        LOG( ERROR ) << "Reader not attached to stream.";
-        return false;
-    }
 
-    // Protobuf can parse from a stream directly
-    // But Sapient uses a non standard 4 byte little endian length field at the beginning. See bsi-flex-335.pdf section 4.2
-    unsigned char msg_len_bytes[4];
-    size_t bytes_read = 0;
-    if( network_stream->Read( msg_len_bytes, 4, bytes_read ) == false )
+// Scans the top level fields of a frame's payload for its destination and content, without parsing it.
+// A payload that is not well formed is left for the full parse to reject.
+bool Reader::Wanted( const uint8_t *payload, uint32_t length )
+{
+    if( filterNodeID.empty() && wantedContent == 0xFFFFFFFF ) return true;
+
+    const uint8_t *p = payload;
+    const uint8_t *end = payload + length;
+    const uint8_t *destination = nullptr;
+    size_t destinationLength = 0;
+    int content = 0;
+
+    while( p < end )
     {
-        LOG( WARNING ) << "Reader connection failed.";
-        return false;
+        uint64_t tag, value;
+        if( !ReadVarint( p, end, &p, &tag ) ) break;
+
+        int field = (int)(tag >> 3);
+        switch( tag & 0x07 )
+        {
+            case 0:     // Varint
+                if( !ReadVarint( p, end, &p, &value ) ) p = end + 1;
+                break;
+            case 1:     // Fixed 64
+                p += 8;
+                break;
+            case 2:     // Length delimited, which all of SapientMessage's fields are
+                if( !ReadVarint( p, end, &p, &value ) || value > (uint64_t)(end - p) )
+                {
+                    p = end + 1;
+                    break;
+                }
+                if( field == sap::SapientMessage::kDestinationIdFieldNumber )
+                {
+                    destination = p;
+                    destinationLength = (size_t)value;
+                }
+                else if( field >= sap::SapientMessage::kRegistrationFieldNumber && field < 32 )
+                {
+                    content = field;
+                }
+                p += value;
+                break;
+            case 5:     // Fixed 32
+                p += 4;
+                break;
+            default:
+                p = end + 1;
+                break;
+        }
     }
+    if( p != end ) return true;
 
-    if( bytes_read == 0 )
+    // Without a destination the ID is empty, which is never ours
+    if( !filterNodeID.empty() &&
+        (destinationLength != filterNodeID.length() || memcmp( destination, filterNodeID.data(), destinationLength ) != 0) )
     {
-        // If uncommented then you would see a lot of these.
-        //LOG( WARNING ) << "Reader timed out waiting for message size.";
+        stats.otherNode++;
         return false;
     }
 
-    if( bytes_read != 4 )
+    if( content != 0 && (wantedContent & (1u << content)) == 0 )
     {
-        LOG( WARNING ) << "Reader read mismatch in number of message size bytes. Wanted 4, got " << bytes_read;
-        network_stream->Flush();
+        stats.unhandled++;
+        if( (ignoredContent & (1u << content)) == 0 )
+        {
+            // Only mention each kind once, as the peer may keep sending them
+            const google::protobuf::FieldDescriptor *fd = sap::SapientMessage::descriptor()->FindFieldByNumber( content );
+            LOG( INFO ) << "Ignoring received " << (fd != nullptr ? fd->name() : std::to_string( content )) << " messages";
+            ignoredContent |= 1u << content;
+        }
         return false;
     }
+    return true;
+}
 
-    uint32_t msg_len = (uint32_t)msg_len_bytes[0] +
-                        (((uint32_t)msg_len_bytes[1]) << 8) +
-                        (((uint32_t)msg_len_bytes[2]) << 16) +
-                        (((uint32_t)msg_len_bytes[3]) << 24);
 
-    //LOG( INFO ) << "Reader msg_len: " << msg_len;
+void Reader::Reset()
+{
+    ring.Clear();
+    resyncing = false;
+}
 
-    if( msg_len >= READ_BUFFER_SIZE )
-    {
-        LOG( WARNING ) << "Reader msg_len is too large. Skipping data.";
-        network_stream->Flush();
-        return false;
-    }
 
-    // Give it a short timeout to ensure all of the message has arrived
-    if( network_stream->ReadWithTimeout( read_buffer, msg_len, bytes_read, short_timeout ) == false )
+bool Reader::Receive()
+{
+    if( network_stream == nullptr )
     {
-        LOG( WARNING ) << "Reader connection failed.";
+        LOG( ERROR ) << "Reader not attached to stream.";
         return false;
     }
 
-    if( bytes_read == 0 )
+    // Read straight into the ring until the socket has nothing more to give
+    size_t space;
+    uint8_t *p;
+    while( (p = ring.WriteSpace( &space )) != nullptr )
     {
-        LOG( WARNING ) << "Reader timed out waiting for message data.";
-        return false;
+        size_t bytes_read = 0;
+        if( network_stream->Read( p, space, bytes_read ) == false )
+        {
+            LOG( WARNING ) << "Reader connection failed.";
+            return false;
+        }
+
+        ring.Produce( bytes_read );
+        if( bytes_read < space ) break;
     }
 
-    if( bytes_read != (size_t)msg_len )
+    return true;
+}
+
+
+// Checks whether the oldest bytes look like the start of a SAPIENT frame. Every SapientMessage
+// field is length delimited, so each top level field received so far must have one of their tags
+// and a length that fits in the frame. Checking the fields rather than just the frame length means
+// corrupt data that happens to start with a small length is rejected as soon as it arrives, instead
+// of holding back the frames behind it until msg_len bytes have.
+bool Reader::PlausibleHeader()
+{
+    uint32_t msg_len = GetLength( ring, 0 );
+    if( msg_len == 0 || msg_len > MAX_MESSAGE_SIZE ) return false;
+
+    size_t end = (size_t)msg_len + 4;
+    size_t received = ring.Size() < end ? ring.Size() : end;
+    size_t offset = 4;
+    while( offset < received )
     {
-        LOG( WARNING ) << "Reader read mismatch in number of message data bytes.";
-        return false;
+        uint8_t tag = ring.At( offset++ );
+        if( (tag & 0x07) != 2 || (tag >> 3) < 1 || (tag >> 3) > 13 ) return false;
+
+        // Any length within MAX_MESSAGE_SIZE fits in a three byte varint
+        uint32_t length = 0;
+        for( int shift = 0; ; shift += 7 )
+        {
+            if( shift > 14 ) return false;
+
+            // The rest can only be checked once it has arrived
+            if( offset >= received ) return true;
+
+            uint8_t byte = ring.At( offset++ );
+            length |= (uint32_t)(byte & 0x7F) << shift;
+            if( (byte & 0x80) == 0 ) break;
+        }
+        if( length > end - offset ) return false;
+        offset += length;
     }
+    return true;
+}
 
-    if( msg.ParseFromArray( read_buffer, msg_len ) )
+
+const sap::SapientMessage *Reader::GetMessage( google::protobuf::Arena *arena )
+{
+    // Protobuf can parse from a stream directly
+    // But Sapient uses a non standard 4 byte little endian length field at the beginning. See bsi-flex-335.pdf section 4.2
+    while( ring.Size() >= 4 )
     {
-        //LOG( INFO ) << "Reader has valid message.";
+        // After corrupt data skip a byte at a time until something looks like a frame,
+        // so that good frames queued behind the corruption are not lost
+        if( resyncing && !PlausibleHeader() )
+        {
+            ring.Consume( 1 );
+            continue;
+        }
+
+        uint32_t msg_len = GetLength( ring, 0 );
+        if( msg_len > MAX_MESSAGE_SIZE )
+        {
+            LOG( WARNING ) << "Reader msg_len is too large. Skipping data.";
+            resyncing = true;
+            ring.Consume( 1 );
+            continue;
+        }
+
+        // Wait for the rest of the frame
+        if( ring.Size() < (size_t)msg_len + 4 ) return nullptr;
+
+        const uint8_t *frame = ring.Peek( msg_len + 4 );
+
+        // Most frames on a shared link are for other nodes, so check that before parsing the whole message
+        if( !Wanted( frame + 4, msg_len ) )
+        {
+            ring.Consume( msg_len + 4 );
+            resyncing = false;
+            continue;
+        }
+
+        sap::SapientMessage *msg = google::protobuf::Arena::CreateMessage<sap::SapientMessage>( arena );
+        if( msg->ParseFromArray( frame + 4, msg_len ) )
+        {
+            ring.Consume( msg_len + 4 );
+            stats.decoded++;
+            if( resyncing )
+            {
+                LOG( INFO ) << "Reader found the start of a valid message.";
+                resyncing = false;
+            }
 
 #ifdef WANT_PROTOBUF_DEBUG_JSON
-        std::string json;
-        google::protobuf::util::MessageToJsonString( msg, &json );
-        LOG( INFO ) << json;
+            std::string json;
+            google::protobuf::util::MessageToJsonString( *msg, &json );
+            LOG( INFO ) << json;
 #endif
 
-        return true;
-    }
-    else
-    {
-        LOG( WARNING ) << "Reader failed to parse message data.";
-        network_stream->Flush();
-        return false;
+            return msg;
+        }
+
+        // On an arena the failed message is freed when the arena is reset
+        if( arena == nullptr ) delete msg;
+
+        if( !resyncing )
+        {
+            LOG( WARNING ) << "Reader failed to parse message data. Skipping data.";
+            resyncing = true;
+        }
+        ring.Consume( 1 );
     }
+
+    return nullptr;
 }
 
 };
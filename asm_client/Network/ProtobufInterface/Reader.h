@@ -6,7 +6,9 @@
 #pragma once
 
 #include "NetworkStream.h"
+#include "../../Utils/RingBuffer.h"
 #include <cstdint>
+#include <string>
 
 #include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
 namespace sap = sapient_msg::bsi_flex_335_v2_0;
@@ -15,30 +17,52 @@ namespace sap = sapient_msg::bsi_flex_335_v2_0;
 namespace ProtobufInterface
 {
 
+// Counts of the frames GetMessage has dealt with
+struct ReaderStats
+{
+    unsigned long decoded;          // Fully parsed and returned
+    unsigned long otherNode;        // Dropped because they were for another node
+    unsigned long unhandled;        // Dropped because their content is not wanted
+};
+
 class Reader
 {
     NetworkStream *network_stream;
-    uint8_t *read_buffer;
-    int short_timeout;
-    int long_timeout;
+    ByteRing ring;
+    bool resyncing;
 
-public:
-    sap::SapientMessage msg;
+    std::string filterNodeID;
+    uint32_t wantedContent;
+    uint32_t ignoredContent;
+    ReaderStats stats;
 
+public:
     Reader();
 
-    void setTimeouts( int short_to, int long_to )
-    {
-        short_timeout = short_to;
-        long_timeout = long_to;
-    }
-
     void Attach( NetworkStream *ns )
     {
         network_stream = ns;
     }
 
-    bool GetMessage();
+    // Discards any partly received data, e.g. after reconnecting
+    void Reset();
+
+    // Only frames addressed to nodeID whose content field number is set in the contentMask bits are
+    // fully parsed. The rest are dropped after a scan of their top level fields.
+    void SetFilter( const std::string &nodeID, uint32_t contentMask );
+
+    const ReaderStats &GetStats() { return stats; }
+
+    // Reads whatever bytes are available without waiting. Returns false if the connection failed.
+    bool Receive();
+
+    // Decodes the next complete frame already received into a message created on arena.
+    // Returns NULL when there are none left. Partial frames are kept until the rest arrives.
+    const sap::SapientMessage *GetMessage( google::protobuf::Arena *arena );
+
+private:
+    bool PlausibleHeader();
+    bool Wanted( const uint8_t *payload, uint32_t length );
 };
 
 };
@@ -17,4 +17,11 @@ struct IOutputStream
     virtual bool Write(unsigned char *pOctets, size_t iOctets, size_t &iWrote) = 0;
     virtual bool Send(bool bTerminator) = 0;
     virtual void Close() = 0;
+
+    // Optional zero-copy output: Reserve returns space for iOctets contiguous bytes
+    // (or NULL if the stream cannot provide it) and Commit then writes them
+    virtual unsigned char *Reserve(size_t iOctets) { return NULL; }
+    virtual bool Commit(size_t iOctets) { return false; }
+
+    virtual ~IOutputStream() {}
 };
@@ -5,11 +5,15 @@
 
 #include "Writer.h"
 
+#include <google/protobuf/message_lite.h>
+#include <stdint.h>
+
 namespace ProtobufInterface
 {
 
 Writer::Writer() :
-    _pStream(NULL)
+    _pStream(NULL),
+    _arena(NULL)
 {
 }
 
@@ -37,4 +41,34 @@ bool Writer::writeBytes( unsigned char* bytes, int len )
     return _pStream->Write( bytes, sz_len, wrote );
 }
 
+
+static void writeLength( unsigned char *p, uint32_t len )
+{
+    p[0] = len & 0xFF;
+    p[1] = (len >> 8) & 0xFF;
+    p[2] = (len >> 16) & 0xFF;
+    p[3] = (len >> 24) & 0xFF;
+}
+
+
+bool Writer::writeMessage( const google::protobuf::MessageLite &msg )
+{
+    // ByteSizeLong caches the sizes, so the serialization below need not compute them again
+    uint32_t len = (uint32_t)msg.ByteSizeLong();
+
+    unsigned char *p = _pStream->Reserve( len + 4 );
+    if (p != NULL)
+    {
+        writeLength( p, len );
+        msg.SerializeWithCachedSizesToArray( p + 4 );
+        return _pStream->Commit( len + 4 );
+    }
+
+    // The stream cannot take the whole frame at once, so build it in a reusable buffer
+    if (_scratch.size() < len + 4) _scratch.resize( len + 4 );
+    writeLength( &_scratch[0], len );
+    msg.SerializeWithCachedSizesToArray( &_scratch[4] );
+    return writeBytes( &_scratch[0], len + 4 );
+}
+
 };
@@ -7,17 +7,31 @@
 
 #include "Stream.h"
 
+#include <vector>
+
+namespace google { namespace protobuf { class MessageLite; class Arena; } }
+
 namespace ProtobufInterface
 {
 
 class Writer
 {
     IOutputStream *_pStream;
+    google::protobuf::Arena *_arena;
+    std::vector<unsigned char> _scratch;
 
 public:
     bool open(IOutputStream *);
     void close();
     bool writeBytes( unsigned char * bytes, int len );
+
+    // Writes msg as a SAPIENT frame: a 4 byte little-endian length followed by the payload.
+    // The frame is serialized directly into the stream's buffer when it has room.
+    bool writeMessage( const google::protobuf::MessageLite &msg );
+
+    // Arena that messages being written should be created on (may be NULL)
+    void setArena( google::protobuf::Arena *arena ) { _arena = arena; }
+    google::protobuf::Arena *arena() { return _arena; }
     Writer();
 };
 
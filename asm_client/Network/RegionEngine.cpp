@@ -0,0 +1,360 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "RegionEngine.h"
+#include "../Utils/Angles.h"
+
+#include <math.h>
+#include <string.h>
+
+// Near enough for the few hundred metres around a sensor
+#define METRES_PER_DEGREE 111319.49
+
+
+static unsigned RegionType( sap::Task::RegionType type )
+{
+    switch (type)
+    {
+        case sap::Task::REGION_TYPE_AREA_OF_INTEREST:       return RegionEngine::AREA_OF_INTEREST;
+        case sap::Task::REGION_TYPE_IGNORE:                 return RegionEngine::IGNORE;
+        case sap::Task::REGION_TYPE_BOUNDARY:               return RegionEngine::BOUNDARY;
+        case sap::Task::REGION_TYPE_MOBILE_NODE_NO_GO_AREA: return RegionEngine::NO_GO_AREA;
+        case sap::Task::REGION_TYPE_MOBILE_NODE_GO_AREA:    return RegionEngine::GO_AREA;
+        default:                                            return RegionEngine::UNSPECIFIED;
+    }
+}
+
+
+RegionEngine::RegionEngine()
+{
+    Clear();
+}
+
+
+void RegionEngine::Clear()
+{
+    shapes.clear();
+    vx.clear();
+    vy.clear();
+    cellShapes.clear();
+    types = 0;
+    gridX = gridY = 0.0f;
+    cellWidth = cellHeight = 1.0f;
+    memset( cellStart, 0, sizeof(cellStart) );
+}
+
+
+const char *RegionEngine::Compile( const sap::Task &msg_task, const RegionOrigin &origin )
+{
+    Clear();
+
+    for (int n = 0; n < msg_task.region_size(); n++)
+    {
+        const sap::Task_Region &rgn = msg_task.region( n );
+        const sap::LocationOrRangeBearing &area = rgn.region_area();
+        unsigned type = RegionType( rgn.type() );
+
+        const char *reason;
+        if (area.has_range_bearing())
+        {
+            reason = AddCone( type, area.range_bearing() );
+        }
+        else if (area.has_location_list())
+        {
+            reason = AddPolygon( type, area.location_list(), origin );
+        }
+        else
+        {
+            reason = "Invalid Region";
+        }
+
+        if (reason)
+        {
+            Clear();
+            return reason;
+        }
+        types |= type;
+    }
+
+    BuildGrid();
+    return NULL;
+}
+
+
+const char *RegionEngine::AddCone( unsigned type, const sap::RangeBearingCone &cone )
+{
+    double range = cone.range();
+    double bearing = cone.azimuth();
+    double extent = cone.horizontal_extent();
+
+    switch (cone.coordinate_system())
+    {
+        case sap::RANGE_BEARING_COORDINATE_SYSTEM_UNSPECIFIED:
+        case sap::RANGE_BEARING_COORDINATE_SYSTEM_DEGREES_M:
+            break;
+        case sap::RANGE_BEARING_COORDINATE_SYSTEM_RADIANS_M:
+            bearing *= 180.0 / M_PI;
+            extent *= 180.0 / M_PI;
+            break;
+        case sap::RANGE_BEARING_COORDINATE_SYSTEM_DEGREES_KM:
+            range *= 1000.0;
+            break;
+        case sap::RANGE_BEARING_COORDINATE_SYSTEM_RADIANS_KM:
+            range *= 1000.0;
+            bearing *= 180.0 / M_PI;
+            extent *= 180.0 / M_PI;
+            break;
+        default:
+            return "Not Supported";
+    }
+    if (range <= 0.0 || extent <= 0.0)
+    {
+        return "Invalid Region";
+    }
+
+    Shape shape;
+    shape.type = type;
+    shape.first = 0;
+    shape.count = 0;
+    shape.range = (float)range;
+    shape.bearing = WrapDegrees( (float)bearing );
+    shape.halfExtent = (float)(extent / 2.0);
+
+    // The box holds the apex, both edges' ends and wherever the arc crosses north, east, south or west
+    shape.minX = shape.minY = shape.maxX = shape.maxY = 0.0f;
+    float ends[2] = { shape.bearing - shape.halfExtent, shape.bearing + shape.halfExtent };
+    float cardinal[4] = { 0.0f, 90.0f, 180.0f, -90.0f };
+    float points[6];
+    int numPoints = 0;
+    if (shape.halfExtent < 180.0f)
+    {
+        points[numPoints++] = ends[0];
+        points[numPoints++] = ends[1];
+    }
+    for (int c = 0; c < 4; c++)
+    {
+        if (fabsf( DifferenceDegrees( cardinal[c], shape.bearing ) ) <= shape.halfExtent)
+            points[numPoints++] = cardinal[c];
+    }
+    for (int p = 0; p < numPoints; p++)
+    {
+        float x = shape.range * sinf( points[p] * (float)M_PI / 180.0f );
+        float y = shape.range * cosf( points[p] * (float)M_PI / 180.0f );
+        shape.minX = fminf( shape.minX, x );
+        shape.maxX = fmaxf( shape.maxX, x );
+        shape.minY = fminf( shape.minY, y );
+        shape.maxY = fmaxf( shape.maxY, y );
+    }
+
+    shapes.push_back( shape );
+    return NULL;
+}
+
+
+const char *RegionEngine::AddPolygon( unsigned type, const sap::LocationList &list, const RegionOrigin &origin )
+{
+    int num_locations = list.locations_size();
+    if (num_locations < 3)
+    {
+        return "Invalid Region";
+    }
+    // A location outside the range of latitude and longitude is a placeholder from the config, not a fix
+    if (!origin.valid || fabs( origin.latitude ) > 90.0 || fabs( origin.longitude ) > 180.0)
+    {
+        return "Location Unknown";
+    }
+
+    Shape shape;
+    shape.type = type;
+    shape.first = (uint32_t)vx.size();
+    shape.count = (uint32_t)num_locations;
+    shape.range = shape.bearing = shape.halfExtent = 0.0f;
+    shape.minX = shape.minY = INFINITY;
+    shape.maxX = shape.maxY = -INFINITY;
+
+    double metresPerDegreeEast = METRES_PER_DEGREE * cos( origin.latitude * M_PI / 180.0 );
+    for (int n = 0; n < num_locations; n++)
+    {
+        const sap::Location &loc = list.locations( n );
+        double longitude = loc.x();
+        double latitude = loc.y();
+
+        switch (loc.coordinate_system())
+        {
+            case sap::LOCATION_COORDINATE_SYSTEM_LAT_LNG_DEG_M:
+                break;
+            case sap::LOCATION_COORDINATE_SYSTEM_LAT_LNG_RAD_M:
+                longitude *= 180.0 / M_PI;
+                latitude *= 180.0 / M_PI;
+                break;
+            default:
+                // The sensor only knows its location as latitude and longitude
+                vx.resize( shape.first );
+                vy.resize( shape.first );
+                return "Not Supported";
+        }
+
+        double east = remainder( longitude - origin.longitude, 360.0 ) * metresPerDegreeEast;
+        double north = (latitude - origin.latitude) * METRES_PER_DEGREE;
+
+        vx.push_back( (float)east );
+        vy.push_back( (float)north );
+        shape.minX = fminf( shape.minX, (float)east );
+        shape.maxX = fmaxf( shape.maxX, (float)east );
+        shape.minY = fminf( shape.minY, (float)north );
+        shape.maxY = fmaxf( shape.maxY, (float)north );
+    }
+
+    shapes.push_back( shape );
+    return NULL;
+}
+
+
+bool RegionEngine::GetCone( size_t n, unsigned types, SensorTaskRangeBearingCone &cone ) const
+{
+    const Shape &shape = shapes[n];
+    if (shape.count != 0 || (shape.type & types) == 0)
+    {
+        return false;
+    }
+
+    cone.present = true;
+    cone.range = shape.range;
+    cone.azimuth = shape.bearing;
+    cone.horizontalExtent = shape.halfExtent * 2.0f;
+    return true;
+}
+
+
+void RegionEngine::BuildGrid()
+{
+    if (shapes.empty())
+    {
+        return;
+    }
+
+    float minX = shapes[0].minX, minY = shapes[0].minY;
+    float maxX = shapes[0].maxX, maxY = shapes[0].maxY;
+    for (size_t s = 1; s < shapes.size(); s++)
+    {
+        minX = fminf( minX, shapes[s].minX );
+        minY = fminf( minY, shapes[s].minY );
+        maxX = fmaxf( maxX, shapes[s].maxX );
+        maxY = fmaxf( maxY, shapes[s].maxY );
+    }
+    gridX = minX;
+    gridY = minY;
+    cellWidth = fmaxf( (maxX - minX) / GRID_SIZE, 0.001f );
+    cellHeight = fmaxf( (maxY - minY) / GRID_SIZE, 0.001f );
+
+    // Count the regions in each cell, then place them after the cells before
+    uint32_t fill[GRID_SIZE * GRID_SIZE];
+    memset( fill, 0, sizeof(fill) );
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t s = 0; s < shapes.size(); s++)
+        {
+            const Shape &shape = shapes[s];
+            int x0 = (int)((shape.minX - gridX) / cellWidth);
+            int x1 = (int)((shape.maxX - gridX) / cellWidth);
+            int y0 = (int)((shape.minY - gridY) / cellHeight);
+            int y1 = (int)((shape.maxY - gridY) / cellHeight);
+            if (x1 >= GRID_SIZE) x1 = GRID_SIZE - 1;
+            if (y1 >= GRID_SIZE) y1 = GRID_SIZE - 1;
+
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    int cell = y * GRID_SIZE + x;
+                    if (pass == 0)
+                        cellStart[cell + 1]++;
+                    else
+                        cellShapes[cellStart[cell] + fill[cell]++] = (uint32_t)s;
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; cell++)
+                cellStart[cell + 1] += cellStart[cell];
+            cellShapes.resize( cellStart[GRID_SIZE * GRID_SIZE] );
+        }
+    }
+}
+
+
+bool RegionEngine::Contains( const Shape &shape, float x, float y, float range, float bearing ) const
+{
+    if (shape.count == 0)
+    {
+        return range <= shape.range && fabsf( DifferenceDegrees( bearing, shape.bearing ) ) <= shape.halfExtent;
+    }
+
+    // Count the edges crossed by a line east from the point
+    const float *px = &vx[shape.first];
+    const float *py = &vy[shape.first];
+    bool inside = false;
+    for (uint32_t i = 0, j = shape.count - 1; i < shape.count; j = i++)
+    {
+        if ((py[i] > y) != (py[j] > y) &&
+            x < (px[j] - px[i]) * (y - py[i]) / (py[j] - py[i]) + px[i])
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+
+unsigned RegionEngine::Classify( float range, float bearing ) const
+{
+    if (shapes.empty())
+    {
+        return 0;
+    }
+
+    float x = range * sinf( bearing * (float)M_PI / 180.0f );
+    float y = range * cosf( bearing * (float)M_PI / 180.0f );
+
+    float gx = (x - gridX) / cellWidth;
+    float gy = (y - gridY) / cellHeight;
+    if (gx < 0.0f || gy < 0.0f || gx > GRID_SIZE || gy > GRID_SIZE)
+    {
+        return 0;
+    }
+    int cx = gx < GRID_SIZE ? (int)gx : GRID_SIZE - 1;
+    int cy = gy < GRID_SIZE ? (int)gy : GRID_SIZE - 1;
+    int cell = cy * GRID_SIZE + cx;
+
+    unsigned inside = 0;
+    for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+    {
+        const Shape &shape = shapes[cellShapes[i]];
+        if ((inside & shape.type) != 0) continue;
+        if (x < shape.minX || x > shape.maxX || y < shape.minY || y > shape.maxY) continue;
+        if (Contains( shape, x, y, range, bearing ))
+        {
+            inside |= shape.type;
+        }
+    }
+    return inside;
+}
+
+
+bool RegionEngine::Admits( float range, float bearing ) const
+{
+    if (shapes.empty())
+    {
+        return true;
+    }
+
+    unsigned inside = Classify( range, bearing );
+    if (inside & IGNORE) return false;
+    if ((types & AREA_OF_INTEREST) && !(inside & AREA_OF_INTEREST)) return false;
+    if ((types & BOUNDARY) && !(inside & BOUNDARY)) return false;
+    return true;
+}
@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "SensorTask.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
+namespace sap = sapient_msg::bsi_flex_335_v2_0;
+
+// The sensor's own location, which polygon regions are measured from
+struct RegionOrigin
+{
+    bool valid;
+    double latitude;    // Degrees
+    double longitude;
+};
+
+// The regions of a task compiled for finding which of them contain a detection.
+// Every region, range/bearing cone or polygon, is converted to metres east and north of
+// the sensor with its bounding box. A uniform grid over the boxes lists in each cell the
+// regions whose box overlaps it, so a lookup only tests the few regions listed in the
+// detection's cell however many the task has. Compiling reuses the storage of the last
+// compile, so it only allocates when a task has more regions or vertices than before.
+class RegionEngine
+{
+public:
+    // Bits for each type of region, as returned by Classify
+    enum Type
+    {
+        UNSPECIFIED      = 1 << 0,
+        AREA_OF_INTEREST = 1 << 1,
+        IGNORE           = 1 << 2,
+        BOUNDARY         = 1 << 3,
+        NO_GO_AREA       = 1 << 4,
+        GO_AREA          = 1 << 5,
+    };
+
+    RegionEngine();
+
+    void Clear();
+
+    // Compiles every region of the task, replacing those compiled before.
+    // Returns the reason the task's regions cannot be used, or NULL.
+    const char *Compile( const sap::Task &msg_task, const RegionOrigin &origin );
+
+    bool Empty() const { return shapes.empty(); }
+    size_t Count() const { return shapes.size(); }
+
+    // Fills cone, in metres and degrees, if region n is a range/bearing cone of one of the Type bits in types
+    bool GetCone( size_t n, unsigned types, SensorTaskRangeBearingCone &cone ) const;
+
+    // Returns the Type bits of the regions containing the point at this range and bearing from the sensor
+    unsigned Classify( float range, float bearing ) const;
+
+    // Whether a detection at this range and bearing should be reported: not within an
+    // ignore region, and within an area of interest and a boundary if the task has any.
+    // Go and no go areas are for mobile nodes, so do not filter detections.
+    bool Admits( float range, float bearing ) const;
+
+private:
+    struct Shape
+    {
+        unsigned type;
+        float minX, minY, maxX, maxY;
+
+        // Vertices [first, first + count) of vx and vy for a polygon; count is 0 for a cone
+        uint32_t first;
+        uint32_t count;
+
+        // Cone, in metres and degrees
+        float range;
+        float bearing;
+        float halfExtent;
+    };
+
+    const char *AddCone( unsigned type, const sap::RangeBearingCone &cone );
+    const char *AddPolygon( unsigned type, const sap::LocationList &list, const RegionOrigin &origin );
+    void BuildGrid();
+    bool Contains( const Shape &shape, float x, float y, float range, float bearing ) const;
+
+    enum { GRID_SIZE = 16 };
+
+    std::vector<Shape> shapes;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    unsigned types;
+
+    float gridX, gridY;
+    float cellWidth, cellHeight;
+    // The regions in cell n are cellShapes[cellStart[n]] to cellShapes[cellStart[n + 1] - 1]
+    uint32_t cellStart[GRID_SIZE * GRID_SIZE + 1];
+    std::vector<uint32_t> cellShapes;
+};
@@ -13,21 +13,19 @@
 namespace sap = sapient_msg::bsi_flex_335_v2_0;
 #define SAP_ICD_VERSION "BSI Flex 335 v2.0"
 
-#include <google/protobuf/util/time_util.h>
 #include <google/protobuf/util/json_util.h>
 
 
 static bool SetTimestamp( google::protobuf::Timestamp* timestamp, SensorRegistrationData* data )
 {
-    google::protobuf::Timestamp ts;
-    if( !google::protobuf::util::TimeUtil::FromString( data->timestamp, &ts ) )
+    if( data->timestamp <= 0 )
     {
-        LOG( ERROR ) << "Registration failed to convert timestamp.";
+        LOG( ERROR ) << "Registration has no timestamp.";
         return false;
     }
 
-    timestamp->set_seconds( ts.seconds() );
-    timestamp->set_nanos(0);
+    timestamp->set_seconds( data->timestamp / 1000000000 );
+    timestamp->set_nanos( (int32_t)(data->timestamp % 1000000000) );
     return true;
 }
 
@@ -387,55 +385,35 @@ static bool SetRegistration( sap::Registration* reg, SensorRegistrationData* dat
 
 bool SensorRegistration::Write( ProtobufInterface::Writer *w )
 {
-    sap::SapientMessage msg;
+    ArenaMessage<sap::SapientMessage> msg( w->arena() );
 
-    if( !SetTimestamp( msg.mutable_timestamp(), data ) )
+    if( !SetTimestamp( msg->mutable_timestamp(), data ) )
     {
         return false;
     }
 
-    msg.set_node_id( data->nodeID );
-    //msg.set_destination_id( data->destID );
+    msg->set_node_id( data->nodeID );
+    //msg->set_destination_id( data->destID );
 
-    if( !SetRegistration( msg.mutable_registration(), data ) )
+    if( !SetRegistration( msg->mutable_registration(), data ) )
     {
         LOG( ERROR ) << "Registration message was not set up.";
         return false;
     }
 
-    if( msg.IsInitialized() )
+    if( msg->IsInitialized() )
     {
         LOG( INFO ) << "Registration message initialized correctly.";
 
 #ifdef WANT_PROTOBUF_DEBUG_JSON
         std::string json;
-        google::protobuf::util::MessageToJsonString( msg, &json );
+        google::protobuf::util::MessageToJsonString( *msg, &json );
         LOG( INFO ) << json;
 #endif
 
-        uint32_t len = msg.ByteSizeLong();
-        uint8_t *p_bytes = new uint8_t[ len + 4 ];
-        if( p_bytes != nullptr )
+        if( !w->writeMessage( *msg ) )
         {
-            uint8_t *p = p_bytes;
-            *p++ = len & 0xFF;
-            *p++ = (len >> 8) & 0xFF;
-            *p++ = (len >> 16) & 0xFF;
-            *p++ = (len >> 24) & 0xFF;
-
-            if( msg.SerializeToArray( p_bytes + 4, len ) )
-            {
-                w->writeBytes( p_bytes, len + 4 );
-            }
-            else
-            {
-                LOG( ERROR ) << "Registration failed to serialize.";
-                return false;
-            }
-        }
-        else
-        {
-            LOG( ERROR ) << "Registration failed to allocate serialize buffer.";
+            LOG( ERROR ) << "Registration failed to serialize.";
             return false;
         }
     }
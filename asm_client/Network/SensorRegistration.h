@@ -15,7 +15,7 @@ struct SensorRegistrationData
     // Most of the sensor registration message is currently fixed in SensorRegistration.cpp
     // If parameters need to be changed they can be added here and in the configuration file
 
-    std::string timestamp;
+    int64_t     timestamp; // UTC nanoseconds since the epoch
     std::string nodeID;
     std::string sensorType;
     std::string heartbeatInterval;
@@ -4,201 +4,136 @@
 //
 
 #include "SensorTask.h"
-#include "ProtobufInterface/Writer.h"
 
 #include <string.h>
 
-#include <google/protobuf/util/time_util.h>
 
-
-static void ReadRangeBearingCone( sap::RangeBearingCone& msg_range_bearing, SensorTaskRangeBearingCone *rangeBearingCone )
+static void ReadRangeBearingCone( const sap::RangeBearingCone& msg_range_bearing, SensorTaskRangeBearingCone *rangeBearingCone )
 {
-    rangeBearingCone->r  = std::to_string( msg_range_bearing.range() );
-    rangeBearingCone->az = std::to_string( msg_range_bearing.azimuth() );
-    rangeBearingCone->he = std::to_string( msg_range_bearing.horizontal_extent() );
+    rangeBearingCone->present          = true;
+    rangeBearingCone->range            = msg_range_bearing.range();
+    rangeBearingCone->azimuth          = msg_range_bearing.azimuth();
+    rangeBearingCone->horizontalExtent = msg_range_bearing.horizontal_extent();
 }
 
 
-static void ReadClassFilter( sap::Task::ClassFilter& cf, SensorTaskClassFilter *classFilter )
+static int64_t ReadTimestamp( const google::protobuf::Timestamp& ts )
 {
-    // Were not using the filters but if you wanted to then the deocde would go here
+    return (int64_t)ts.seconds() * 1000000000 + ts.nanos();
 }
 
 
-static void ReadBehaviourFilter( sap::Task::BehaviourFilter& bf, SensorTaskBehaviourFilter *behaviourFilter )
+static SensorTaskCommand::Threshold ReadThreshold( sap::Task::DiscreteThreshold threshold )
 {
-    // Were not using the filters but if you wanted to then the deocde would go here
-}
-
-
-static void ReadRegion( sap::Task& msg_task, SensorTaskRegion *region )
-{
-    // The SensorTaskRegion has only one space but the msg_task.region is an array of them.
-    // So pick off the first one if it exists.
-
-    int num_regions = msg_task.region_size();
-    if( num_regions <= 0 )
+    switch( threshold )
     {
-        return;
+        case sap::Task::DISCRETE_THRESHOLD_LOW:    return SensorTaskCommand::THRESHOLD_LOW;
+        case sap::Task::DISCRETE_THRESHOLD_MEDIUM: return SensorTaskCommand::THRESHOLD_MEDIUM;
+        case sap::Task::DISCRETE_THRESHOLD_HIGH:   return SensorTaskCommand::THRESHOLD_HIGH;
+        default:                                   return SensorTaskCommand::THRESHOLD_UNSPECIFIED;
     }
+}
 
-    sap::Task_Region rgn = msg_task.region(0);
 
-    switch( rgn.type() )
+static void ReadCommand( const sap::Task_Command& msg_cmd, SensorTaskCommand* command )
+{
+    switch( msg_cmd.command_case() )
     {
-        case sap::Task::REGION_TYPE_AREA_OF_INTEREST:
-            region->type = "Area of interest";
-            break;
-
-        case sap::Task::REGION_TYPE_IGNORE:
-            region->type = "Ignore";
+        case sap::Task_Command::kRequest:
+        {
+            const std::string &request = msg_cmd.request();
+            command->type = SensorTaskCommand::REQUEST;
+            if( request == "Start" ) command->request = SensorTaskCommand::REQUEST_START;
+            else if( request == "Stop" ) command->request = SensorTaskCommand::REQUEST_STOP;
+            else command->request = SensorTaskCommand::REQUEST_OTHER;
             break;
+        }
 
-        case sap::Task::REGION_TYPE_BOUNDARY:
-            region->type = "Boundary";
+        case sap::Task_Command::kDetectionThreshold:
+            command->type = SensorTaskCommand::DETECTION_THRESHOLD;
+            command->threshold = ReadThreshold( msg_cmd.detection_threshold() );
             break;
 
-        case sap::Task::REGION_TYPE_MOBILE_NODE_NO_GO_AREA:
-            region->type = "No Go Area";
+        case sap::Task_Command::kDetectionReportRate:
+            command->type = SensorTaskCommand::DETECTION_REPORT_RATE;
+            command->threshold = ReadThreshold( msg_cmd.detection_report_rate() );
             break;
 
-        case sap::Task::REGION_TYPE_MOBILE_NODE_GO_AREA:
-            region->type = "Go Area";
+        case sap::Task_Command::kClassificationThreshold:
+            command->type = SensorTaskCommand::CLASSIFICATION_THRESHOLD;
+            command->threshold = ReadThreshold( msg_cmd.classification_threshold() );
             break;
 
-        case sap::Task::REGION_TYPE_UNSPECIFIED:
-        default:
-            region->type = "Unspecified";
+        case sap::Task_Command::kModeChange:
+            command->type = SensorTaskCommand::MODE_CHANGE;
             break;
-    }
-
-    region->regionID   = rgn.region_id();
-    region->regionName = rgn.region_name();
-
-    sap::LocationOrRangeBearing region_area = rgn.region_area();
-    if( region_area.has_range_bearing() )
-    {
-        sap::RangeBearingCone msg_range_bearing = region_area.range_bearing();
-        ReadRangeBearingCone( msg_range_bearing, &region->rangeBearingCone );
-    }
-
-    int num_class_filters = rgn.class_filter_size();
-    for( int c=0; c<num_class_filters; c++ )
-    {
-        sap::Task::ClassFilter cf = rgn.class_filter(c);
-        if( cf.type() == "All" )
-        {
-            ReadClassFilter( cf, &region->classFilterAll );
-        }
-        else if( cf.type() == "Human" )
-        {
-            ReadClassFilter( cf, &region->classFilterHuman );
-        }
-        else if( cf.type() == "Vehicle" )
-        {
-            ReadClassFilter( cf, &region->classFilterVehicle );
-        }
-    }
 
-    int num_beh_filters = rgn.behaviour_filter_size();
-    for( int b=0; b<num_beh_filters; b++ )
-    {
-        sap::Task::BehaviourFilter bf = rgn.behaviour_filter(b);
-        if( bf.type() == "Walking" )
-        {
-            ReadBehaviourFilter( bf, &region->behaviourFilterWalking );
-        }
-        else if( bf.type() == "Running" )
-        {
-            ReadBehaviourFilter( bf, &region->behaviourFilterRunning );
-        }
-        else if( bf.type() == "Loitering" )
-        {
-            ReadBehaviourFilter( bf, &region->behaviourFilterLoitering );
-        }
-        else if( bf.type() == "Crawling" )
+        case sap::Task_Command::kLookAt:
         {
-            ReadBehaviourFilter( bf, &region->behaviourFilterCrawling );
+            const sap::LocationOrRangeBearing& look_at = msg_cmd.look_at();
+            if( look_at.has_range_bearing() )
+            {
+                command->type = SensorTaskCommand::LOOK_AT;
+                ReadRangeBearingCone( look_at.range_bearing(), &command->rangeBearingCone );
+            }
+            else
+            {
+                command->type = SensorTaskCommand::UNSUPPORTED;
+            }
+            break;
         }
-    }
-}
 
+        case sap::Task_Command::COMMAND_NOT_SET:
+            break;
 
-static void ReadCommand( sap::Task_Command& msg_cmd, SensorTaskCommand* command )
-{
-    if( msg_cmd.has_request() )
-    {
-        command->request = msg_cmd.request();
-    }
-    else if( msg_cmd.has_detection_threshold() )
-    {
-        command->detectionThreshold = msg_cmd.detection_threshold();
-    }
-    else if( msg_cmd.has_detection_report_rate() )
-    {
-        command->detectionReportRate = msg_cmd.detection_report_rate();
-    }
-    else if( msg_cmd.has_classification_threshold() )
-    {
-        command->classificationThreshold = msg_cmd.classification_threshold();
-    }
-    else if( msg_cmd.has_mode_change() )
-    {
-        command->mode = msg_cmd.mode_change();
-    }
-    else if( msg_cmd.has_look_at() )
-    {
-        sap::LocationOrRangeBearing look_at = msg_cmd.look_at();
-        if( look_at.has_range_bearing() )
-        {
-            sap::RangeBearingCone msg_look_at = look_at.range_bearing();
-            ReadRangeBearingCone( msg_look_at, &command->rangeBearingCone );
-        }
+        // Not doing: move_to, patrol, follow nor the command_parameter
+        default:
+            command->type = SensorTaskCommand::UNSUPPORTED;
+            break;
     }
-    // Not doing: move_to, patrol, follow nor the command_parameter
 }
 
 
-SensorTask::SensorTask( sap::Task& msg_task )
+SensorTask::SensorTask( const sap::Task& msg_task )
 {
-    data = new SensorTaskData();
+    memset( &data.command.rangeBearingCone, 0, sizeof(data.command.rangeBearingCone) );
+    data.command.type = SensorTaskCommand::NONE;
+    data.command.request = SensorTaskCommand::REQUEST_OTHER;
+    data.command.threshold = SensorTaskCommand::THRESHOLD_UNSPECIFIED;
 
-    std::string tid = msg_task.task_id();
+    const std::string& tid = msg_task.task_id();
     if( tid.length() == 26 )    // ULID length
     {
-        ulid::UnmarshalFrom( tid.c_str(), data->taskID );
+        ulid::UnmarshalFrom( tid.c_str(), data.taskID );
     }
     // else it will leave it as '0' from the ULID default constructor
 
-    data->taskName        = msg_task.task_name();
-    data->taskDescription = msg_task.task_description();
-    data->taskStartTime   = google::protobuf::util::TimeUtil::ToString( msg_task.task_start_time() );
-    data->taskEndTime     = google::protobuf::util::TimeUtil::ToString( msg_task.task_end_time() );
+    data.taskStartTime = msg_task.has_task_start_time() ? ReadTimestamp( msg_task.task_start_time() ) : 0;
+    data.taskEndTime   = msg_task.has_task_end_time() ? ReadTimestamp( msg_task.task_end_time() ) : 0;
 
-    sap::Task::Control control = msg_task.control();
-    switch( control )
+    switch( msg_task.control() )
     {
         case sap::Task::CONTROL_START:
-            data->control = "Start";
+            data.control = SensorTaskData::START;
             break;
         case sap::Task::CONTROL_STOP:
-            data->control = "Stop";
+            data.control = SensorTaskData::STOP;
             break;
         case sap::Task::CONTROL_PAUSE:
-            data->control = "Pause";
+            data.control = SensorTaskData::PAUSE;
             break;
 
         case sap::Task::CONTROL_UNSPECIFIED:
         default:
-            data->control = "Unspecified";
+            data.control = SensorTaskData::UNSPECIFIED;
             break;
     }
 
-    ReadRegion( msg_task, &data->region );
+    // The regions are compiled from the message by RegionEngine
+    data.regions = msg_task.region_size();
 
     if( msg_task.has_command() )
     {
-        sap::Task_Command msg_cmd = msg_task.command();
-        ReadCommand( msg_cmd, &data->command );
+        ReadCommand( msg_task.command(), &data.command );
     }
 }
@@ -8,79 +8,45 @@
 #include "ProtobufInterface/Reader.h"
 #include "../Utils/Ulid.h"
 
-#include <string>
+#include <stdint.h>
 
 struct SensorTaskRangeBearingCone
 {
-    std::string r;
-    std::string az;
-    std::string he;
-};
-
-struct SensorTaskClassFilter
-{
-    std::string name;
-    std::string op;
-    std::string value;
-};
-
-struct SensorTaskBehaviourFilter
-{
-    std::string name;
-    std::string op;
-    std::string value;
-};
-
-struct SensorTaskRegion
-{
-    std::string type;
-    std::string regionID;
-    std::string regionName;
-
-    SensorTaskRangeBearingCone rangeBearingCone;
-
-    SensorTaskClassFilter classFilterAll;
-    SensorTaskClassFilter classFilterHuman;
-    SensorTaskClassFilter classFilterVehicle;
-    SensorTaskBehaviourFilter behaviourFilterWalking;
-    SensorTaskBehaviourFilter behaviourFilterRunning;
-    SensorTaskBehaviourFilter behaviourFilterLoitering;
-    SensorTaskBehaviourFilter behaviourFilterCrawling;
+    bool present;
+    float range;
+    float azimuth;
+    float horizontalExtent;
 };
 
 struct SensorTaskCommand
 {
-    std::string request;
-    std::string detectionThreshold;
-    std::string detectionReportRate;
-    std::string classificationThreshold;
-    std::string mode;
+    enum Type { NONE, REQUEST, DETECTION_THRESHOLD, DETECTION_REPORT_RATE, CLASSIFICATION_THRESHOLD, MODE_CHANGE, LOOK_AT, UNSUPPORTED } type;
+    enum Request { REQUEST_OTHER, REQUEST_START, REQUEST_STOP } request;
+    enum Threshold { THRESHOLD_UNSPECIFIED, THRESHOLD_LOW, THRESHOLD_MEDIUM, THRESHOLD_HIGH } threshold;
 
+    // Set for LOOK_AT
     SensorTaskRangeBearingCone rangeBearingCone;
 };
 
 struct SensorTaskData
 {
-    ulid::ULID  taskID;
-    std::string taskName;
-    std::string taskDescription;
-    std::string taskStartTime;
-    std::string taskEndTime;
-    std::string control;
+    ulid::ULID taskID;
+    int64_t taskStartTime;  // Nanoseconds since the epoch, 0 if not given
+    int64_t taskEndTime;
+    enum Control { UNSPECIFIED, START, STOP, PAUSE } control;
 
-    SensorTaskRegion region;
+    int regions;
     SensorTaskCommand command;
 };
 
 class SensorTask
 {
 public:
-    // Constructs SensorTask message read from the reader
-    SensorTask( sap::Task& msg_task );
+    // Decodes the task straight from the message into numbers and enums, without allocating
+    SensorTask( const sap::Task& msg_task );
 
-    // Gets a copy of the SensorTaskData
-    virtual SensorTaskData GetSensorTaskData() { return *data; }
+    const SensorTaskData &GetSensorTaskData() const { return data; }
 
 private:
-    SensorTaskData *data;
+    SensorTaskData data;
 };
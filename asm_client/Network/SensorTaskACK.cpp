@@ -12,21 +12,19 @@
 #include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
 namespace sap = sapient_msg::bsi_flex_335_v2_0;
 
-#include <google/protobuf/util/time_util.h>
 #include <google/protobuf/util/json_util.h>
 
 
 static bool SetTimestamp( google::protobuf::Timestamp* timestamp, SensorTaskACKData* data )
 {
-    google::protobuf::Timestamp ts;
-    if( !google::protobuf::util::TimeUtil::FromString( data->timestamp, &ts ) )
+    if( data->timestamp <= 0 )
     {
-        LOG( ERROR ) << "SensorTaskAck failed to convert timestamp.";
+        LOG( ERROR ) << "SensorTaskAck has no timestamp.";
         return false;
     }
 
-    timestamp->set_seconds( ts.seconds() );
-    timestamp->set_nanos(0);
+    timestamp->set_seconds( data->timestamp / 1000000000 );
+    timestamp->set_nanos( (int32_t)(data->timestamp % 1000000000) );
     return true;
 }
 
@@ -40,8 +38,9 @@ static bool SetSensorTaskAck( sap::TaskAck* ta, SensorTaskACKData* data )
     }
     else
     {
-        std::string str_task_id = ulid::Marshal( data->taskID );
-        ta->set_task_id( str_task_id );
+        char str_task_id[26];
+        ulid::MarshalTo( data->taskID, str_task_id );
+        ta->set_task_id( str_task_id, sizeof( str_task_id ) );
     }
 
     if( data->status == "Accepted" )
@@ -68,51 +67,32 @@ static bool SetSensorTaskAck( sap::TaskAck* ta, SensorTaskACKData* data )
 
 bool SensorTaskACK::Write( ProtobufInterface::Writer *w )
 {
-    sap::SapientMessage msg;
+    ArenaMessage<sap::SapientMessage> msg( w->arena() );
 
-    if( !SetTimestamp( msg.mutable_timestamp(), data ) )
+    if( !SetTimestamp( msg->mutable_timestamp(), data ) )
     {
         return false;
     }
 
-    msg.set_node_id( data->nodeID );
-    msg.set_destination_id( data->destID );
+    msg->set_node_id( data->nodeID );
+    msg->set_destination_id( data->destID );
 
-    if( !SetSensorTaskAck( msg.mutable_task_ack(), data ) )
+    if( !SetSensorTaskAck( msg->mutable_task_ack(), data ) )
     {
         return false;
     }
 
-    if( msg.IsInitialized() )
+    if( msg->IsInitialized() )
     {
 #ifdef WANT_PROTOBUF_DEBUG_JSON
         std::string json;
-        google::protobuf::util::MessageToJsonString( msg, &json );
+        google::protobuf::util::MessageToJsonString( *msg, &json );
         LOG( INFO ) << json;
 #endif
 
-        uint32_t len = msg.ByteSizeLong();
-        uint8_t *p_bytes = new uint8_t[ len + 4 ];
-        if( p_bytes != nullptr )
+        if( !w->writeMessage( *msg ) )
         {
-            uint8_t *p = p_bytes;
-            *p++ = len & 0xFF;
-            *p++ = (len >> 8) & 0xFF;
-            *p++ = (len >> 16) & 0xFF;
-            *p++ = (len >> 24) & 0xFF;
-            if( msg.SerializeToArray( p_bytes + 4, len ) )
-            {
-                w->writeBytes( p_bytes, len + 4 );
-            }
-            else
-            {
-                LOG( ERROR ) << "Sensor Task Ack failed to serialize.";
-                return false;
-            }
-        }
-        else
-        {
-            LOG( ERROR ) << "Sensor Tack Ack failed to allocate serialize buffer.";
+            LOG( ERROR ) << "Sensor Task Ack failed to serialize.";
             return false;
         }
     }
@@ -122,5 +102,5 @@ bool SensorTaskACK::Write( ProtobufInterface::Writer *w )
         return false;
     }
 
-    return false;
+    return true;
 }
@@ -13,7 +13,7 @@
 
 struct SensorTaskACKData
 {
-    std::string timestamp;
+    int64_t     timestamp; // UTC nanoseconds since the epoch
     std::string nodeID;
     std::string destID;
     ulid::ULID  taskID;     // Optional
@@ -5,6 +5,7 @@
 
 #include "StatusReport.h"
 #include "ProtobufInterface/Writer.h"
+#include "../Utils/UlidGenerator.h"
 
 #define ELPP_DEFAULT_LOGGER "network"
 #include "../Utils/Log.h"
@@ -12,21 +13,19 @@
 #include "sapient_msg/bsi_flex_335_v2_0/sapient_message.pb.h"
 namespace sap = sapient_msg::bsi_flex_335_v2_0;
 
-#include <google/protobuf/util/time_util.h>
 #include <google/protobuf/util/json_util.h>
 
 
 static bool SetTimestamp( google::protobuf::Timestamp* timestamp, StatusReportData* data )
 {
-    google::protobuf::Timestamp ts;
-    if( !google::protobuf::util::TimeUtil::FromString( data->timestamp, &ts ) )
+    if( data->timestamp <= 0 )
     {
-        LOG( ERROR ) << "Status failed to convert timestamp.";
+        LOG( ERROR ) << "Status has no timestamp.";
         return false;
     }
 
-    timestamp->set_seconds( ts.seconds() );
-    timestamp->set_nanos(0);
+    timestamp->set_seconds( data->timestamp / 1000000000 );
+    timestamp->set_nanos( (int32_t)(data->timestamp % 1000000000) );
     return true;
 }
 
@@ -97,9 +96,9 @@ static void SetStatus( sap::StatusReport* sr, std::string level, sap::StatusRepo
 static bool SetStatusReport( sap::StatusReport* sr, StatusReportData* data )
 {
     ulid::ULID rep_id;
-    ulid::EncodeTimeNow( rep_id );
-    std::string str_rep_id = ulid::Marshal( rep_id );
-    sr->set_report_id( str_rep_id );
+    char str_rep_id[26];
+    Generate_Ulid( rep_id, str_rep_id );
+    sr->set_report_id( str_rep_id, sizeof( str_rep_id ) );
 
     if( data->system == "Tamper" )
     {
@@ -129,8 +128,9 @@ static bool SetStatusReport( sap::StatusReport* sr, StatusReportData* data )
 
     if( !data->activeTaskID.IsZero() )
     {
-        std::string str_active_task_id = ulid::Marshal( data->activeTaskID );
-        sr->set_active_task_id( str_active_task_id );
+        char str_active_task_id[26];
+        ulid::MarshalTo( data->activeTaskID, str_active_task_id );
+        sr->set_active_task_id( str_active_task_id, sizeof( str_active_task_id ) );
     }
 
     sr->set_mode( "default" );
@@ -245,51 +245,32 @@ static bool SetStatusReport( sap::StatusReport* sr, StatusReportData* data )
 
 bool StatusReport::Write( ProtobufInterface::Writer *w )
 {
-    sap::SapientMessage msg;
+    ArenaMessage<sap::SapientMessage> msg( w->arena() );
 
-    if( !SetTimestamp( msg.mutable_timestamp(), data ) )
+    if( !SetTimestamp( msg->mutable_timestamp(), data ) )
     {
         return false;
     }
 
-    msg.set_node_id( data->nodeID );
-    msg.set_destination_id( data->destID );
+    msg->set_node_id( data->nodeID );
+    msg->set_destination_id( data->destID );
 
-    if( !SetStatusReport( msg.mutable_status_report(), data ) )
+    if( !SetStatusReport( msg->mutable_status_report(), data ) )
     {
         return false;
     }
 
-    if( msg.IsInitialized() )
+    if( msg->IsInitialized() )
     {
 #ifdef WANT_PROTOBUF_DEBUG_JSON
         std::string json;
-        google::protobuf::util::MessageToJsonString( msg, &json );
+        google::protobuf::util::MessageToJsonString( *msg, &json );
         LOG( INFO ) << json;
 #endif
 
-        uint32_t len = msg.ByteSizeLong();
-        uint8_t *p_bytes = new uint8_t[ len + 4 ];
-        if( p_bytes != nullptr )
+        if( !w->writeMessage( *msg ) )
         {
-            uint8_t *p = p_bytes;
-            *p++ = len & 0xFF;
-            *p++ = (len >> 8) & 0xFF;
-            *p++ = (len >> 16) & 0xFF;
-            *p++ = (len >> 24) & 0xFF;
-            if( msg.SerializeToArray( p_bytes + 4, len ) )
-            {
-                w->writeBytes( p_bytes, len + 4 );
-            }
-            else
-            {
-                LOG( ERROR ) << "Status failed to serialize.";
-                return false;
-            }
-        }
-        else
-        {
-            LOG( ERROR ) << "Status failed to allocate serialize buffer.";
+            LOG( ERROR ) << "Status failed to serialize.";
             return false;
         }
     }
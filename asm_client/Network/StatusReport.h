@@ -33,7 +33,7 @@ struct StatusReportLocationRBC
 
 struct StatusReportData
 {
-    std::string timestamp;
+    int64_t     timestamp; // UTC nanoseconds since the epoch
     std::string nodeID;
     std::string destID;
     std::string system;
@@ -59,6 +59,7 @@ struct StatusReportData
 
     StatusReportData()
     {
+        timestamp = 0;
         sensorLocation = nullptr;
         fieldOfViewRBC = nullptr;
         fieldOfViewPolygon = nullptr;
@@ -12,15 +12,43 @@
 #include "../../Utils/Log.h"
 #include "../../Utils/Config.h"
 #include "../../Utils/Utils.h"
-#include "../../Utils/Ulid.h"
+#include "../../Utils/UlidGenerator.h"
+#include "../../Utils/Reactor.h"
+
+#ifdef __unix__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#endif
 
 AptCorePIR::AptCorePIR()
 {
     el::Loggers::getLogger( "sensor" );
+    reactor = nullptr;
+    poll_timer = nullptr;
+    for (int t = 0; t < MAX_SENSORS; t++)
+    {
+        event_fd[t] = -1;
+        gpio_level[t] = 0;
+    }
 }
 
 AptCorePIR::~AptCorePIR()
 {
+#ifdef __unix__
+    for (int t = 0; t < MAX_SENSORS; t++)
+    {
+        if (event_fd[t] >= 0) close( event_fd[t] );
+    }
+#endif
+    delete poll_timer;
+}
+
+void AptCorePIR::AttachReactor( Reactor *r )
+{
+    reactor = r;
 }
 
 void AptCorePIR::Initialise( const char *configFilename )
@@ -44,6 +72,10 @@ void AptCorePIR::Initialise( const char *configFilename )
     {
         LOG( INFO ) << "Configured for " << num_sensors << " sensors.";
     }
+
+    gpio_chip = config.GetValue( "sensor", "gpio_chip", "/dev/gpiochip0" );
+    poll_period_ms = (int)config.GetLongValue( "sensor", "poll_period_ms", 50 );
+    poll_timer = new ReactorTimer( reactor );
 #ifdef __unix__
     for (int t = 0; t < num_sensors; t++)
     {
@@ -62,6 +94,16 @@ void AptCorePIR::Initialise( const char *configFilename )
             const char *sys_command_c = sys_command.c_str();
             LOG( INFO ) << sys_command_c;
             system( sys_command_c );
+
+            event_fd[t] = GPIO_Request_Events( t );
+            if (event_fd[t] >= 0)
+            {
+                if (reactor != nullptr) reactor->Watch( event_fd[t] );
+            }
+            else
+            {
+                LOG( WARNING ) << "GPIO events unavailable for " << sensors[t] << ", polling every " << poll_period_ms << "ms";
+            }
         }
     }
 #else
@@ -72,12 +114,24 @@ void AptCorePIR::Initialise( const char *configFilename )
 void AptCorePIR::Loop( const struct AsmClientTask &task, struct AsmClientData &data )
 {
     data.detections.resize( num_sensors );
-    data.timestamp = Get_Timestamp( std::chrono::system_clock::now() );
+    data.timestamp = Get_Time_UTC_ns();
     int num_detections = 0;
+    bool polling = false;
 
     for (int t = 0; t < num_sensors; t++) // cycle through the sensors checking for detections.
     {
-        if (GPIO_Read_Raspi( t ) != 0)
+        int level;
+        if (event_fd[t] >= 0)
+        {
+            level = GPIO_Read_Events( t );
+        }
+        else
+        {
+            level = GPIO_Read_Raspi( t );
+            polling = true;
+        }
+
+        if (level != 0)
         {
             if (detection_active[t] == 0)
             {
@@ -87,11 +141,9 @@ void AptCorePIR::Loop( const struct AsmClientTask &task, struct AsmClientData &d
 
                 // Protobuf interface now uses ULID's for object IDs.
                 //detection->id = detection_num;
-                ulid::ULID det_ulid;
-                ulid::EncodeTimeNow( det_ulid );
-                detection->id = det_ulid;
+                Generate_Ulid( detection->id, detection->idText );
 
-                LOG( INFO ) << "Detection sensor: " << t + 1 << " Detection number: " << detection_num;
+                VLOG( 1 ) << "Detection sensor: " << t + 1 << " Detection number: " << detection_num;
                 detection->range = 6;
                 detection->direction = (float)(t * 90);
                 detection->directionError = 45;
@@ -109,6 +161,67 @@ void AptCorePIR::Loop( const struct AsmClientTask &task, struct AsmClientData &d
         }
     }
     data.detections.resize( num_detections );
+
+    // Make sure the loop is run again to poll any pins without events
+    if (polling && poll_timer->Expired())
+    {
+        poll_timer->Start( poll_period_ms / 1000.0 );
+    }
+}
+
+// Requests edge events for the sensor's GPIO line from the GPIO character device.
+// Returns the event descriptor, or -1 if events are not available.
+int AptCorePIR::GPIO_Request_Events( int sensor )
+{
+#ifdef __unix__
+    int gpio_num = std::stoi( sensors[sensor].substr( 4 ) );
+
+    int chip_fd = open( gpio_chip.c_str(), O_RDONLY | O_CLOEXEC );
+    if (chip_fd < 0)
+    {
+        return -1;
+    }
+
+    struct gpioevent_request request = { 0 };
+    request.lineoffset = gpio_num;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+    snprintf( request.consumer_label, sizeof( request.consumer_label ), "asm_client" );
+
+    int result = ioctl( chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request );
+    close( chip_fd );
+    if (result < 0)
+    {
+        return -1;
+    }
+    fcntl( request.fd, F_SETFL, fcntl( request.fd, F_GETFL ) | O_NONBLOCK );
+
+    // Events only report changes, so start from the current level
+    struct gpiohandle_data values = { { 0 } };
+    if (ioctl( request.fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &values ) == 0)
+    {
+        gpio_level[sensor] = values.values[0];
+    }
+    return request.fd;
+#else
+    return -1;
+#endif
+}
+
+// Consumes any pending edge events and returns the level of the line. A pulse that
+// rose and fell since the last call is reported as high so that it is not missed.
+int AptCorePIR::GPIO_Read_Events( int sensor )
+{
+    int rising = 0;
+#ifdef __unix__
+    struct gpioevent_data event;
+    while (read( event_fd[sensor], &event, sizeof( event ) ) == (ssize_t)sizeof( event ))
+    {
+        gpio_level[sensor] = (event.id == GPIOEVENT_EVENT_RISING_EDGE) ? 1 : 0;
+        rising |= gpio_level[sensor];
+    }
+#endif
+    return gpio_level[sensor] | rising;
 }
 
 int AptCorePIR::GPIO_Read_Raspi( int sensor )
@@ -125,11 +238,11 @@ int AptCorePIR::GPIO_Read_Raspi( int sensor )
 
 #ifdef __unix__
     char cmd_res[64] = { 0 };
-    std::string sys_command = "pinctrl get " + std::to_string( gpio_num );
-    const char *sys_command_c = sys_command.c_str();
+    char sys_command[32];
+    snprintf( sys_command, sizeof( sys_command ), "pinctrl get %d", gpio_num );
 
     // We need the result of the sys command
-    FILE *fp = popen( sys_command_c, "r" );
+    FILE *fp = popen( sys_command, "r" );
     if( fp )
     {
         fgets( cmd_res, 64, fp );
@@ -139,15 +252,14 @@ int AptCorePIR::GPIO_Read_Raspi( int sensor )
     }
 
     // E.g: 4: ip    -- | lo // GPIO4 = input
-    std::string s( cmd_res );
-    std::string::size_type pos = s.find( "| " );
-    if( pos == std::string::npos )
+    const char *level = strstr( cmd_res, "| " );
+    if( level == NULL )
     {
         LOG( ERROR ) << "GPIO read result is malformed";
         return 0;
     }
 
-    if( s[ pos+2 ] != 'l' )        // for "lo"
+    if( level[2] != 'l' )        // for "lo"
     {
         retval = 1;
     }
@@ -16,16 +16,28 @@ class AptCorePIR : public Sensor
 public:
     AptCorePIR();
     ~AptCorePIR();
+    void AttachReactor( Reactor *reactor );
     void Initialise( const char *configFilename );
     void Loop( const struct AsmClientTask &task, struct AsmClientData &data );
 
 private:
     int GPIO_Read( int pin );
     int GPIO_Read_Raspi( int pin );
+    int GPIO_Request_Events( int sensor );
+    int GPIO_Read_Events( int sensor );
 
     std::string sensors[MAX_SENSORS];
     int num_sensors;
 
+    // GPIO line event descriptors wake the reactor on each edge. Where they are not
+    // available the pins are polled every poll_period_ms instead.
+    std::string gpio_chip;
+    int event_fd[MAX_SENSORS];
+    int gpio_level[MAX_SENSORS];
+    int poll_period_ms;
+    Reactor *reactor;
+    class ReactorTimer *poll_timer;
+
     int detection_num;
     int detection_active[MAX_SENSORS];
 };
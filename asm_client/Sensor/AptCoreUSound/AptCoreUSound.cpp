@@ -5,6 +5,7 @@
 
 #include "AptCoreUSound.h"
 #include "Modbus.h"
+#include "ModbusQueue.h"
 #include "../Sensor.h"
 #include "../../AsmClient.h"
 
@@ -12,6 +13,13 @@
 #include "../../Utils/Log.h"
 #include "../../Utils/Config.h"
 #include "../../Utils/Utils.h"
+#include "../../Utils/Reactor.h"
+#include "../../Utils/UlidGenerator.h"
+
+#include <algorithm>
+#include <math.h>
+#include <sstream>
+#include <stdlib.h>
 
 #ifdef __unix__
 #include <unistd.h>
@@ -19,14 +27,31 @@
 
 #define TRIGGER_PERIOD_MS 15
 
+// How many scans with echoes a pair fired together is watched for before deciding whether they hear each other
+#define CROSSTALK_WINDOW 20
+
+// The function codes are bitmasks of the transducers to trigger or read
+#define FUNCTION_TRIGGER 0x20
+#define FUNCTION_READ 0x40
+
+// A trigger's response is just the address, function code and CRC
+#define TRIGGER_RESPONSE_LENGTH 4
+
 AptCoreUSound::AptCoreUSound()
 {
     el::Loggers::getLogger( "sensor" );
-    previous_trigger = 0;
+    reactor = nullptr;
+    modbus_queue = nullptr;
 }
 
 AptCoreUSound::~AptCoreUSound()
 {
+    delete modbus_queue;
+}
+
+void AptCoreUSound::AttachReactor( Reactor *r )
+{
+    reactor = r;
 }
 
 void AptCoreUSound::Initialise( const char *configFilename )
@@ -52,6 +77,7 @@ void AptCoreUSound::Initialise( const char *configFilename )
     mbus.timeout = (int)config.GetLongValue( "sensor", "modbus_timeout_us", 0 );
     mbus.slave_id = (int)config.GetLongValue( "sensor", "modbus_slave_id", 0 );
     mbus.tx_enable_gpio = (int)config.GetLongValue( "sensor", "tx_enable_gpio", 0 );
+    mbus.rs485 = (int)config.GetLongValue( "sensor", "modbus_rs485", 0 );
 
     if ((serial.device == "None") || (serial.baud == 0) ||
         (mbus.timeout == 0) || (mbus.slave_id == 0) || (mbus.timeout == 0))
@@ -67,16 +93,25 @@ void AptCoreUSound::Initialise( const char *configFilename )
     int default_min_range = (int)config.GetLongValue( "sensor", "min_range", 15 );
     int default_track_range_diff = (int)config.GetLongValue( "sensor", "track_range_diff", 20 );
     int default_track_lifetime = (int)config.GetLongValue( "sensor", "track_lifetime", 20 );
+    double default_track_alpha = config.GetDoubleValue( "sensor", "track_alpha", 0.5 );
+    double default_track_beta = config.GetDoubleValue( "sensor", "track_beta", 0.2 );
 
     //Read the number of sensors.
     num_sensors = config.GetLongValue( "sensor", "num_sensors", 1 );
 
+    // How many groups of transducers may be listening for their echoes at once
+    scan_overlap = (int)config.GetLongValue( "sensor", "scan_overlap", 1 );
+    if (scan_overlap < 1) scan_overlap = 1;
+    stats_interval = config.GetDoubleValue( "sensor", "stats_interval", 60 );
+
     //Allow for independant control of threshold and range.
     amplitude_threshold = (int*)malloc( num_sensors * sizeof( amplitude_threshold ) );
     max_range = (int*)malloc( num_sensors * sizeof( max_range ) );
     min_range = (int*)malloc( num_sensors * sizeof( min_range ) );
     track_range_diff = (int*)malloc( num_sensors * sizeof( track_range_diff ) );
     track_lifetime = (int*)malloc( num_sensors * sizeof( track_lifetime ) );
+    track_alpha = (double*)malloc( num_sensors * sizeof( *track_alpha ) );
+    track_beta = (double*)malloc( num_sensors * sizeof( *track_beta ) );
     det_direction = (int*)malloc( num_sensors * sizeof( det_direction ) );
 
     for (index = 0; index < num_sensors; index++)
@@ -96,196 +131,387 @@ void AptCoreUSound::Initialise( const char *configFilename )
         snprintf( config_key, sizeof( config_key ), "track_lifetime%d", index );
         track_lifetime[index] = (unsigned int)config.GetLongValue( "sensor", config_key, default_track_lifetime );
 
+        snprintf( config_key, sizeof( config_key ), "track_alpha%d", index );
+        track_alpha[index] = config.GetDoubleValue( "sensor", config_key, default_track_alpha );
+
+        snprintf( config_key, sizeof( config_key ), "track_beta%d", index );
+        track_beta[index] = config.GetDoubleValue( "sensor", config_key, default_track_beta );
+
         snprintf( config_key, sizeof( config_key ), "det_direction%d", index );
         det_direction[index] = (int)config.GetLongValue( "sensor", config_key, 0 );
     }
 
-    // Initialise the vector for number of results
+    // Which transducers hear each other is given as a list for each of the transducers it hears,
+    // or else assumed of those pointing within group_separation degrees of each other. Without
+    // either, each transducer is triggered on its own.
+    double group_separation = config.GetDoubleValue( "sensor", "group_separation", 0 );
+    crosstalk_limit = config.GetDoubleValue( "sensor", "crosstalk_limit", 0.5 );
+    conflicts.assign( num_sensors, 0 );
+    grouping = false;
+    for (index = 0; index < num_sensors; index++)
+    {
+        snprintf( config_key, sizeof( config_key ), "crosstalk%d", index );
+        const char *heard = config.GetValue( "sensor", config_key, nullptr );
+        if (heard == nullptr) continue;
+
+        grouping = true;
+        const char *p = heard;
+        while (*p != '\0')
+        {
+            char *end;
+            long other = strtol( p, &end, 10 );
+            if (end == p)
+            {
+                p++;
+                continue;
+            }
+            if (other >= 0 && other < num_sensors && other != index)
+            {
+                conflicts[index] |= 1u << other;
+                conflicts[other] |= 1u << index;
+            }
+            p = end;
+        }
+    }
+    if (!grouping && group_separation > 0)
+    {
+        grouping = true;
+        for (int a = 0; a < num_sensors; a++)
+        {
+            for (int b = a + 1; b < num_sensors; b++)
+            {
+                int separation = abs( det_direction[a] - det_direction[b] ) % 360;
+                if (separation > 180) separation = 360 - separation;
+                if (separation < group_separation)
+                {
+                    conflicts[a] |= 1u << b;
+                    conflicts[b] |= 1u << a;
+                }
+            }
+        }
+    }
+    group_mask.reserve( num_sensors );
+    group_reads_left.reserve( num_sensors );
+    transducer_group.resize( num_sensors );
+    pair_scans.assign( num_sensors * num_sensors, 0 );
+    pair_coincident.assign( num_sensors * num_sensors, 0 );
+    crosstalk_found = 0;
+    Build_Groups();
+
+    // Initialise the vector for number of results, and a tracker for each sensor. Each sensor
+    // has one direction, so its tracker gates on range alone.
     raw_detections.resize( num_sensors );
-    tracks.resize( num_sensors );
+    trackers.reserve( num_sensors );
+    for (index = 0; index < num_sensors; index++)
+    {
+        TrackerConfig tracker_config;
+        tracker_config.rangeGate = (float)track_range_diff[index] / 100;
+        tracker_config.azimuthGate = 360;
+        tracker_config.alpha = (float)track_alpha[index];
+        tracker_config.beta = (float)track_beta[index];
+        tracker_config.confirmScore = track_lifetime[index];
+        raw_detections[index].reserve( tracker_config.maxPlots );
+        trackers.push_back( Tracker( tracker_config ) );
+    }
+
+    // Each transducer has at most a trigger and a read waiting
+    modbus_queue = new ModbusQueue( modbus, reactor, 2 * num_sensors );
+    trigger_time.resize( num_sensors );
+    max_detections = num_sensors * TrackerConfig().maxTracks;
+    next_group = (int)group_mask.size();
+    listening = 0;
+    listening_mask = 0;
+    reads_done = num_sensors;
+    scan_timestamp = 0;
+    scans = 0;
+    stats_start = Get_Time_Monotonic();
 }
 
-void AptCoreUSound::Loop( const struct AsmClientTask &task, struct AsmClientData &data )
+// Puts each transducer in the first group with none that it hears
+void AptCoreUSound::Build_Groups()
 {
-    ModbusErrno returncode;
-    int d, function, adu_length, datapoint, delay_ms;
-    uint8_t *adu;
+    group_mask.clear();
+    for (int d = 0; d < num_sensors; d++)
+    {
+        size_t g = grouping ? 0 : group_mask.size();
+        while (g < group_mask.size() && (group_mask[g] & conflicts[d]) != 0) g++;
+        if (g == group_mask.size()) group_mask.push_back( 0 );
+        group_mask[g] |= 1u << d;
+        transducer_group[d] = (int)g;
+    }
+    group_reads_left.assign( group_mask.size(), 0 );
 
-    // Clear out all 'updated' flags before the loop for each sensor
-    for (d = 0; d < (int)data.detections.size(); d++)
+    std::ostringstream groups;
+    for (size_t g = 0; g < group_mask.size(); g++)
     {
-        data.detections[d].updated = false;
+        groups << (g ? " {" : "{");
+        for (int d = 0, n = 0; d < num_sensors; d++)
+        {
+            if (group_mask[g] & 1u << d) groups << (n++ ? "," : "") << d;
+        }
+        groups << "}";
     }
-    // Cycle around the sensors triggering and reading.
-    for (d = 0; d < num_sensors; d++)
+    LOG( INFO ) << "USound firing groups: " << groups.str();
+}
+
+uint32_t AptCoreUSound::Group_Conflicts( int group )
+{
+    uint32_t heard = 0;
+    for (int d = 0; d < num_sensors; d++)
     {
-        // Clear all the previous detections.
-        raw_detections[d].clear();
+        if (group_mask[group] & 1u << d) heard |= conflicts[d];
+    }
+    return heard;
+}
 
-        // Trigger for this detector
-        function = (0x20 | 1 << d);
-        returncode = modbus->SendADU( function, NULL, 0 );
-        if (returncode != MODBUS_ERR_NO_ERROR)
+// Transducers that hear each other's pings see the same objects at the same ranges. A pair
+// that does so in more than crosstalk_limit of their scans cannot be fired together, and
+// is split up once the scan is finished.
+void AptCoreUSound::Check_Crosstalk( int group )
+{
+    for (int a = 0; a < num_sensors; a++)
+    {
+        if ((group_mask[group] & 1u << a) == 0) continue;
+        for (int b = a + 1; b < num_sensors; b++)
         {
-            LOG( ERROR ) << "Modbus Failure: " << returncode;
+            if ((group_mask[group] & 1u << b) == 0) continue;
+            if (raw_detections[a].empty() && raw_detections[b].empty()) continue;
+
+            float gate = (float)std::max( track_range_diff[a], track_range_diff[b] ) / 100;
+            bool coincident = false;
+            for (size_t i = 0; i < raw_detections[a].size() && !coincident; i++)
+            {
+                for (size_t j = 0; j < raw_detections[b].size() && !coincident; j++)
+                {
+                    coincident = fabsf( raw_detections[a][i].range - raw_detections[b][j].range ) <= gate;
+                }
+            }
+
+            int pair = a * num_sensors + b;
+            pair_scans[pair]++;
+            if (coincident) pair_coincident[pair]++;
+            if (pair_scans[pair] < CROSSTALK_WINDOW) continue;
+
+            if (pair_coincident[pair] > crosstalk_limit * pair_scans[pair])
+            {
+                LOG( WARNING ) << "Crosstalk between transducers " << a << " and " << b << " in "
+                    << pair_coincident[pair] << " of " << pair_scans[pair]
+                    << " scans makes firing them together unusable, separating them";
+                conflicts[a] |= 1u << b;
+                conflicts[b] |= 1u << a;
+                crosstalk_found |= 1u << a | 1u << b;
+            }
+            pair_scans[pair] = 0;
+            pair_coincident[pair] = 0;
         }
-        // Receive the response to the trigger.
-        returncode = modbus->ReceiveADU( function, &adu, &adu_length );
-        if (returncode != MODBUS_ERR_NO_ERROR)
+    }
+}
+
+// Each pass moves the scan along as far as it can without waiting. A group of transducers
+// is triggered, and each read once its echoes are in, while up to scan_overlap other groups
+// that it does not hear are listening, so the bus carries their transactions while it would
+// otherwise be idle. The reactor is woken by the serial port and the Modbus queue's timer.
+void AptCoreUSound::Loop( const struct AsmClientTask &task, struct AsmClientData &data )
+{
+    ModbusCompletion done;
+
+    if (reads_done == num_sensors)
+    {
+        Start_Scan( data );
+    }
+
+    while (true)
+    {
+        while (next_group < (int)group_mask.size() && listening < scan_overlap &&
+            (Group_Conflicts( next_group ) & listening_mask) == 0)
         {
-            LOG( ERROR ) << "Modbus Rx Failure: " << returncode;
+            modbus_queue->Post( FUNCTION_TRIGGER | group_mask[next_group], next_group, 0, TRIGGER_RESPONSE_LENGTH );
+            listening_mask |= group_mask[next_group];
+            next_group++;
+            listening++;
         }
-        // Wait for 15msec before reading.
-        delay_ms = (int)(TRIGGER_PERIOD_MS - (1e3 * (Get_Time_Monotonic() - previous_trigger)));
-        if (delay_ms > 0) { Sleep_ms( delay_ms ); }
-
-        // Read the result.
-        function = (0x40 | 1 << d);
-        returncode = modbus->SendADU( function, NULL, 0 );
-        if (returncode != MODBUS_ERR_NO_ERROR)
+
+        if (!modbus_queue->Poll( done )) break;
+
+        if (done.error != MODBUS_ERR_NO_ERROR)
         {
-            LOG( ERROR ) << "Modbus Failure: " << returncode;
+            LOG( ERROR ) << "Modbus Rx Failure: " << done.error;
         }
-        // Receive the response to the read.
-        returncode = modbus->ReceiveADU( function, &adu, &adu_length );
-        if (returncode != MODBUS_ERR_NO_ERROR)
+        if (done.function & FUNCTION_TRIGGER)
         {
-            LOG( ERROR ) << "Modbus Rx Failure: " << returncode;
+            // The echoes are timed from when the trigger left the bus, and each transducer is read on its own
+            int g = done.tag;
+            int64_t sent = Get_Time_UTC_ns() - (int64_t)(done.latency * 1e9);
+            trigger_latency.Add( done );
+            group_reads_left[g] = 0;
+            for (int d = 0; d < num_sensors; d++)
+            {
+                if ((group_mask[g] & 1u << d) == 0) continue;
+                trigger_time[d] = sent;
+                modbus_queue->Post( FUNCTION_READ | 1 << d, d, done.sent + TRIGGER_PERIOD_MS / 1000.0 );
+                group_reads_left[g]++;
+            }
         }
-
-        // Check for detections from this sensor. Format of response:
-        // range[], amplitude[].
-        for (datapoint = 0; datapoint < (adu_length / 2); datapoint++)
+        else
         {
-            int range = adu[datapoint];
-            int amplitude = adu[(datapoint + adu_length) / 2];
+            int d = done.tag;
+            int g = transducer_group[d];
+            read_latency.Add( done );
+            Read_Echoes( d, done.error == MODBUS_ERR_NO_ERROR ? done.data : nullptr, done.length );
+            // Once we've pulled in all the detections we can process the data and report any tracks.
+            Process_Tracks( d, trigger_time[d], data );
+            reads_done++;
+
+            if (--group_reads_left[g] == 0)
+            {
+                Check_Crosstalk( g );
+                listening--;
+                listening_mask &= ~group_mask[g];
+            }
 
-            // Check for detections above threshold
-            if (amplitude > amplitude_threshold[d] &&
-                range > min_range[d] &&
-                range < max_range[d])
+            if (reads_done == num_sensors)
             {
-                struct Raw_Detection raw_data;
-                raw_data.amplitude = amplitude;
-                raw_data.range = range;
-                raw_detections[d].push_back( raw_data );
+                Finish_Scan( data );
+                Start_Scan( data );
             }
         }
-        // Once we've pulled in all the detections we can process the data and report any tracks.
-        Process_Tracks( d, data );
     }
 
-    // Clear out any tracks not updated. This is independant of detector number so
-    // needs to be outside the loop for each detector.
-    int det;
-    for (det = 0; det < (int)data.detections.size(); det++)
+    if (stats_interval > 0 && Get_Time_Monotonic() - stats_start >= stats_interval)
     {
-        if (data.detections[det].updated == false)
-        {
-            data.detections.erase( data.detections.begin() + det-- );
-        }
+        double elapsed = Get_Time_Monotonic() - stats_start;
+        LOG( INFO ) << "USound: " << scans / elapsed << " scans/s in " << group_mask.size() << " groups, trigger latency "
+            << trigger_latency.Mean() * 1e3 << " ms mean " << trigger_latency.max * 1e3 << " ms max "
+            << trigger_latency.errors << " errors, read latency "
+            << read_latency.Mean() * 1e3 << " ms mean " << read_latency.max * 1e3 << " ms max "
+            << read_latency.errors << " errors";
+        scans = 0;
+        trigger_latency.Reset();
+        read_latency.Reset();
+        stats_start = Get_Time_Monotonic();
     }
-
-    // Setup the timestamp
-    data.timestamp = Get_Timestamp( std::chrono::system_clock::now() );
 }
 
-void AptCoreUSound::Process_Tracks( int detector, struct AsmClientData &data )
+void AptCoreUSound::Start_Scan( struct AsmClientData &data )
 {
-    int track_loop, raw_det_loop;
-    int match_found;
-    int d;
+    // Room for every track that could be confirmed, so that new tracks do not allocate
+    if (data.detections.capacity() < max_detections) data.detections.reserve( max_detections );
 
-    // Search through provided raw data for a reasonable match
-    for (raw_det_loop = 0; raw_det_loop < (int)raw_detections[detector].size(); raw_det_loop++)
+    // Clear out all 'updated' flags before the scan reads each sensor
+    for (size_t d = 0; d < data.detections.size(); d++)
+    {
+        data.detections[d].updated = false;
+    }
+    // The scan is stamped with when its first sensor is triggered, as close as we get to when the echoes were acquired
+    scan_timestamp = Get_Time_UTC_ns();
+    next_group = 0;
+    reads_done = 0;
+}
+
+void AptCoreUSound::Finish_Scan( struct AsmClientData &data )
+{
+    // Clear out any tracks not updated. This is independant of detector number so
+    // needs to be done once every detector has been read. Each is replaced by the last
+    // detection, so removing one never moves more than one other.
+    size_t det = 0;
+    while (det < data.detections.size())
     {
-        match_found = 0;
-        // Cycle through the tracks
-        for (track_loop = 0; track_loop < (int)tracks[detector].size(); track_loop++)
+        if (data.detections[det].updated == false)
         {
-            // Check for a close match on range.
-            if ((abs( tracks[detector][track_loop].range - raw_detections[detector][raw_det_loop].range )
-                <= track_range_diff[detector]) &&
-                tracks[detector][track_loop].matched == 0)
+            detection_index.Remove( data.detections[det].id );
+            if (det + 1 < data.detections.size())
             {
-                tracks[detector][track_loop].matched = 1;
-                match_found++;
-                // Found something close. Update range and lifetime.
-                tracks[detector][track_loop].range = raw_detections[detector][raw_det_loop].range;
-                tracks[detector][track_loop].lifetime += 2; // 1 is subtracted later, 2 gives an incrementing counter;
-                if (tracks[detector][track_loop].lifetime > track_lifetime[detector])
-                {
-                    // The track is keeping a maintaining a lifetime. Cap it and report it.
-                    tracks[detector][track_loop].lifetime = track_lifetime[detector];
-                    // Asign it an ID
-                    if( tracks[detector][track_loop].id.IsZero() )
-                    {
-                        ulid::EncodeTimeNow( tracks[detector][track_loop].id );
-                    }
-                    // Report the track
-                    tracks[detector][track_loop].active = 1;
-                }
-                else
-                {
-                    tracks[detector][track_loop].active = 0;
-                }
-                break; // no need to search the rest of the tracks.
+                data.detections[det] = data.detections.back();
+                detection_index.Move( data.detections[det].id, (uint32_t)det );
             }
+            data.detections.pop_back();
         }
-        if (match_found == 0)
+        else
         {
-            struct Track_Struct new_track;
-            new_track.range = raw_detections[detector][raw_det_loop].range;
-            new_track.amplitude = raw_detections[detector][raw_det_loop].amplitude;
-            new_track.lifetime = 2; // Will be decremented shortly.
-            new_track.active = 0;
-            tracks[detector].push_back( new_track );
+            det++;
         }
     }
+    data.timestamp = scan_timestamp;
+    scans++;
 
-    // Go back through tracks (without detections) to decrement and report.
-    for (track_loop = 0; track_loop < (int)tracks[detector].size(); track_loop++)
+    // Regroup between scans, so that no group is split while it is listening
+    if (crosstalk_found != 0)
     {
-        struct AsmClientData::Detection *detection = nullptr;
-        tracks[detector][track_loop].lifetime--;
-        tracks[detector][track_loop].matched = 0;
+        crosstalk_found = 0;
+        Build_Groups();
+    }
+}
+
+// Check for detections from this sensor. Format of response:
+// range[], amplitude[].
+void AptCoreUSound::Read_Echoes( int d, const uint8_t *adu, int adu_length )
+{
+    // Clear all the previous detections.
+    raw_detections[d].clear();
+    if (adu == nullptr) return;
 
-        if (tracks[detector][track_loop].active > 0)
+    for (int datapoint = 0; datapoint < (adu_length / 2); datapoint++)
+    {
+        int range = adu[datapoint];
+        int amplitude = adu[(datapoint + adu_length) / 2];
+
+        // Check for detections above threshold
+        if (amplitude > amplitude_threshold[d] &&
+            range > min_range[d] &&
+            range < max_range[d])
         {
-            for (d = 0; d < (int)data.detections.size(); d++)
-            {
-                if( ulid::CompareULIDs( tracks[detector][track_loop].id, data.detections[d].id ) == 0 )
-                {
-                    detection = &data.detections[d];
-                }
-            }
-            if (detection == nullptr)
-            {
-                AsmClientData::Detection newDetection;
-                newDetection.id = tracks[detector][track_loop].id;
-                data.detections.push_back( newDetection );
-                detection = &data.detections.back();
-            }
-            detection->updated = true;
-            detection->range = (float)((float)tracks[detector][track_loop].range / 100);
-            detection->direction = (float)det_direction[detector];
-            detection->directionError = 90;
-            detection->dopplerSpeed = 0;
-            detection->detectionConfidence = 1;
-            detection->humanConfidence = 0;
-            detection->vehicleConfidence = 0;
-            detection->unknownConfidence = 1;
-
-            std::string did = ulid::Marshal( detection->id );
-            LOG( INFO ) << "TRACK. Detector: " << detector << " ID: "
-                << did << " Range: "
-                << detection->range;
+            struct TrackerPlot raw_data;
+            raw_data.range = (float)range / 100;
+            raw_data.azimuth = (float)det_direction[d];
+            raw_detections[d].push_back( raw_data );
         }
+    }
+}
 
-        // Kill tracks with a life of 0
-        if (tracks[detector][track_loop].lifetime == 0)
+void AptCoreUSound::Process_Tracks( int detector, int64_t timestamp, struct AsmClientData &data )
+{
+    Tracker &tracker = trackers[detector];
+    tracker.Update( timestamp, raw_detections[detector].data(), raw_detections[detector].size() );
+
+    // Report the confirmed tracks, including those coasting through a missed detection
+    for (size_t track_loop = 0; track_loop < tracker.Size(); track_loop++)
+    {
+        const TrackerTrack &track = tracker.Track( track_loop );
+        if (!track.confirmed) continue;
+
+        // The index is checked against the detection, in case something else has changed the detections
+        struct AsmClientData::Detection *detection = nullptr;
+        uint32_t slot = detection_index.Find( track.id );
+        if (slot < data.detections.size() &&
+            ulid::CompareULIDs( track.id, data.detections[slot].id ) == 0)
+        {
+            detection = &data.detections[slot];
+        }
+        if (detection == nullptr)
         {
-            tracks[detector].erase( tracks[detector].begin() + track_loop );
+            AsmClientData::Detection newDetection;
+            newDetection.id = track.id;
+            memcpy( newDetection.idText, track.idText, sizeof( newDetection.idText ) );
+            detection_index.Insert( newDetection.id, (uint32_t)data.detections.size() );
+            data.detections.push_back( newDetection );
+            detection = &data.detections.back();
         }
+        detection->updated = true;
+        detection->range = track.range;
+        detection->direction = (float)det_direction[detector];
+        detection->directionError = 90;
+        detection->dopplerSpeed = track.rangeRate;
+        detection->detectionConfidence = 1;
+        detection->humanConfidence = 0;
+        detection->vehicleConfidence = 0;
+        detection->unknownConfidence = 1;
+
+        char did[27];
+        memcpy( did, detection->idText, sizeof( detection->idText ) );
+        did[26] = '\0';
+        VLOG( 1 ) << "TRACK. Detector: " << detector << " ID: "
+            << did << " Range: "
+            << detection->range << " Range rate: "
+            << detection->dopplerSpeed;
     }
 }
@@ -6,7 +6,9 @@
 #pragma once
 
 #include "../Sensor.h"
-#include "../../Utils/Ulid.h"
+#include "ModbusQueue.h"
+#include "../Tracker/Tracker.h"
+#include "../../Utils/UlidIndex.h"
 
 #include <string>
 #include <vector>
@@ -16,16 +18,25 @@ class AptCoreUSound : public Sensor
 public:
     AptCoreUSound();
     ~AptCoreUSound();
+    void AttachReactor( Reactor *reactor );
     void Initialise( const char *configFilename );
     void Loop( const struct AsmClientTask &task, struct AsmClientData &data );
 
 private:
-    void Process_Tracks( int detector, struct AsmClientData &data );
+    void Build_Groups();
+    uint32_t Group_Conflicts( int group );
+    void Check_Crosstalk( int group );
+    void Start_Scan( struct AsmClientData &data );
+    void Finish_Scan( struct AsmClientData &data );
+    void Read_Echoes( int detector, const uint8_t *adu, int adu_length );
+    void Process_Tracks( int detector, int64_t timestamp, struct AsmClientData &data );
 
     int modbus_timeout_us;
     int slave_id;
     class ModbusComms *modbus;
     class Hardware *hware;
+    Reactor *reactor;
+    class ModbusQueue *modbus_queue;
 
     int num_sensors;
     int *amplitude_threshold;
@@ -33,23 +44,42 @@ private:
     int *max_range;
     int *track_range_diff;
     int *track_lifetime;
+    double *track_alpha;
+    double *track_beta;
     int *det_direction;
 
-    double previous_trigger;
-    struct Raw_Detection
-    {
-        int range;
-        int amplitude;
-    };
-    struct Track_Struct
-    {
-        ulid::ULID id;
-        int range;
-        int amplitude;
-        int lifetime;
-        int matched;
-        int active;
-    };
-    std::vector<std::vector <Raw_Detection> >raw_detections;
-    std::vector<std::vector <Track_Struct> >tracks;
+    // Transducers that do not hear each other are triggered together, as a group. A group is
+    // only triggered while none of the groups listening hear it.
+    std::vector<uint32_t> conflicts;        // For each transducer, a mask of those it hears or is heard by
+    bool grouping;
+    std::vector<uint32_t> group_mask;
+    std::vector<int> group_reads_left;
+    std::vector<int> transducer_group;
+
+    // Pairs fired together that keep seeing echoes at the same range are hearing each other
+    double crosstalk_limit;
+    std::vector<int> pair_scans;
+    std::vector<int> pair_coincident;
+    uint32_t crosstalk_found;
+
+    // The scan in progress
+    int scan_overlap;
+    int next_group;
+    int listening;
+    uint32_t listening_mask;
+    int reads_done;
+    int64_t scan_timestamp;
+    std::vector<int64_t> trigger_time;      // UTC nanoseconds each transducer was last triggered
+    size_t max_detections;
+
+    double stats_interval;
+    double stats_start;
+    unsigned long scans;
+    ModbusLatency trigger_latency;
+    ModbusLatency read_latency;
+    std::vector<std::vector <TrackerPlot> >raw_detections;
+    std::vector<Tracker> trackers;
+
+    // Slot in data.detections of each reported track's detection, by track ID
+    UlidIndex detection_index;
 };
@@ -13,19 +13,33 @@
 #include <thread>
 
 #ifdef __unix__
+#include <errno.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <linux/serial.h>
 #endif
 
 #ifdef TARGET_RPI
 #include <wiringPi.h>
 #else
-void digitalWrite( int pin, int value ) {};
+static inline void digitalWrite( int pin, int value ) {}
+static inline void pinMode( int pin, int mode ) {}
+static inline int wiringPiSetupGpio() { return 0; }
+#define OUTPUT 1
 #endif
 
 #define RS485_TX_ENABLE_PIN 4
 
+// The quiet time after the last byte received that ends a response of unknown length
+#define RX_GAP_US 1000
+
+// The quiet time in character periods that must separate frames on the bus
+#define FRAME_GAP_CHARS 3.5
+
 // Table of CRC values for high-order byte
 static const uint8_t Modbus_table_crc_hi[] = {
     0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
@@ -89,10 +103,17 @@ static const uint8_t Modbus_table_crc_lo[] = {
 ModbusComms::ModbusComms( HWSerial s, ModbusState mbus )
 {
     serial = s;
-    Serial_Init();
-
     state = mbus;
     state.byte_period = (float)(10 * 1.0 / serial.baud);
+
+    direction = DIRECTION_NONE;
+    rx_minimum = 1;
+    tx_done = 0;
+    rx_last = 0;
+    rx_bytes = 0;
+    rx_expected = 0;
+
+    Serial_Init();
 }
 
 // The Modbus CRC calculation is readily and openly available from on-line sources.
@@ -116,62 +137,136 @@ uint16_t ModbusComms::Calc_CRC( uint8_t *data, uint16_t length )
 // Send a data-packet. These follow an AptCore defined format, and are not
 // standard Modbus function codes.
 ModbusErrno ModbusComms::SendADU( int function, uint8_t *data, int length )
+{
+    ModbusErrno returncode = WriteADU( function, data, length );
+
+    // Sleep until the data has been transmitted
+    Serial_Drain();
+
+    return returncode;
+}
+
+ModbusErrno ModbusComms::WriteADU( int function, uint8_t *data, int length, int response_length )
 {
     adu[0] = state.slave_id;
     adu[1] = function;
-    memcpy( adu + 2, data, length );
+    if (length > 0) memcpy( adu + 2, data, length );
 
     uint16_t crc = Calc_CRC( adu, length + 2 );
     adu[length + 2] = crc >> 8;
     adu[length + 3] = crc & 0x00FF;
 
-    // Send the message
-    Serial_Write( adu, length + 4 );
+    // A response of known length only wakes the reactor once it has all arrived
+    rx_bytes = 0;
+    rx_expected = response_length;
+    Serial_Set_Minimum( response_length > 0 ? response_length : 1 );
 
-    // Busy wait for the data to be transmitted (sleep can be unpredictable)
-    // Add 0.5 byte period to allow for a small delay before transmission
-    double start = Get_Time_Monotonic();
-    while (Get_Time_Monotonic() - start < state.byte_period * (length + 4.5));
+    // Send the message. The kernel turns the bus around if it can, otherwise the
+    // transmitter is enabled until the message has been sent.
+    if (direction == DIRECTION_GPIO) digitalWrite( state.tx_enable_gpio, 1 );
+    SerialErrno error = Serial_Write( adu, length + 4 );
+    if (direction == DIRECTION_GPIO)
+    {
+        Serial_Drain();
+        digitalWrite( state.tx_enable_gpio, 0 );
+    }
+    else
+    {
+        // Add 0.5 byte period to allow for a small delay before transmission
+        tx_done = Get_Time_Monotonic() + state.byte_period * (length + 4.5);
+    }
 
-    return MODBUS_ERR_NO_ERROR;
+    return error == SERIAL_ERR_NO_ERROR ? MODBUS_ERR_NO_ERROR : (ModbusErrno)(MODBUS_ERR_SERIAL_BASE + error);
 }
 
 // Receive a Modbus response from the USound board.
 ModbusErrno ModbusComms::ReceiveADU( int function, uint8_t **data, int *length )
 {
-    int len = 1, num_bytes = 0;
+    ModbusErrno returncode;
 
-    *length = 0;
+    // Sleep until more of the response arrives or it is due to be complete
+    while ((returncode = PollADU( function, data, length )) == MODBUS_ERR_RX_PENDING)
+    {
+        int timeout = (int)((PollDeadline() - Get_Time_Monotonic()) * 1e6);
+        if (Serial_Wait( timeout > 0 ? timeout : 0 ) != SERIAL_ERR_NO_ERROR)
+        {
+            LOG( ERROR ) << "Error on serial read";
+            return MODBUS_ERR_SERIAL_BASE;
+        }
+    }
 
-    if (Serial_Read( state.timeout, adu, sizeof( adu ), num_bytes )
-        != SERIAL_ERR_NO_ERROR)
+    if (returncode == MODBUS_ERR_BAD_RX_CRC)
     {
-        LOG( ERROR ) << "Error on serial read";
+        std::this_thread::sleep_for( std::chrono::milliseconds( state.timeout / 1000 ) );
+        FlushRx();
+        return MODBUS_ERR_RX_ERROR;
     }
+    return returncode;
+}
 
-    if (num_bytes == 0) { return MODBUS_ERR_RX_TIMEOUT; }
+ModbusErrno ModbusComms::PollADU( int function, uint8_t **data, int *length )
+{
+    int len;
+    double now = Get_Time_Monotonic();
 
-    // Wait for remaining bytes
-    while (len > 0)
+    *length = 0;
+    do
     {
-        // Wait 1ms from the last received byte to create a gap before transmitting again
-        if (Serial_Read( 1000, adu + num_bytes, sizeof( adu ) - num_bytes, len )
-            != SERIAL_ERR_NO_ERROR)
+        if (Serial_Read( adu + rx_bytes, sizeof( adu ) - rx_bytes, len ) != SERIAL_ERR_NO_ERROR)
         {
             return MODBUS_ERR_SERIAL_BASE;
         }
-        num_bytes += len;
+        if (len > 0)
+        {
+            rx_bytes += len;
+            rx_last = now;
+        }
+    } while (len > 0 && rx_bytes < (int)sizeof( adu ));
+
+    if (rx_bytes == 0)
+    {
+        return now < tx_done + state.timeout * 1e-6 ? MODBUS_ERR_RX_PENDING : MODBUS_ERR_RX_TIMEOUT;
     }
 
-    // Check the CRC - CRC of the whole message (including CRC) will be 0 for valid CRC
-    if (Calc_CRC( adu, num_bytes ) != 0x0000)
+    // A response of the expected length is complete as soon as its CRC checks out. Anything
+    // else, such as an exception response, is complete once the bus has gone quiet.
+    bool complete = rx_expected > 0 && rx_bytes >= rx_expected && Calc_CRC( adu, rx_bytes ) == 0x0000;
+    if (!complete && now < rx_last + RX_GAP_US * 1e-6 && rx_bytes < (int)sizeof( adu ))
     {
-        LOG( ERROR ) << "CRC Failure";
-        std::this_thread::sleep_for( std::chrono::milliseconds( state.timeout / 1000 ) );
+        return MODBUS_ERR_RX_PENDING;
+    }
+
+    int num_bytes = rx_bytes;
+    rx_bytes = 0;
+    return Check_ADU( function, num_bytes, data, length );
+}
+
+double ModbusComms::PollDeadline() const
+{
+    return rx_bytes > 0 ? rx_last + RX_GAP_US * 1e-6 : tx_done + state.timeout * 1e-6;
+}
+
+double ModbusComms::BusFree() const
+{
+    return rx_last + state.byte_period * FRAME_GAP_CHARS;
+}
+
+void ModbusComms::FlushRx()
+{
+    rx_bytes = 0;
 #ifdef __unix__
-        tcflush( serial.fd, TCIFLUSH );
+    tcflush( serial.fd, TCIFLUSH );
 #endif
-        return MODBUS_ERR_RX_ERROR;
+}
+
+// Checks a complete response received into adu, pointing data at its contents
+ModbusErrno ModbusComms::Check_ADU( int function, int num_bytes, uint8_t **data, int *length )
+{
+    // Check the CRC - CRC of the whole message (including CRC) will be 0 for valid CRC
+    if (num_bytes < 4 || Calc_CRC( adu, num_bytes ) != 0x0000)
+    {
+        LOG( ERROR ) << "CRC Failure";
+        return MODBUS_ERR_BAD_RX_CRC;
     }
 
     // Check funcion code is correct
@@ -204,7 +299,8 @@ SerialErrno ModbusComms::Serial_Init()
 
     // Open modem device for reading and writing and not as controlling tty
     // because we don't want to get killed if linenoise sends CTRL-C.
-    serial.fd = open( serial.device.c_str(), O_RDWR | O_NOCTTY );
+    // Reads never block, taking whatever has arrived.
+    serial.fd = open( serial.device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK );
     if (serial.fd < 0)
     {
         LOG( INFO ) << "Open Failure. Device: " << serial.device.c_str();
@@ -228,15 +324,45 @@ SerialErrno ModbusComms::Serial_Init()
     default: return SERIAL_ERR_INVALID_BAUD;
     }
 
-    // Specified baud, 8 bit, no parity, 1 stop, ignore modem control, enable read
+    // Specified baud, 8 bit, no parity, 1 stop, ignore modem control, enable read.
+    // The port is readable once VMIN bytes have arrived, as set for each response.
     bzero( &tio, sizeof( tio ) );
     tio.c_cflag = baud_define | CS8 | CLOCAL | CREAD;
+    tio.c_cc[VMIN] = rx_minimum;
+    tio.c_cc[VTIME] = 0;
     tcsetattr( serial.fd, TCSAFLUSH, &tio );
 
     // Flush the serial port.
     tcflush( serial.fd, TCIFLUSH );
 
     LOG( INFO ) << "Opened serial fd: " << serial.fd;
+
+    if (state.rs485)
+    {
+#ifdef TIOCSRS485
+        // Have the driver raise RTS to enable the transmitter while it sends
+        struct serial_rs485 rs485;
+        memset( &rs485, 0, sizeof( rs485 ) );
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        if (ioctl( serial.fd, TIOCSRS485, &rs485 ) == 0)
+        {
+            direction = DIRECTION_KERNEL;
+            LOG( INFO ) << "RS485 direction controlled by the serial driver";
+        }
+#endif
+        if (direction == DIRECTION_NONE && state.tx_enable_gpio > 0)
+        {
+            wiringPiSetupGpio();
+            pinMode( state.tx_enable_gpio, OUTPUT );
+            digitalWrite( state.tx_enable_gpio, 0 );
+            direction = DIRECTION_GPIO;
+            LOG( WARNING ) << "The serial driver does not support RS485, enabling the transmitter with GPIO " << state.tx_enable_gpio;
+        }
+        else if (direction == DIRECTION_NONE)
+        {
+            LOG( WARNING ) << "The serial driver does not support RS485 and there is no tx_enable_gpio";
+        }
+    }
 #else
     // Set up a fd for test purposes.
     serial.fd = 12;
@@ -256,35 +382,68 @@ SerialErrno ModbusComms::Serial_Write( const void *data, int length )
     return SERIAL_ERR_NO_ERROR;
 }
 
-SerialErrno ModbusComms::Serial_Read( int timeout, void *data, int max_length, int &length )
+// Reads whatever has arrived, without waiting
+SerialErrno ModbusComms::Serial_Read( void *data, int max_length, int &length )
+{
+    length = 0;
+#ifdef __unix__
+    int received = read( serial.fd, data, max_length );
+    if (received < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? SERIAL_ERR_NO_ERROR : SERIAL_ERR_READ_ERROR;
+    }
+    length = received;
+#else
+    LOG( INFO ) << "Serial Read";
+#endif
+    return SERIAL_ERR_NO_ERROR;
+}
+
+// Waits up to timeout microseconds for the port to become readable
+SerialErrno ModbusComms::Serial_Wait( int timeout )
 {
 #ifdef __unix__
     fd_set readfds;
     struct timeval timeout_struct;
-    int waiting_data;
 
-    length = 0;
-    // See if there is data waiting to be read
     timeout_struct.tv_sec = timeout / 1000000;
     timeout_struct.tv_usec = timeout % 1000000;
 
     FD_ZERO( &readfds );
     FD_SET( serial.fd, &readfds );
 
-    waiting_data = select( serial.fd + 1, &readfds, NULL, NULL, &timeout_struct );
-    // See if there is any data available
-    if (waiting_data < 0)
+    if (select( serial.fd + 1, &readfds, NULL, NULL, &timeout_struct ) < 0 && errno != EINTR)
     {
         return SERIAL_ERR_READ_ERROR;
     }
-    else if (waiting_data > 0)
+#endif
+    return SERIAL_ERR_NO_ERROR;
+}
+
+// Sleeps until everything written has left the transmitter
+void ModbusComms::Serial_Drain()
+{
+#ifdef __unix__
+    tcdrain( serial.fd );
+    tx_done = Get_Time_Monotonic();
+#else
+    while (Get_Time_Monotonic() < tx_done);
+#endif
+}
+
+// Sets how many bytes must arrive before the port is readable
+void ModbusComms::Serial_Set_Minimum( int minimum )
+{
+    if (minimum > 255) minimum = 255;
+    if (minimum == rx_minimum) return;
+    rx_minimum = minimum;
+#ifdef __unix__
+    struct termios tio;
+    if (tcgetattr( serial.fd, &tio ) == 0)
     {
-        // Read the available data
-        length = read( serial.fd, data, max_length );
-        if (length == -1) return SERIAL_ERR_READ_ERROR;
+        tio.c_cc[VMIN] = minimum;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr( serial.fd, TCSANOW, &tio );
     }
-#else
-    LOG( INFO ) << "Serial Read";
 #endif
-    return SERIAL_ERR_NO_ERROR;
 }
@@ -13,6 +13,7 @@ typedef enum
     MODBUS_ERR_BAD_RX_CRC,
     MODBUS_ERR_RX_ERROR,
     MODBUS_ERR_RX_TIMEOUT,
+    MODBUS_ERR_RX_PENDING,
     MODBUS_ERR_SERIAL_BASE = 20
 } ModbusErrno;
 
@@ -38,6 +39,7 @@ struct ModbusState
     int slave_id;
     int timeout;
     int tx_enable_gpio;
+    int rs485;              // Turn the bus around in the serial driver, or else with tx_enable_gpio
     float byte_period;
 };
 
@@ -54,13 +56,52 @@ public:
     // Receives incoming Modbus responses.
     ModbusErrno ReceiveADU( int function, uint8_t **data, int *length );
 
+    // Transmits a message without waiting for it to leave the bus. Its response is
+    // collected by calling PollADU until it returns something other than MODBUS_ERR_RX_PENDING.
+    // If the response's length is known, including address and CRC, it is complete as soon
+    // as that much has arrived, and the port only becomes readable then.
+    ModbusErrno WriteADU( int function, uint8_t *data, int length, int response_length = 0 );
+
+    // Reads whatever of the response has arrived without blocking. A response of unknown
+    // length is complete once the bus has been quiet for a millisecond. It times out if
+    // nothing has arrived within the timeout of the message leaving the bus.
+    ModbusErrno PollADU( int function, uint8_t **data, int *length );
+
+    // When, in monotonic seconds, PollADU next has something to decide if no more bytes arrive
+    double PollDeadline() const;
+
+    // When the gap after the last response will have passed, so the next message may be sent
+    double BusFree() const;
+
+    // When the message last written will have left the bus
+    double TxDone() const { return tx_done; }
+
+    // Discards anything received, such as the rest of a corrupted response
+    void FlushRx();
+
+    int Fd() const { return serial.fd; }
+    int Timeout_us() const { return state.timeout; }
+
 private:
     uint16_t Calc_CRC( uint8_t *data, uint16_t length );
+    ModbusErrno Check_ADU( int function, int num_bytes, uint8_t **data, int *length );
     SerialErrno Serial_Init();
     SerialErrno Serial_Write( const void *data, int length );
-    SerialErrno Serial_Read( int timeout, void *data, int max_length, int &length );
+    SerialErrno Serial_Read( void *data, int max_length, int &length );
+    SerialErrno Serial_Wait( int timeout );
+    void Serial_Drain();
+    void Serial_Set_Minimum( int minimum );
 
     struct HWSerial serial;
     struct ModbusState state;
     uint8_t adu[256 + 4];       // maximum RTU message length
+
+    enum { DIRECTION_NONE, DIRECTION_KERNEL, DIRECTION_GPIO } direction;
+    int rx_minimum;
+
+    // The message in progress for WriteADU and PollADU
+    double tx_done;
+    double rx_last;
+    int rx_bytes;
+    int rx_expected;
 };
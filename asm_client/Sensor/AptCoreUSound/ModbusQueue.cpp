@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "ModbusQueue.h"
+
+#define ELPP_DEFAULT_LOGGER "sensor"
+#include "../../Utils/Log.h"
+#include "../../Utils/Utils.h"
+#include "../../Utils/Reactor.h"
+
+
+ModbusQueue::ModbusQueue( ModbusComms *m, Reactor *reactor, size_t capacity )
+{
+    modbus = m;
+    timer = new ReactorTimer( reactor );
+    posted.reserve( capacity );
+    active = false;
+    quiet_until = 0;
+
+    if (reactor != nullptr && modbus->Fd() >= 0) reactor->Watch( modbus->Fd() );
+}
+
+ModbusQueue::~ModbusQueue()
+{
+    delete timer;
+}
+
+bool ModbusQueue::Post( int function, int tag, double not_before, int response_length )
+{
+    if (posted.size() == posted.capacity()) return false;
+
+    Transaction transaction;
+    transaction.function = function;
+    transaction.tag = tag;
+    transaction.not_before = not_before;
+    transaction.response_length = response_length;
+    posted.push_back( transaction );
+    return true;
+}
+
+bool ModbusQueue::Poll( ModbusCompletion &done )
+{
+    double now = Get_Time_Monotonic();
+
+    if (active)
+    {
+        uint8_t *data = nullptr;
+        int length = 0;
+        ModbusErrno returncode = modbus->PollADU( current.function, &data, &length );
+        if (returncode != MODBUS_ERR_RX_PENDING)
+        {
+            active = false;
+            done.function = current.function;
+            done.tag = current.tag;
+            done.error = returncode;
+            done.data = data;
+            done.length = length;
+            done.sent = modbus->TxDone();
+            done.latency = now - done.sent;
+
+            // As ReceiveADU does, wait out the rest of a corrupted response and discard it
+            if (returncode == MODBUS_ERR_BAD_RX_CRC)
+            {
+                quiet_until = now + modbus->Timeout_us() * 1e-6;
+            }
+            return true;
+        }
+    }
+
+    if (!active && now >= quiet_until && now >= modbus->BusFree())
+    {
+        if (quiet_until != 0)
+        {
+            modbus->FlushRx();
+            quiet_until = 0;
+        }
+
+        // Send whichever transaction has been due longest, keeping the order they were posted in otherwise
+        size_t next = posted.size();
+        for (size_t i = 0; i < posted.size(); i++)
+        {
+            if (posted[i].not_before <= now && (next == posted.size() || posted[i].not_before < posted[next].not_before))
+            {
+                next = i;
+            }
+        }
+        if (next < posted.size())
+        {
+            current = posted[next];
+            posted.erase( posted.begin() + next );
+            active = true;
+
+            ModbusErrno returncode = modbus->WriteADU( current.function, NULL, 0, current.response_length );
+            if (returncode != MODBUS_ERR_NO_ERROR)
+            {
+                LOG( ERROR ) << "Modbus Failure: " << returncode;
+            }
+        }
+    }
+
+    Arm( now );
+    return false;
+}
+
+// Wakes the reactor when the next thing is due that the serial port will not wake it for
+void ModbusQueue::Arm( double now )
+{
+    double deadline = -1;
+    if (active)
+    {
+        deadline = modbus->PollDeadline();
+    }
+    else
+    {
+        for (size_t i = 0; i < posted.size(); i++)
+        {
+            if (deadline < 0 || posted[i].not_before < deadline) deadline = posted[i].not_before;
+        }
+        if (deadline >= 0 && deadline < quiet_until) deadline = quiet_until;
+        if (deadline >= 0 && deadline < modbus->BusFree()) deadline = modbus->BusFree();
+    }
+
+    if (deadline < 0)
+    {
+        timer->Stop();
+    }
+    else
+    {
+        timer->Start( deadline - now );
+    }
+}
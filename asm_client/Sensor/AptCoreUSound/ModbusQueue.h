@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "Modbus.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class Reactor;
+class ReactorTimer;
+
+struct ModbusCompletion
+{
+    int function;
+    int tag;                // As given to Post
+    ModbusErrno error;
+    uint8_t *data;          // The response's contents, valid until the next Poll
+    int length;
+    double sent;            // When the request left the bus, in monotonic seconds
+    double latency;         // Seconds from the request being sent to its response being complete
+};
+
+// Running figures for a kind of transaction, for logging
+struct ModbusLatency
+{
+    unsigned long count;
+    unsigned long errors;
+    double total;
+    double max;
+
+    ModbusLatency() { Reset(); }
+    void Reset() { count = 0; errors = 0; total = 0; max = 0; }
+    void Add( const ModbusCompletion &done )
+    {
+        count++;
+        if (done.error != MODBUS_ERR_NO_ERROR) errors++;
+        total += done.latency;
+        if (done.latency > max) max = done.latency;
+    }
+    double Mean() const { return count ? total / count : 0; }
+};
+
+// Runs Modbus transactions one at a time on the bus without blocking. A transaction is
+// posted with the earliest time it may be sent, so a slave can be given time to do its
+// work while the bus is used for others. Whenever the bus is free, the posted transaction
+// that has been due longest is sent. The serial port is watched by the reactor and a
+// timer wakes it for the next deadline, so Poll only needs calling when the reactor wakes.
+class ModbusQueue
+{
+public:
+    ModbusQueue( ModbusComms *modbus, Reactor *reactor, size_t capacity );
+    ~ModbusQueue();
+
+    // Queues a transaction with no data, and a response of the given length if it is known.
+    // Returns false if the queue is full.
+    bool Post( int function, int tag, double not_before, int response_length = 0 );
+
+    // Moves the transaction on the bus along. Returns true with the next completed transaction,
+    // or false once there is nothing more to do until the reactor next wakes.
+    bool Poll( ModbusCompletion &done );
+
+    // Transactions posted and not yet completed
+    size_t Pending() const { return posted.size() + (active ? 1 : 0); }
+
+private:
+    struct Transaction
+    {
+        int function;
+        int tag;
+        double not_before;
+        int response_length;
+    };
+
+    void Arm( double now );
+
+    ModbusComms *modbus;
+    ReactorTimer *timer;
+    std::vector<Transaction> posted;
+    Transaction current;
+    bool active;
+    double quiet_until;     // The bus is left alone until then after a corrupted response
+};
@@ -5,10 +5,18 @@
 
 #pragma once
 
+class Reactor;
+class MessageDispatcher;
+
 class Sensor
 {
 public:
     virtual ~Sensor() {};
+    // Called before Initialise with the reactor that the sensor's descriptors and timers should wake
+    virtual void AttachReactor( Reactor *reactor ) {};
     virtual void Initialise( const char *configFilename ) = 0;
+    // Called after Initialise so the sensor can register handlers for the messages it is interested in.
+    // The handlers are called on the sensor's thread between calls to Loop, never during one.
+    virtual void Subscribe( MessageDispatcher *dispatcher ) {};
     virtual void Loop( const struct AsmClientTask &task, struct AsmClientData &data ) = 0;
 };
@@ -0,0 +1,289 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Tracker.h"
+#include "../../Utils/Angles.h"
+#include "../../Utils/UlidGenerator.h"
+
+#include <math.h>
+
+// Assigning a plot is worth this less its normalised distance from the prediction, which is at most 2
+// inside the gates, so that assigning more plots always beats assigning fewer but closer ones
+#define ASSIGN_BENEFIT 4.0f
+
+// Each bid raises a plot's price by at least this. The total benefit found is within
+// this much per track of the best possible.
+#define AUCTION_EPSILON 0.01f
+
+
+Tracker::Tracker( const TrackerConfig &c ) : config( c )
+{
+    lastTimestamp = 0;
+
+    // Cells at least as wide as the gates, so a track need only look in the cells next to its prediction's
+    azimuthCells = (long)floorf( 360.0f / config.azimuthGate );
+    if (azimuthCells < 1) azimuthCells = 1;
+
+    pool.resize( config.maxTracks );
+    live.reserve( config.maxTracks );
+    survivors.reserve( config.maxTracks );
+    freeTracks.reserve( config.maxTracks );
+    for (size_t i = config.maxTracks; i > 0; i--)
+    {
+        freeTracks.push_back( (uint32_t)(i - 1) );
+    }
+
+    size_t cells = 16;
+    while (cells < config.maxPlots * 2) cells <<= 1;
+    cellStart.resize( cells + 1 );
+    cellPlots.resize( config.maxPlots );
+    plotCell.resize( config.maxPlots );
+
+    candidateStart.reserve( config.maxTracks + 1 );
+    candidatePlot.reserve( config.maxTracks * 4 );
+    candidateBenefit.reserve( config.maxTracks * 4 );
+    predictedRange.resize( config.maxTracks );
+    predictedAzimuth.resize( config.maxTracks );
+
+    price.resize( config.maxPlots );
+    plotOwner.resize( config.maxPlots );
+    trackPlot.resize( config.maxTracks );
+    bidders.reserve( config.maxTracks );
+}
+
+
+size_t Tracker::Cell( long rangeCell, long azimuthCell ) const
+{
+    azimuthCell %= azimuthCells;
+    if (azimuthCell < 0) azimuthCell += azimuthCells;
+    uint64_t hash = ((uint64_t)rangeCell * 73856093ULL) ^ ((uint64_t)azimuthCell * 19349663ULL);
+    return (size_t)(hash & (cellStart.size() - 2));
+}
+
+
+size_t Tracker::Cell( float range, float azimuth ) const
+{
+    return Cell( (long)floorf( range / config.rangeGate ), (long)floorf( azimuth * azimuthCells / 360.0f ) );
+}
+
+
+// Sorts the plots by cell, counting them first so that each cell's plots are contiguous
+void Tracker::Bucket( const TrackerPlot *plots, size_t count )
+{
+    size_t cells = cellStart.size() - 1;
+    for (size_t c = 0; c <= cells; c++)
+    {
+        cellStart[c] = 0;
+    }
+    for (size_t p = 0; p < count; p++)
+    {
+        plotCell[p] = (uint32_t)Cell( plots[p].range, WrapDegrees( plots[p].azimuth ) );
+        cellStart[plotCell[p] + 1]++;
+    }
+    for (size_t c = 0; c < cells; c++)
+    {
+        cellStart[c + 1] += cellStart[c];
+    }
+    for (size_t p = 0; p < count; p++)
+    {
+        cellPlots[cellStart[plotCell[p]]++] = (uint32_t)p;
+    }
+    // Filling moved each start on to the next cell's, so move them back
+    for (size_t c = cells; c > 0; c--)
+    {
+        cellStart[c] = cellStart[c - 1];
+    }
+    cellStart[0] = 0;
+}
+
+
+void Tracker::FindCandidates( const TrackerPlot *plots, float dt )
+{
+    candidateStart.clear();
+    candidatePlot.clear();
+    candidateBenefit.clear();
+
+    for (size_t k = 0; k < live.size(); k++)
+    {
+        const TrackerTrack &track = pool[live[k]];
+        float range = track.range + track.rangeRate * dt;
+        float azimuth = WrapDegrees( track.azimuth + track.azimuthRate * dt );
+        predictedRange[k] = range;
+        predictedAzimuth[k] = azimuth;
+        candidateStart.push_back( (uint32_t)candidatePlot.size() );
+
+        // The cells around the prediction, once each, as neighbours can share a bucket
+        long rangeCell = (long)floorf( range / config.rangeGate );
+        long azimuthCell = (long)floorf( azimuth * azimuthCells / 360.0f );
+        size_t cells[9];
+        int numCells = 0;
+        for (long dr = -1; dr <= 1; dr++)
+        {
+            for (long da = -1; da <= 1; da++)
+            {
+                size_t cell = Cell( rangeCell + dr, azimuthCell + da );
+                int i = 0;
+                while (i < numCells && cells[i] != cell) i++;
+                if (i == numCells) cells[numCells++] = cell;
+            }
+        }
+
+        for (int i = 0; i < numCells; i++)
+        {
+            for (uint32_t j = cellStart[cells[i]]; j < cellStart[cells[i] + 1]; j++)
+            {
+                uint32_t p = cellPlots[j];
+                float rangeResidual = (plots[p].range - range) / config.rangeGate;
+                float azimuthResidual = DifferenceDegrees( plots[p].azimuth, azimuth ) / config.azimuthGate;
+                if (fabsf( rangeResidual ) > 1.0f || fabsf( azimuthResidual ) > 1.0f) continue;
+
+                candidatePlot.push_back( p );
+                candidateBenefit.push_back( ASSIGN_BENEFIT - rangeResidual * rangeResidual - azimuthResidual * azimuthResidual );
+            }
+        }
+    }
+    candidateStart.push_back( (uint32_t)candidatePlot.size() );
+}
+
+
+// Global nearest neighbour by auction: each unassigned track bids for the plot worth most
+// to it at the current prices, raising the price by how much more that plot is worth than
+// its next choice. A track outbid for its plot bids again. Leaving a track unassigned is
+// always a choice worth nothing, so a track never pays more for a plot than it is worth.
+void Tracker::Assign()
+{
+    for (size_t k = 0; k < live.size(); k++)
+    {
+        trackPlot[k] = -1;
+        if (candidateStart[k + 1] > candidateStart[k]) bidders.push_back( (uint32_t)k );
+    }
+
+    while (!bidders.empty())
+    {
+        uint32_t k = bidders.back();
+        bidders.pop_back();
+
+        int32_t best = -1;
+        float bestValue = 0.0f;
+        float secondValue = 0.0f;
+        for (uint32_t c = candidateStart[k]; c < candidateStart[k + 1]; c++)
+        {
+            float value = candidateBenefit[c] - price[candidatePlot[c]];
+            if (value > bestValue)
+            {
+                secondValue = bestValue;
+                bestValue = value;
+                best = (int32_t)candidatePlot[c];
+            }
+            else if (value > secondValue)
+            {
+                secondValue = value;
+            }
+        }
+        if (best < 0) continue;
+
+        price[best] += bestValue - secondValue + AUCTION_EPSILON;
+        if (plotOwner[best] >= 0)
+        {
+            trackPlot[plotOwner[best]] = -1;
+            bidders.push_back( (uint32_t)plotOwner[best] );
+        }
+        plotOwner[best] = (int32_t)k;
+        trackPlot[k] = best;
+    }
+}
+
+
+void Tracker::Update( int64_t timestamp, const TrackerPlot *plots, size_t count )
+{
+    float dt = (lastTimestamp != 0 && timestamp > lastTimestamp) ? (float)((timestamp - lastTimestamp) * 1e-9) : 0.0f;
+    lastTimestamp = timestamp;
+    if (count > config.maxPlots) count = config.maxPlots;
+
+    for (size_t p = 0; p < count; p++)
+    {
+        price[p] = 0.0f;
+        plotOwner[p] = -1;
+    }
+
+    Bucket( plots, count );
+    FindCandidates( plots, dt );
+    Assign();
+
+    // Filter each track with its plot, or coast it on its prediction
+    survivors.clear();
+    for (size_t k = 0; k < live.size(); k++)
+    {
+        TrackerTrack &track = pool[live[k]];
+        int32_t p = trackPlot[k];
+        if (p >= 0)
+        {
+            if (track.hits == 1 && dt > 0.0f)
+            {
+                // The second plot gives the first estimate of the rates
+                track.rangeRate = (plots[p].range - track.range) / dt;
+                track.azimuthRate = DifferenceDegrees( plots[p].azimuth, track.azimuth ) / dt;
+                track.range = plots[p].range;
+                track.azimuth = WrapDegrees( plots[p].azimuth );
+            }
+            else
+            {
+                float rangeResidual = plots[p].range - predictedRange[k];
+                float azimuthResidual = DifferenceDegrees( plots[p].azimuth, predictedAzimuth[k] );
+                track.range = predictedRange[k] + config.alpha * rangeResidual;
+                track.azimuth = WrapDegrees( predictedAzimuth[k] + config.alpha * azimuthResidual );
+                if (dt > 0.0f)
+                {
+                    track.rangeRate += config.beta * rangeResidual / dt;
+                    track.azimuthRate += config.beta * azimuthResidual / dt;
+                }
+            }
+            track.hits++;
+            if (track.score < config.confirmScore) track.score++;
+            track.associated = true;
+        }
+        else
+        {
+            track.range = predictedRange[k];
+            track.azimuth = predictedAzimuth[k];
+            track.score--;
+            track.associated = false;
+        }
+
+        if (track.score <= 0)
+        {
+            freeTracks.push_back( live[k] );
+            continue;
+        }
+        if (!track.confirmed && track.score >= config.confirmScore)
+        {
+            track.confirmed = true;
+            Generate_Ulid( track.id, track.idText );
+        }
+        survivors.push_back( live[k] );
+    }
+    live.swap( survivors );
+
+    // Plots no track took start new ones
+    for (size_t p = 0; p < count && !freeTracks.empty(); p++)
+    {
+        if (plotOwner[p] >= 0) continue;
+
+        uint32_t i = freeTracks.back();
+        freeTracks.pop_back();
+        TrackerTrack &track = pool[i];
+        track.id = ulid::ULID();
+        track.range = plots[p].range;
+        track.rangeRate = 0.0f;
+        track.azimuth = WrapDegrees( plots[p].azimuth );
+        track.azimuthRate = 0.0f;
+        track.score = 1;
+        track.hits = 1;
+        track.confirmed = config.confirmScore <= 1;
+        track.associated = true;
+        if (track.confirmed) Generate_Ulid( track.id, track.idText );
+        live.push_back( i );
+    }
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "../../Utils/Ulid.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// One return from a sensor in a frame
+struct TrackerPlot
+{
+    float range;        // Metres
+    float azimuth;      // Degrees, in the sensor's frame
+};
+
+struct TrackerConfig
+{
+    float rangeGate;        // Largest difference in metres between a track's predicted range and a plot's range
+    float azimuthGate;      // Likewise in degrees. A sensor with one direction per tracker can use 360.
+    float alpha;            // Gains of the alpha-beta filters on range and azimuth
+    float beta;
+    int confirmScore;       // A hit adds one to a track's score and a miss takes one away. A track is
+                            // confirmed, and given an ID, when its score reaches this, and dies at zero.
+    size_t maxTracks;       // The track pool's size. Plots that would start a track when it is full are dropped.
+    size_t maxPlots;        // Plots per frame. Any more are ignored.
+
+    TrackerConfig()
+    {
+        rangeGate = 0.2f;
+        azimuthGate = 360.0f;
+        alpha = 0.5f;
+        beta = 0.2f;
+        confirmScore = 20;
+        maxTracks = 64;
+        maxPlots = 256;
+    }
+};
+
+struct TrackerTrack
+{
+    ulid::ULID id;          // Zero until the track is confirmed
+    char idText[26];        // id, marshalled when it is assigned
+    float range;
+    float rangeRate;        // Metres per second, positive when moving away
+    float azimuth;
+    float azimuthRate;
+    int score;
+    int hits;
+    bool confirmed;
+    bool associated;        // A plot was assigned to the track in the last frame
+};
+
+// Tracks targets from frames of plots in range and azimuth. Each track has alpha-beta
+// filters for range and azimuth, so it predicts where its next plot will be, and gives
+// a range rate. The plots of a frame are bucketed in a grid of gate-sized cells, so each
+// track only considers the plots in the cells around its prediction. The plots within a
+// track's gates are then assigned by global nearest neighbour, solved as an auction,
+// which keeps crossing targets apart where taking the first plot within the gate would
+// swap them. Plots left over start new tracks. Tracks live in a pool of fixed size, and
+// the working arrays are sized on construction, so a frame does not allocate.
+class Tracker
+{
+public:
+    Tracker( const TrackerConfig &config );
+
+    // Adds a frame of plots, taken at the given UTC time in nanoseconds
+    void Update( int64_t timestamp, const TrackerPlot *plots, size_t count );
+
+    // The live tracks, confirmed or not
+    size_t Size() const { return live.size(); }
+    const TrackerTrack &Track( size_t i ) const { return pool[live[i]]; }
+
+private:
+    void Bucket( const TrackerPlot *plots, size_t count );
+    void FindCandidates( const TrackerPlot *plots, float dt );
+    void Assign();
+    size_t Cell( float range, float azimuth ) const;
+    size_t Cell( long rangeCell, long azimuthCell ) const;
+
+    TrackerConfig config;
+    int64_t lastTimestamp;
+    long azimuthCells;
+
+    std::vector<TrackerTrack> pool;
+    std::vector<uint32_t> live;             // Pool indices of the live tracks
+    std::vector<uint32_t> freeTracks;
+    std::vector<uint32_t> survivors;
+
+    // The frame's plots bucketed by cell
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellPlots;
+    std::vector<uint32_t> plotCell;
+
+    // The plots within each live track's gates, and the benefit of assigning each
+    std::vector<uint32_t> candidateStart;
+    std::vector<uint32_t> candidatePlot;
+    std::vector<float> candidateBenefit;
+    std::vector<float> predictedRange;
+    std::vector<float> predictedAzimuth;
+
+    // The auction
+    std::vector<float> price;
+    std::vector<int32_t> plotOwner;
+    std::vector<int32_t> trackPlot;
+    std::vector<uint32_t> bidders;
+};
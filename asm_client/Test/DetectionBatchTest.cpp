@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+// Checks that DetectionBatch::Gate, which uses SSE2 or NEON where the target has them, selects
+// the same detections and computes the same bearings as the gate done one detection at a time.
+// Detections are placed on and either side of the bearing wrap, the edges of the task's extent
+// and the range limits, as well as at random. Run with 'scons target=linux test', or directly
+// with an optional seed.
+
+#include "../Network/DetectionBatch.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+// Random tasks, each gating a batch of edge case and random detections
+#define TASKS 20000
+
+// Stop reporting differences after this many
+#define MAX_REPORTED 10
+
+
+struct Task
+{
+    float compassBearing;
+    float taskBearing;
+    float horizontalExtent;
+    float minRange;
+    float maxRange;
+};
+
+
+// Adds value and the floats either side of it
+static void AddAround( std::vector<float> &values, float value )
+{
+    values.push_back( nextafterf( value, -INFINITY ) );
+    values.push_back( value );
+    values.push_back( nextafterf( value, INFINITY ) );
+}
+
+
+static Task RandomTask( std::mt19937 &random )
+{
+    static const float bearings[] = { 0.0f, 180.0f, 359.99f, 360.0f, -0.001f, 90.5f };
+    static const float extents[] = { 0.0f, 1.0f, 40.0f, 359.0f, 360.0f };
+
+    Task task;
+    task.compassBearing = random() % 2 ? bearings[random() % 6] : std::uniform_real_distribution<float>( -720.0f, 720.0f )( random );
+    task.taskBearing = random() % 2 ? bearings[random() % 6] : std::uniform_real_distribution<float>( 0.0f, 360.0f )( random );
+    task.horizontalExtent = random() % 2 ? extents[random() % 5] : std::uniform_real_distribution<float>( 0.0f, 360.0f )( random );
+    task.minRange = std::uniform_real_distribution<float>( 0.0f, 5.0f )( random );
+    task.maxRange = task.minRange + std::uniform_real_distribution<float>( 0.0f, 100.0f )( random );
+    return task;
+}
+
+
+// Directions that land on the wrap, the task's bearing and either edge of its extent, then some at random
+static void MakeDetections( std::mt19937 &random, const Task &task, std::vector<AsmClientData::Detection> &detections )
+{
+    std::vector<float> directions;
+    float half = task.horizontalExtent / 2.0f;
+    AddAround( directions, -task.compassBearing );
+    AddAround( directions, 360.0f - task.compassBearing );
+    AddAround( directions, task.taskBearing - task.compassBearing );
+    AddAround( directions, task.taskBearing - task.compassBearing - half );
+    AddAround( directions, task.taskBearing - task.compassBearing + half );
+    AddAround( directions, task.taskBearing - task.compassBearing + 180.0f );
+    for (int n = 0; n < 7; n++)
+    {
+        directions.push_back( std::uniform_real_distribution<float>( -360.0f, 360.0f )( random ) );
+    }
+
+    std::vector<float> ranges;
+    AddAround( ranges, task.minRange );
+    AddAround( ranges, task.maxRange );
+    ranges.push_back( (task.minRange + task.maxRange) / 2.0f );
+
+    detections.resize( directions.size() );
+    for (size_t i = 0; i < detections.size(); i++)
+    {
+        detections[i] = AsmClientData::Detection();
+        detections[i].direction = directions[i];
+        // Mostly within range, so that the bearing decides
+        detections[i].range = random() % 4 ? ranges[6] : ranges[random() % ranges.size()];
+    }
+}
+
+
+int main( int argc, char **argv )
+{
+    unsigned seed = argc > 1 ? (unsigned)strtoul( argv[1], NULL, 0 ) : 17;
+    std::mt19937 random( seed );
+
+    DetectionBatch batch;
+    std::vector<AsmClientData::Detection> detections;
+    std::vector<uint8_t> selected;
+    std::vector<float> bearing;
+
+    unsigned long compared = 0, selections = 0, differences = 0;
+    for (int t = 0; t < TASKS; t++)
+    {
+        Task task = RandomTask( random );
+        MakeDetections( random, task, detections );
+
+        batch.Load( detections );
+        batch.Gate( task.compassBearing, task.taskBearing, task.horizontalExtent, task.minRange, task.maxRange );
+        selected.assign( batch.Selected(), batch.Selected() + batch.Size() );
+        bearing.assign( batch.Bearing(), batch.Bearing() + batch.Size() );
+
+        batch.GateEach( task.compassBearing, task.taskBearing, task.horizontalExtent, task.minRange, task.maxRange );
+        for (size_t i = 0; i < batch.Size(); i++)
+        {
+            compared++;
+            selections += selected[i];
+            if (selected[i] != batch.Selected()[i] || memcmp( &bearing[i], &batch.Bearing()[i], sizeof( float ) ) != 0)
+            {
+                if (differences < MAX_REPORTED)
+                {
+                    printf( "Compass %.9g task %.9g extent %.9g direction %.9g range %.9g: selected %d bearing %.9g, one at a time %d %.9g\n",
+                        task.compassBearing, task.taskBearing, task.horizontalExtent, detections[i].direction, detections[i].range,
+                        selected[i], bearing[i], batch.Selected()[i], batch.Bearing()[i] );
+                }
+                differences++;
+            }
+        }
+    }
+
+    printf( "%lu detections compared with seed %u, %lu selected, %lu differed\n", compared, seed, selections, differences );
+    return differences == 0 ? 0 : 1;
+}
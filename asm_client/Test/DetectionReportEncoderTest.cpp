@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+// Checks that DetectionReportEncoder writes byte for byte the frames the generated code
+// writes through DetectionReportBuilder, for every combination of optional fields with
+// randomised values. Run with 'scons target=linux test', or directly with an optional seed.
+
+#include "../Network/DetectionReport.h"
+#include "../Network/DetectionReportEncoder.h"
+#include "../Network/ProtobufInterface/Writer.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <google/protobuf/arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+// Every combination of DetectionReportFields::Optional bits
+#define OPTIONAL_FIELDS 14
+
+// Stop reporting differences after this many
+#define MAX_REPORTED 10
+
+
+// Collects the frames written to it
+class FrameStream : public IOutputStream
+{
+public:
+    std::vector<unsigned char> frame;
+
+    virtual bool Write( unsigned char *pOctets, size_t iOctets, size_t &iWrote )
+    {
+        frame.insert( frame.end(), pOctets, pOctets + iOctets );
+        iWrote = iOctets;
+        return true;
+    }
+    virtual bool Send( bool bTerminator ) { return true; }
+    virtual void Close() {}
+};
+
+
+class FieldGenerator
+{
+public:
+    FieldGenerator( unsigned seed ) : random( seed ) {}
+
+    // Mostly ordinary values, with some zeros, negatives and extremes, which the encoder must write alike
+    float Value()
+    {
+        switch (random() % 8)
+        {
+            case 0: return 0.0f;
+            case 1: return -std::uniform_real_distribution<float>( 0.0f, 1000.0f )( random );
+            case 2: return (float)std::uniform_real_distribution<double>( -3.0e38, 3.0e38 )( random );
+            default: return std::uniform_real_distribution<float>( 0.0f, 1.0f )( random );
+        }
+    }
+
+    void Ulid( ulid::ULID &id )
+    {
+        for (int i = 0; i < 16; i++) id.data[i] = (uint8_t)random();
+    }
+
+    // Empty, short, ULID sized, or long enough that its length takes a two byte varint
+    std::string ID()
+    {
+        static const char alphabet[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+        static const size_t lengths[] = { 0, 5, 26, 200 };
+        std::string id( lengths[random() % 4], ' ' );
+        for (size_t i = 0; i < id.length(); i++) id[i] = alphabet[random() % 32];
+        return id;
+    }
+
+    void Fill( DetectionReportFields &f, unsigned present, char objectID[26] )
+    {
+        Ulid( f.reportID );
+        ulid::ULID object;
+        Ulid( object );
+        ulid::MarshalTo( object, objectID );
+        f.objectID = objectID;
+        f.present = present;
+
+        f.range = Value();
+        f.rangeError = Value();
+        f.azimuth = Value();
+        f.azimuthError = Value();
+        f.detectionConfidence = Value();
+        f.dopplerSpeed = Value();
+        f.dopplerSpeedError = Value();
+        f.humanConfidence = Value();
+        f.vehicleConfidence = Value();
+        f.vehicleTwoWheelConfidence = Value();
+        f.vehicleFourWheelConfidence = Value();
+        f.vehicleFourWheelHeavyConfidence = Value();
+        f.vehicleFourWheelMediumConfidence = Value();
+        f.vehicleFourWheelLightConfidence = Value();
+        f.staticObjectConfidence = Value();
+        f.unknownConfidence = Value();
+        f.humanWalkingConfidence = Value();
+        f.humanRunningConfidence = Value();
+        f.humanLoiteringConfidence = Value();
+        f.humanCrawlingConfidence = Value();
+    }
+
+    std::mt19937 random;
+};
+
+
+int main( int argc, char **argv )
+{
+    unsigned seed = argc > 1 ? (unsigned)strtoul( argv[1], NULL, 0 ) : 335;
+    FieldGenerator generate( seed );
+
+    google::protobuf::Arena arena;
+    ProtobufInterface::Writer w;
+    w.setArena( &arena );
+
+    DetectionReportBuilder builder;
+    DetectionReportEncoder encoder;
+
+    unsigned long frames = 0, differences = 0, multiByteLengths = 0;
+    for (unsigned present = 0; present < (1u << OPTIONAL_FIELDS); present++)
+    {
+        // Each combination is written once without a task and once with one
+        for (int withTask = 0; withTask < 2; withTask++)
+        {
+            int64_t timestamp = (int64_t)(generate.random() % 2000000000) * 1000000000 + generate.random() % 1000000000;
+            std::string nodeID = generate.ID();
+            std::string destID = generate.ID();
+            ulid::ULID taskID;
+            if (withTask) generate.Ulid( taskID );
+
+            DetectionReportFields f;
+            char objectID[26];
+            generate.Fill( f, present, objectID );
+
+            FrameStream expected, actual;
+            builder.Begin( timestamp, nodeID, destID, taskID );
+            w.open( &expected );
+            bool builderOk = builder.Write( &w, f );
+            encoder.Begin( timestamp, nodeID, destID, taskID );
+            bool encoderOk = encoder.Write( &actual, f );
+            arena.Reset();
+            frames++;
+
+            if (nodeID.length() > 127 || destID.length() > 127) multiByteLengths++;
+
+            if (!builderOk || !encoderOk || expected.frame != actual.frame)
+            {
+                size_t at = 0;
+                while (at < actual.frame.size() && at < expected.frame.size() && expected.frame[at] == actual.frame[at]) at++;
+                if (differences < MAX_REPORTED)
+                {
+                    printf( "Frame %lu (present 0x%04x, %s task) differs at byte %zu: %zu bytes, expected %zu\n",
+                        frames, present, withTask ? "with" : "no", at, actual.frame.size(), expected.frame.size() );
+                }
+                differences++;
+            }
+        }
+    }
+
+    printf( "%lu frames compared with seed %u, %lu with multi-byte ID lengths, %lu differed\n",
+        frames, seed, multiByteLengths, differences );
+    return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+// Checks UlidIndex against a std::map over random inserts, moves, removes and clears, and
+// that IDs made in the same millisecond are spread over the table rather than sharing a home
+// bucket. Run with 'scons target=linux test', or directly with an optional seed.
+
+#include "../Utils/UlidIndex.h"
+#include "../Utils/UlidGenerator.h"
+
+#define ELPP_DEFAULT_LOGGER "main"
+#include "../Utils/Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+INITIALIZE_EASYLOGGINGPP
+
+// Random operations compared against the map
+#define OPERATIONS 2000000
+
+// IDs the operations choose from, so that most of them find an ID already in the index
+#define POOL_SIZE 300
+
+// IDs made in one millisecond, and the fewest distinct home buckets they may have
+#define SAME_MILLISECOND_IDS 64
+#define MIN_DISTINCT_HOMES 48
+
+
+struct UlidLess
+{
+    bool operator()( const ulid::ULID &a, const ulid::ULID &b ) const
+    {
+        return memcmp( a.data, b.data, sizeof( a.data ) ) < 0;
+    }
+};
+
+
+// Returns the number of operations after which the index and the map differed, or 0
+static unsigned long CompareWithMap( std::mt19937 &random, const std::vector<ulid::ULID> &pool )
+{
+    UlidIndex index( 8 );
+    std::map<ulid::ULID, uint32_t, UlidLess> expected;
+
+    for (unsigned long n = 1; n <= OPERATIONS; n++)
+    {
+        const ulid::ULID &id = pool[random() % pool.size()];
+        uint32_t slot = random() % 1000;
+
+        switch (random() % 16)
+        {
+            case 0:
+                // Rarely, so that the index fills up and grows in between
+                if (random() % 64 == 0)
+                {
+                    index.Clear();
+                    expected.clear();
+                }
+                break;
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                index.Remove( id );
+                expected.erase( id );
+                break;
+            case 5:
+            case 6:
+                index.Move( id, slot );
+                expected[id] = slot;
+                break;
+            default:
+                index.Insert( id, slot );
+                expected[id] = slot;
+                break;
+        }
+
+        if (index.Size() != expected.size())
+        {
+            printf( "Operation %lu: index holds %zu IDs, expected %zu\n", n, index.Size(), expected.size() );
+            return n;
+        }
+
+        // Look up an ID that may or may not be present
+        const ulid::ULID &look = pool[random() % pool.size()];
+        std::map<ulid::ULID, uint32_t, UlidLess>::const_iterator it = expected.find( look );
+        uint32_t want = it == expected.end() ? UlidIndex::NONE : it->second;
+        if (index.Find( look ) != want)
+        {
+            printf( "Operation %lu: found slot %u, expected %u\n", n, index.Find( look ), want );
+            return n;
+        }
+    }
+
+    // Finally every ID must be where the map says
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        std::map<ulid::ULID, uint32_t, UlidLess>::const_iterator it = expected.find( pool[i] );
+        uint32_t want = it == expected.end() ? UlidIndex::NONE : it->second;
+        if (index.Find( pool[i] ) != want)
+        {
+            printf( "After all operations: ID %zu found in slot %u, expected %u\n", i, index.Find( pool[i] ), want );
+            return OPERATIONS;
+        }
+    }
+    return 0;
+}
+
+
+int main( int argc, char **argv )
+{
+    unsigned seed = argc > 1 ? (unsigned)strtoul( argv[1], NULL, 0 ) : 21;
+    std::mt19937 random( seed );
+    int failures = 0;
+
+    std::vector<ulid::ULID> pool( POOL_SIZE );
+    for (size_t i = 0; i < pool.size(); i++)
+    {
+        for (int b = 0; b < 16; b++) pool[i].data[b] = (uint8_t)random();
+    }
+    if (CompareWithMap( random, pool ) != 0)
+    {
+        failures++;
+    }
+
+    // IDs from one millisecond count up in their last byte
+    UlidGenerator generator;
+    UlidIndex index( SAME_MILLISECOND_IDS * 2 );
+    int64_t timestamp = 1571313600000000000LL;
+    std::set<size_t> homes;
+    for (int i = 0; i < SAME_MILLISECOND_IDS; i++)
+    {
+        ulid::ULID id;
+        generator.Generate( timestamp, id );
+        homes.insert( index.Home( id ) );
+    }
+    printf( "%d IDs from one millisecond have %zu distinct homes in %zu buckets\n",
+        SAME_MILLISECOND_IDS, homes.size(), index.Buckets() );
+    if (homes.size() < MIN_DISTINCT_HOMES)
+    {
+        failures++;
+    }
+
+    printf( "%lu operations compared with seed %u, %d checks failed\n", (unsigned long)OPERATIONS, seed, failures );
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "AllocationCheck.h"
+
+#ifdef WANT_ALLOCATION_CHECK
+#define ELPP_DEFAULT_LOGGER "main"
+#include "Log.h"
+
+#include <execinfo.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+
+#define MAX_FRAMES 24
+
+// Counted for each thread, so that each stage of the pipeline is checked on its own
+static thread_local unsigned long threadAllocations;
+static thread_local unsigned long threadLogMessages;
+static thread_local bool threadEvent;
+static thread_local bool recordFrames;
+static thread_local bool inHook;
+static thread_local void *firstFrames[MAX_FRAMES];
+static thread_local int numFirstFrames;
+
+
+static void *CountedAllocation( size_t size )
+{
+    void *p = malloc( size ? size : 1 );
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    threadAllocations++;
+
+    // backtrace may allocate itself the first time it is called
+    if (recordFrames && !inHook)
+    {
+        inHook = true;
+        numFirstFrames = backtrace( firstFrames, MAX_FRAMES );
+        recordFrames = false;
+        inHook = false;
+    }
+    return p;
+}
+
+void *operator new( size_t size ) { return CountedAllocation( size ); }
+void *operator new[]( size_t size ) { return CountedAllocation( size ); }
+
+void *operator new( size_t size, const std::nothrow_t & ) noexcept
+{
+    try { return CountedAllocation( size ); } catch (...) { return NULL; }
+}
+
+void *operator new[]( size_t size, const std::nothrow_t & ) noexcept
+{
+    try { return CountedAllocation( size ); } catch (...) { return NULL; }
+}
+
+void operator delete( void *p ) noexcept { free( p ); }
+void operator delete[]( void *p ) noexcept { free( p ); }
+
+
+// Counts the messages written to the log by each thread
+class LogCounter : public el::LogDispatchCallback
+{
+protected:
+    void handle( const el::LogDispatchData *data ) { threadLogMessages++; }
+};
+
+
+AllocationCheck::AllocationCheck( const char *stage, unsigned long warmupPasses )
+{
+    this->stage = stage;
+    this->warmupPasses = warmupPasses;
+    passes = 0;
+    checkedPasses = 0;
+    allocations = 0;
+    logMessages = 0;
+    loggingPasses = 0;
+
+    el::Helpers::installLogDispatchCallback<LogCounter>( "AllocationCheck" );
+
+    // Load whatever backtrace needs now rather than in the middle of a pass
+    void *frames[1];
+    backtrace( frames, 1 );
+}
+
+
+AllocationCheck::~AllocationCheck()
+{
+    if (passes <= warmupPasses) return;
+    LOG( WARNING ) << "The " << stage << " loop made no allocations in " << checkedPasses << " passes after warming up, "
+        << passes - warmupPasses - checkedPasses << " passes handling events were not checked";
+}
+
+
+void AllocationCheck::BeginPass()
+{
+    allocations = threadAllocations;
+    logMessages = threadLogMessages;
+    numFirstFrames = 0;
+    threadEvent = false;
+    recordFrames = passes >= warmupPasses;
+}
+
+
+void AllocationCheck::Event()
+{
+    threadEvent = true;
+}
+
+
+void AllocationCheck::EndPass()
+{
+    unsigned long made = threadAllocations - allocations;
+    bool logged = threadLogMessages != logMessages;
+    recordFrames = false;
+
+    // A pass that logs every time would leave nothing to check
+    loggingPasses = logged ? loggingPasses + 1 : 0;
+    if (loggingPasses == warmupPasses)
+    {
+        LOG( WARNING ) << "The last " << loggingPasses << " passes of the " << stage
+            << " loop all logged, so are not checked for allocations";
+    }
+
+    if (++passes <= warmupPasses || threadEvent || logged)
+    {
+        return;
+    }
+    checkedPasses++;
+
+    if (made > 0)
+    {
+        LOG( ERROR ) << "The " << stage << " loop made " << made << " allocations in pass " << passes
+            << ", after " << checkedPasses - 1 << " passes without. First allocated from:";
+        backtrace_symbols_fd( firstFrames, numFirstFrames, STDERR_FILENO );
+        throw "Allocation made in the steady state loop";
+    }
+}
+#endif
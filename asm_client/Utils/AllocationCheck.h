@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+// Passes a loop may make before it is expected to have stopped allocating
+#define ALLOCATION_CHECK_WARMUP 100
+
+// Checks that a loop makes no heap allocations once it has warmed up. When built with
+// WANT_ALLOCATION_CHECK, the global operator new counts allocations made by each thread
+// and EndPass throws if a pass after the warm-up allocated, after logging the call stack
+// of the pass's first allocation. Passes that handle an event, such as a received
+// message or a changed status, call Event and are not checked, nor are passes that log,
+// as easylogging allocates for every message. The check runs at the configured log levels,
+// so anything logged on every pass, such as each detection, is logged with VLOG, which is
+// off unless asm_client is run with --v. Otherwise these do nothing.
+#ifdef WANT_ALLOCATION_CHECK
+class AllocationCheck
+{
+public:
+    AllocationCheck( const char *stage, unsigned long warmupPasses = ALLOCATION_CHECK_WARMUP );
+    ~AllocationCheck();
+
+    void BeginPass();
+    void EndPass();
+
+    // Marks the calling thread's current pass as handling an event rather than the steady state
+    static void Event();
+
+private:
+    const char *stage;
+    unsigned long warmupPasses;
+    unsigned long passes;
+    unsigned long checkedPasses;
+    unsigned long allocations;
+    unsigned long logMessages;
+    unsigned long loggingPasses;
+};
+#else
+class AllocationCheck
+{
+public:
+    AllocationCheck( const char *stage, unsigned long warmupPasses = ALLOCATION_CHECK_WARMUP ) {}
+
+    void BeginPass() {}
+    void EndPass() {}
+
+    static void Event() {}
+};
+#endif
@@ -0,0 +1,22 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include <math.h>
+
+// The angle as a bearing, from 0 up to 360 degrees
+inline float WrapDegrees( float angle )
+{
+    angle = fmodf( angle, 360.0f );
+    return angle < 0.0f ? angle + 360.0f : angle;
+}
+
+// The difference between two angles, from -180 to 180 degrees
+inline float DifferenceDegrees( float a, float b )
+{
+    float difference = WrapDegrees( a - b );
+    return difference > 180.0f ? difference - 360.0f : difference;
+}
@@ -0,0 +1,54 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Lock-free triple buffer holding the latest snapshot of T. The writer never
+// waits for the reader; the reader always sees the most recently published value.
+template <typename T>
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer() : back( 0 ), middle( 1 ), front( 2 ) {}
+
+    // Writer: publish a new snapshot. Returns false if the previous one was never read.
+    bool Publish( const T &item )
+    {
+        buffers[back] = item;
+        int previous = middle.exchange( back | FRESH, std::memory_order_acq_rel );
+        back = previous & ~FRESH;
+        return (previous & FRESH) == 0;
+    }
+
+    // Reader: fetch the latest snapshot if one has been published since the last call.
+    bool Fetch( T &item )
+    {
+        if ((middle.load( std::memory_order_relaxed ) & FRESH) == 0) return false;
+        front = middle.exchange( front, std::memory_order_acq_rel ) & ~FRESH;
+        item = buffers[front];
+        return true;
+    }
+
+private:
+    enum { FRESH = 4 };
+
+    T buffers[3];
+    int back;
+    std::atomic<int> middle;
+    int front;
+};
+
+// Counters kept by each stage of the threaded pipeline
+struct PipelineCounters
+{
+    std::atomic<unsigned long> passes;      // Number of times the stage has run
+    std::atomic<unsigned long> inputWaits;  // Passes that found no new input from the upstream stage
+    std::atomic<unsigned long> outputWaits; // Snapshots that found the downstream stage had not caught up
+
+    PipelineCounters() : passes( 0 ), inputWaits( 0 ), outputWaits( 0 ) {}
+};
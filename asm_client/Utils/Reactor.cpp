@@ -0,0 +1,192 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "Reactor.h"
+#include "Utils.h"
+
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#define MAX_EVENTS 16
+
+Reactor::Reactor()
+{
+#ifdef __unix__
+    epollFd = epoll_create1( EPOLL_CLOEXEC );
+    if (epollFd < 0) throw "Failed to create epoll instance";
+
+    notifyFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if (notifyFd < 0) throw "Failed to create eventfd";
+
+    // The notify descriptor is recognised in Wait by pointing at its own member
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN;
+    event.data.ptr = &notifyFd;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, notifyFd, &event );
+#else
+    epollFd = -1;
+    notifyFd = -1;
+#endif
+}
+
+Reactor::~Reactor()
+{
+#ifdef __unix__
+    close( notifyFd );
+    close( epollFd );
+#endif
+}
+
+void Reactor::Watch( int fd, bool writable )
+{
+#ifdef __unix__
+    struct epoll_event event = { 0 };
+    event.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+    event.data.ptr = nullptr;
+    if (epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event ) != 0 && errno == EEXIST)
+    {
+        epoll_ctl( epollFd, EPOLL_CTL_MOD, fd, &event );
+    }
+#endif
+}
+
+void Reactor::Unwatch( int fd )
+{
+#ifdef __unix__
+    epoll_ctl( epollFd, EPOLL_CTL_DEL, fd, NULL );
+#endif
+}
+
+void Reactor::Notify()
+{
+#ifdef __unix__
+    uint64_t one = 1;
+    if (write( notifyFd, &one, sizeof( one ) ) < 0)
+    {
+        // The counter is already non-zero, so the waiter will wake anyway
+    }
+#endif
+}
+
+int Reactor::Wait( int timeout_ms )
+{
+#ifdef __unix__
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait( epollFd, events, MAX_EVENTS, timeout_ms );
+    for (int i = 0; i < count; i++)
+    {
+        if (events[i].data.ptr == &notifyFd)
+        {
+            uint64_t value;
+            if (read( notifyFd, &value, sizeof( value ) ) < 0) {}
+        }
+        else if (events[i].data.ptr != nullptr)
+        {
+            // Latch timer expiries here so an unchecked timer cannot keep waking us
+            static_cast<ReactorTimer *>(events[i].data.ptr)->Fire();
+        }
+    }
+    return count < 0 ? 0 : count;
+#else // windows
+    Sleep_ms( timeout_ms < 0 || timeout_ms > 1 ? 1 : timeout_ms );
+    return 0;
+#endif
+}
+
+ReactorTimer::ReactorTimer( Reactor *r )
+{
+    reactor = r;
+    timerFd = -1;
+    deadline = 0.0;
+    running = false;
+#ifdef __unix__
+    if (reactor != nullptr)
+    {
+        timerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+        if (timerFd < 0) throw "Failed to create timerfd";
+
+        struct epoll_event event = { 0 };
+        event.events = EPOLLIN;
+        event.data.ptr = this;
+        epoll_ctl( reactor->epollFd, EPOLL_CTL_ADD, timerFd, &event );
+    }
+#endif
+}
+
+ReactorTimer::~ReactorTimer()
+{
+#ifdef __unix__
+    if (timerFd >= 0) close( timerFd );
+#endif
+}
+
+void ReactorTimer::Start( double seconds )
+{
+    deadline = Get_Time_Monotonic() + seconds;
+    running = true;
+#ifdef __unix__
+    if (timerFd >= 0)
+    {
+        if (seconds <= 0)
+        {
+            // A zero timerfd value would disarm it, so expire now and wake the reactor instead
+            Stop();
+            reactor->Notify();
+            return;
+        }
+        struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+        spec.it_value.tv_sec = (time_t)seconds;
+        spec.it_value.tv_nsec = (long)((seconds - (double)spec.it_value.tv_sec) * 1e9);
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+        timerfd_settime( timerFd, 0, &spec, NULL );
+    }
+#endif
+}
+
+void ReactorTimer::Stop()
+{
+    running = false;
+#ifdef __unix__
+    if (timerFd >= 0)
+    {
+        struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+        timerfd_settime( timerFd, 0, &spec, NULL );
+    }
+#endif
+}
+
+void ReactorTimer::Fire()
+{
+#ifdef __unix__
+    uint64_t expirations;
+    if (read( timerFd, &expirations, sizeof( expirations ) ) == sizeof( expirations ))
+    {
+        running = false;
+    }
+#endif
+}
+
+bool ReactorTimer::Expired()
+{
+    if (running)
+    {
+#ifdef __unix__
+        if (timerFd >= 0)
+        {
+            Fire();
+            return !running;
+        }
+#endif
+        if (Get_Time_Monotonic() >= deadline) running = false;
+    }
+    return !running;
+}
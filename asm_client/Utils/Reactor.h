@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+class ReactorTimer;
+
+// Waits in one place for any of the registered file descriptors to become ready,
+// for a timer to expire or for another thread to call Notify. Uses epoll, timerfd
+// and eventfd on Linux; elsewhere Wait just sleeps briefly and timers are polled.
+class Reactor
+{
+public:
+    Reactor();
+    ~Reactor();
+
+    // Adds (or updates) a file descriptor to wake on when readable, and optionally when writable
+    void Watch( int fd, bool writable = false );
+
+    // Removes a file descriptor. Closing a descriptor also removes it.
+    void Unwatch( int fd );
+
+    // Wakes the thread blocked in Wait. May be called from any thread.
+    void Notify();
+
+    // Blocks until something is ready or timeout_ms has elapsed (-1 waits indefinitely)
+    // Returns the number of events received, zero on timeout
+    int Wait( int timeout_ms );
+
+private:
+    friend class ReactorTimer;
+
+    int epollFd;
+    int notifyFd;
+};
+
+// A one-shot timer that wakes the Reactor when it expires. Once expired it stays
+// expired until it is started again. A timer that has never been started is expired.
+class ReactorTimer
+{
+public:
+    ReactorTimer( Reactor *reactor );
+    ~ReactorTimer();
+
+    // (Re)starts the timer to expire after the given number of seconds
+    void Start( double seconds );
+
+    // Stops the timer, leaving it expired
+    void Stop();
+
+    // Returns true if the timer has expired or is stopped
+    bool Expired();
+
+private:
+    friend class Reactor;
+    void Fire();
+
+    Reactor *reactor;
+    int timerFd;
+    double deadline;
+    bool running;
+};
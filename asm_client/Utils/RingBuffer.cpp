@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "RingBuffer.h"
+
+#include <algorithm>
+#include <string.h>
+
+ByteRing::ByteRing( size_t initialCapacity, size_t maxCapacity ) :
+    buffer( initialCapacity ),
+    head( 0 ),
+    used( 0 ),
+    maxCapacity( maxCapacity )
+{
+}
+
+uint8_t ByteRing::At( size_t offset ) const
+{
+    return buffer[(head + offset) % buffer.size()];
+}
+
+uint8_t *ByteRing::WriteSpace( size_t *length )
+{
+    if (used == buffer.size() && !Grow())
+    {
+        *length = 0;
+        return nullptr;
+    }
+
+    size_t tail = (head + used) % buffer.size();
+    *length = (tail >= head && used < buffer.size()) ? buffer.size() - tail : head - tail;
+    return &buffer[tail];
+}
+
+void ByteRing::Produce( size_t length )
+{
+    used += length;
+}
+
+uint8_t *ByteRing::Reserve( size_t length )
+{
+    while (buffer.size() - used < length)
+    {
+        if (!Grow()) return nullptr;
+    }
+
+    size_t tail = (head + used) % buffer.size();
+    size_t space = (tail >= head && used < buffer.size()) ? buffer.size() - tail : head - tail;
+    if (space < length)
+    {
+        // As in Peek, rotating leaves all the free space in one block after the data
+        std::rotate( buffer.begin(), buffer.begin() + head, buffer.end() );
+        head = 0;
+        tail = used;
+    }
+    return &buffer[tail];
+}
+
+const uint8_t *ByteRing::ReadSpace( size_t *length ) const
+{
+    *length = std::min( used, buffer.size() - head );
+    return &buffer[head];
+}
+
+const uint8_t *ByteRing::Peek( size_t length )
+{
+    if (head + length > buffer.size())
+    {
+        // Rotating the whole buffer leaves the data at the start and the free space after it
+        std::rotate( buffer.begin(), buffer.begin() + head, buffer.end() );
+        head = 0;
+    }
+    return &buffer[head];
+}
+
+void ByteRing::Consume( size_t length )
+{
+    used -= length;
+    head = (used == 0) ? 0 : (head + length) % buffer.size();
+}
+
+bool ByteRing::Grow()
+{
+    size_t capacity = buffer.size() * 2;
+    if (capacity > maxCapacity) capacity = maxCapacity;
+    if (capacity <= buffer.size()) return false;
+
+    std::vector<uint8_t> larger( capacity );
+    size_t first = std::min( used, buffer.size() - head );
+    memcpy( &larger[0], &buffer[head], first );
+    memcpy( &larger[first], &buffer[0], used - first );
+    buffer.swap( larger );
+    head = 0;
+    return true;
+}
@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A byte FIFO held in a ring that doubles in size (up to a limit) when it fills.
+// Data can be written directly into the free space and read directly from the
+// stored bytes, so a frame normally never needs to be copied out.
+class ByteRing
+{
+public:
+    ByteRing( size_t initialCapacity, size_t maxCapacity );
+
+    size_t Size() const { return used; }
+    size_t Capacity() const { return buffer.size(); }
+    void Clear() { head = 0; used = 0; }
+
+    // Returns the byte at the given offset from the oldest stored byte
+    uint8_t At( size_t offset ) const;
+
+    // Returns a pointer to contiguous free space and its length, growing the ring
+    // if it is full. The length is zero if the ring is full and cannot grow.
+    uint8_t *WriteSpace( size_t *length );
+
+    // Adds length bytes that were written into the space returned by WriteSpace
+    void Produce( size_t length );
+
+    // Returns a pointer to length bytes of contiguous free space, growing the ring or
+    // moving the stored data within it as needed. NULL if the ring cannot hold them.
+    uint8_t *Reserve( size_t length );
+
+    // Returns a pointer to the oldest stored bytes and how many of them are contiguous
+    const uint8_t *ReadSpace( size_t *length ) const;
+
+    // Returns a pointer to the oldest length bytes as one contiguous block,
+    // moving the stored data within the ring if it wraps around the end
+    const uint8_t *Peek( size_t length );
+
+    // Removes the oldest length bytes
+    void Consume( size_t length );
+
+private:
+    bool Grow();
+
+    std::vector<uint8_t> buffer;
+    size_t head;
+    size_t used;
+    size_t maxCapacity;
+};
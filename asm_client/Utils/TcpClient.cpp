@@ -7,6 +7,7 @@
 #include "../Utils/Utils.h"
 
 #include <string.h>
+#include <errno.h>
 
 #ifdef __unix__
 #include <unistd.h>
@@ -14,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
 #define FLAG int
 #define SOCKET int
 #else // windows
@@ -25,6 +27,13 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
+
 // Chunk size when writing to socket
 #define CHUNK_SIZE 65536
 
@@ -187,6 +196,30 @@ TcpClientErrno TcpClient::Get_Connected( int *connected )
     return TCPCLIENT_ERR_NO_ERROR;
 }
 
+TcpClientErrno TcpClient::Get_Socket( int *fd )
+{
+    *fd = -1;
+
+    if (state == NULL) return TCPCLIENT_ERR_INVALID_STATE;
+
+    if (state->connected) *fd = (int)state->client_sockfd;
+
+    return TCPCLIENT_ERR_NO_ERROR;
+}
+
+TcpClientErrno TcpClient::Get_Unsent( int *bytes )
+{
+    *bytes = 0;
+
+    if (state == NULL) return TCPCLIENT_ERR_INVALID_STATE;
+
+#ifdef TIOCOUTQ
+    if (state->connected && ioctl( state->client_sockfd, TIOCOUTQ, bytes ) < 0) *bytes = 0;
+#endif
+
+    return TCPCLIENT_ERR_NO_ERROR;
+}
+
 TcpClientErrno TcpClient::Read( int timeout, void *data, int max_length, int *length )
 {
     fd_set readfds;
@@ -235,13 +268,15 @@ TcpClientErrno TcpClient::Read( int timeout, void *data, int max_length, int *le
     return TCPCLIENT_ERR_NO_ERROR;
 }
 
-TcpClientErrno TcpClient::Write( const void *data, int length )
+TcpClientErrno TcpClient::Write( const void *data, int length, int *written, int more, int *sends )
 {
     fd_set writefds;
     struct timeval timeout_struct = { 0 };
     int space_available = 1, write_length = 1, remainder = length;
     char *ptr = (char*)data;
 
+    *written = 0;
+
     if (state == NULL) return TCPCLIENT_ERR_INVALID_STATE;
 
     if (state->connected == 0) return TCPCLIENT_ERR_NOT_CONNECTED;
@@ -263,10 +298,15 @@ TcpClientErrno TcpClient::Write( const void *data, int length )
         {
             write_length = remainder > CHUNK_SIZE ? CHUNK_SIZE : remainder;
 
-            // Write up to CHUNK_SIZE bytes at a time
-            write_length = send( state->client_sockfd, ptr, write_length, MSG_NOSIGNAL );
+            // Write up to CHUNK_SIZE bytes at a time, holding back all but the last chunk if more is to come
+            // The socket may have room for less than the whole chunk, so never wait for it
+            int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+            if (more || remainder > write_length) flags |= MSG_MORE;
+            write_length = send( state->client_sockfd, ptr, write_length, flags );
+            if (sends != NULL) (*sends)++;
             if (write_length == -1)
             {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 Disconnect();
                 return TCPCLIENT_ERR_CONNECTION_LOST;
             }
@@ -275,10 +315,27 @@ TcpClientErrno TcpClient::Write( const void *data, int length )
             remainder -= write_length;
         }
     }
-    if (remainder > 0)
+
+    // Whatever is left is for the caller to write again once the socket has room
+    *written = length - remainder;
+
+    return TCPCLIENT_ERR_NO_ERROR;
+}
+
+TcpClientErrno TcpClient::Push()
+{
+    if (state == NULL) return TCPCLIENT_ERR_INVALID_STATE;
+
+    if (state->connected == 0) return TCPCLIENT_ERR_NOT_CONNECTED;
+
+#ifdef TCP_CORK
+    // Clearing the cork sends any partial segment left waiting by MSG_MORE
+    FLAG off = 0;
+    if (setsockopt( state->client_sockfd, IPPROTO_TCP, TCP_CORK, &off, sizeof( off ) ) != 0)
     {
-        return TCPCLIENT_ERR_WRITING_TO_SERVER;
+        return TCPCLIENT_ERR_SETTING_SOCKET_OPT;
     }
+#endif
 
     return TCPCLIENT_ERR_NO_ERROR;
 }
@@ -42,6 +42,14 @@ public:
     // Returns 0 on success, otherwise an error code
     TcpClientErrno Get_Connected( int *connected );
 
+    // Provides the socket descriptor while connected, otherwise -1
+    // Returns 0 on success, otherwise an error code
+    TcpClientErrno Get_Socket( int *fd );
+
+    // Provides the number of bytes written but not yet sent by the socket, or 0 if unknown
+    // Returns 0 on success, otherwise an error code
+    TcpClientErrno Get_Unsent( int *bytes );
+
     // Waits for data and then reads up to max_length bytes to data address
     // from the server. Actual number of bytes read provided in *length
     // The read will wait for the specified number of milliseconds before
@@ -49,9 +57,17 @@ public:
     // Returns 0 on success, otherwise an error code
     TcpClientErrno Read( int timeout, void *data, int max_length, int *length );
 
-    // Writes the specified number of bytes from the data address to the server
+    // Writes up to the specified number of bytes from the data address to the server
+    // without waiting. Actual number of bytes written provided in *written, which is
+    // less than length if the socket's buffer is full
+    // If 'more' is set the data may be held back to be sent with the next write
+    // The number of send calls made is added to *sends if provided
+    // Returns 0 on success, otherwise an error code
+    TcpClientErrno Write( const void *data, int length, int *written, int more = 0, int *sends = NULL );
+
+    // Sends anything held back by a previous write with 'more' set
     // Returns 0 on success, otherwise an error code
-    TcpClientErrno Write( const void *data, int length );
+    TcpClientErrno Push();
 
 private:
     TcpClientErrno Set_Non_Blocking( int non_blocking );
@@ -254,7 +254,7 @@ struct ULID {
         return *this;
     }
 
-    bool IsZero()
+    bool IsZero() const
     {
         for( int i = 0; i < 16; i++ )
         {
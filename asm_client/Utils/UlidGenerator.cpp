@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "UlidGenerator.h"
+#include "Utils.h"
+
+#include <random>
+
+
+// SplitMix64, to spread a seed over the generator's state
+static uint64_t Mix( uint64_t &seed )
+{
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+UlidGenerator::UlidGenerator()
+{
+    // The time and the generator's address separate generators made together, should random_device be deterministic
+    std::random_device device;
+    uint64_t seed = ((uint64_t)device() << 32) ^ device() ^ (uint64_t)Get_Time_UTC_ns() ^ (uint64_t)(uintptr_t)this;
+    state[0] = Mix( seed );
+    state[1] = Mix( seed );
+    if (state[0] == 0 && state[1] == 0) state[1] = 1;
+
+    lastTime = -1;
+    entropyHigh = 0;
+    entropyLow = 0;
+}
+
+
+uint64_t UlidGenerator::Next()
+{
+    uint64_t s1 = state[0];
+    const uint64_t s0 = state[1];
+    state[0] = s0;
+    s1 ^= s1 << 23;
+    state[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return state[1] + s0;
+}
+
+
+void UlidGenerator::Generate( ulid::ULID &id )
+{
+    Generate( Get_Time_UTC_ns(), id );
+}
+
+
+void UlidGenerator::Generate( int64_t timestamp, ulid::ULID &id )
+{
+    int64_t time = timestamp / 1000000;
+    if (time > lastTime)
+    {
+        lastTime = time;
+        entropyHigh = Next() & 0xFFFF;
+        entropyLow = Next();
+    }
+    else if (++entropyLow == 0 && ++entropyHigh > 0xFFFF)
+    {
+        // All 80 bits have been used in this millisecond, so carry in to the time
+        lastTime++;
+        entropyHigh = 0;
+    }
+
+    // Big-endian, as ulid::EncodeTime would, but without narrowing the time to a 32 bit time_t
+    uint64_t t = (uint64_t)lastTime;
+    for (int i = 5; i >= 0; i--, t >>= 8)
+    {
+        id.data[i] = (uint8_t)t;
+    }
+    id.data[6] = (uint8_t)(entropyHigh >> 8);
+    id.data[7] = (uint8_t)entropyHigh;
+    uint64_t e = entropyLow;
+    for (int i = 15; i >= 8; i--, e >>= 8)
+    {
+        id.data[i] = (uint8_t)e;
+    }
+}
+
+
+UlidGenerator &UlidGenerator::ThisThread()
+{
+    static thread_local UlidGenerator generator;
+    return generator;
+}
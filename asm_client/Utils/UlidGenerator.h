@@ -0,0 +1,50 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "Ulid.h"
+
+#include <stdint.h>
+
+// Makes ULIDs from the UTC time in milliseconds and 80 bits from a xorshift128+ generator,
+// seeded differently for each generator. IDs made in the same millisecond as the last
+// one take its random bits plus one, so a generator's IDs always sort in the order they
+// were made, even if the clock steps back. Each thread has its own generator, so no locking
+// is needed, and IDs from different threads differ in their random bits.
+class UlidGenerator
+{
+public:
+    UlidGenerator();
+
+    // Makes an ID from the current time
+    void Generate( ulid::ULID &id );
+
+    // Makes an ID from the given UTC time in nanoseconds since the epoch
+    void Generate( int64_t timestamp, ulid::ULID &id );
+
+    // The calling thread's generator
+    static UlidGenerator &ThisThread();
+
+private:
+    uint64_t Next();
+
+    uint64_t state[2];
+    int64_t lastTime;           // Milliseconds since the epoch of the last ID
+    uint64_t entropyHigh;       // 16 bits
+    uint64_t entropyLow;        // 64 bits
+};
+
+// Makes an ID with the calling thread's generator, and optionally its 26 character text
+inline void Generate_Ulid( ulid::ULID &id )
+{
+    UlidGenerator::ThisThread().Generate( id );
+}
+
+inline void Generate_Ulid( ulid::ULID &id, char text[26] )
+{
+    UlidGenerator::ThisThread().Generate( id );
+    ulid::MarshalTo( id, text );
+}
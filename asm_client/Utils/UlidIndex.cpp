@@ -0,0 +1,145 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#include "UlidIndex.h"
+
+#include <string.h>
+
+
+UlidIndex::UlidIndex( size_t capacity )
+{
+    size_t size = 16;
+    while (size < capacity * 2) size <<= 1;
+
+    buckets.resize( size );
+    for (size_t i = 0; i < size; i++)
+    {
+        buckets[i].generation = 0;
+    }
+    mask = size - 1;
+    shift = 64;
+    while (size > 1)
+    {
+        shift--;
+        size >>= 1;
+    }
+    count = 0;
+    generation = 1;
+}
+
+
+// The 80 random bits of a ULID folded into 64, spread over the table by Fibonacci hashing.
+// IDs made in the same millisecond differ by one in their last byte, so it goes in the low
+// bits of the product, which carry into the top bits the bucket is taken from.
+size_t UlidIndex::Home( const ulid::ULID &id ) const
+{
+    uint64_t random = 0;
+    for (int i = 8; i < 16; i++)
+    {
+        random = random << 8 | id.data[i];
+    }
+    random ^= (uint64_t)id.data[6] << 56 | (uint64_t)id.data[7] << 48;
+    return (size_t)((random * 0x9E3779B97F4A7C15ULL) >> shift);
+}
+
+
+uint32_t UlidIndex::Find( const ulid::ULID &id ) const
+{
+    for (size_t i = Home( id ); Used( i ); i = (i + 1) & mask)
+    {
+        if (memcmp( buckets[i].id.data, id.data, sizeof( id.data ) ) == 0) return buckets[i].slot;
+    }
+    return NONE;
+}
+
+
+void UlidIndex::Insert( const ulid::ULID &id, uint32_t slot )
+{
+    size_t i;
+    for (i = Home( id ); Used( i ); i = (i + 1) & mask)
+    {
+        if (memcmp( buckets[i].id.data, id.data, sizeof( id.data ) ) == 0)
+        {
+            buckets[i].slot = slot;
+            return;
+        }
+    }
+
+    if ((count + 1) * 2 > buckets.size())
+    {
+        Grow();
+        Insert( id, slot );
+        return;
+    }
+
+    buckets[i].id = id;
+    buckets[i].slot = slot;
+    buckets[i].generation = generation;
+    count++;
+}
+
+
+void UlidIndex::Remove( const ulid::ULID &id )
+{
+    size_t i;
+    for (i = Home( id ); Used( i ); i = (i + 1) & mask)
+    {
+        if (memcmp( buckets[i].id.data, id.data, sizeof( id.data ) ) == 0) break;
+    }
+    if (!Used( i )) return;
+
+    // Shift back any later entry of the probe run that would no longer be found past the gap
+    for (size_t j = (i + 1) & mask; Used( j ); j = (j + 1) & mask)
+    {
+        size_t home = Home( buckets[j].id );
+        bool reachable = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!reachable)
+        {
+            buckets[i] = buckets[j];
+            i = j;
+        }
+    }
+    buckets[i].generation = generation - 1;
+    count--;
+}
+
+
+void UlidIndex::Clear()
+{
+    generation++;
+    if (generation == 0)
+    {
+        // Every bucket could now look current, so mark them all unused the slow way, once every 2^32 clears
+        for (size_t i = 0; i < buckets.size(); i++)
+        {
+            buckets[i].generation = 0;
+        }
+        generation = 1;
+    }
+    count = 0;
+}
+
+
+void UlidIndex::Grow()
+{
+    std::vector<Bucket> old;
+    old.swap( buckets );
+    uint32_t oldGeneration = generation;
+
+    buckets.resize( old.size() * 2 );
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        buckets[i].generation = 0;
+    }
+    mask = buckets.size() - 1;
+    shift--;
+    count = 0;
+    generation = 1;
+
+    for (size_t i = 0; i < old.size(); i++)
+    {
+        if (old[i].generation == oldGeneration) Insert( old[i].id, old[i].slot );
+    }
+}
@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2019 AptCore Limited
+// MIT License (see LICENSE file)
+//
+
+#pragma once
+
+#include "Ulid.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Maps ULIDs to slots in a dense array, such as a sensor's detections, so that a track's
+// detection is found in constant time rather than by comparing every ID. The table is
+// open addressed with linear probing, and kept under half full by doubling. A bucket is
+// only in use if it carries the table's current generation, so Clear is a single increment,
+// and Remove shifts the rest of its probe run back rather than leaving a tombstone.
+// When the array is compacted by moving its last entry into a removed one's slot, Move
+// tells the index where that entry went.
+class UlidIndex
+{
+public:
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    UlidIndex( size_t capacity = 64 );
+
+    // Returns the ID's slot, or NONE if it is not in the index
+    uint32_t Find( const ulid::ULID &id ) const;
+
+    // Adds an ID, or changes its slot if it is already in the index
+    void Insert( const ulid::ULID &id, uint32_t slot );
+
+    void Move( const ulid::ULID &id, uint32_t slot ) { Insert( id, slot ); }
+    void Remove( const ulid::ULID &id );
+    void Clear();
+
+    size_t Size() const { return count; }
+
+    // The bucket, of Buckets(), that the search for an ID starts from
+    size_t Home( const ulid::ULID &id ) const;
+    size_t Buckets() const { return buckets.size(); }
+
+private:
+    struct Bucket
+    {
+        ulid::ULID id;
+        uint32_t slot;
+        uint32_t generation;
+    };
+
+    bool Used( size_t i ) const { return buckets[i].generation == generation; }
+    void Grow();
+
+    std::vector<Bucket> buckets;
+    size_t mask;
+    unsigned shift;             // 64 less the log2 of the number of buckets
+    size_t count;
+    uint32_t generation;
+};
@@ -4,9 +4,11 @@
 //
 
 #include <time.h>
+#include <stdint.h>
 #include <chrono>
 #include <ctime>
 #include <string>
+#include <atomic>
 
 #ifdef __unix__
 #include <unistd.h>
@@ -39,24 +41,56 @@ double Get_Time_Monotonic()
 #endif
 }
 
-std::string Get_Timestamp( std::chrono::system_clock::time_point tp )
+// Monotonic time in nanoseconds since an unspecified start point
+static int64_t Get_Time_Monotonic_ns()
 {
-    // Split the time in to seconds since the epoch and a fractional part
-    std::chrono::seconds tp_seconds_since_epoch = std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch());
-    std::chrono::duration<long long, std::nano> tp_fractional_nanoseconds = tp.time_since_epoch() - tp_seconds_since_epoch;
+#ifdef __unix__
+    struct timespec monotonic_timespec;
+    clock_gettime( CLOCK_MONOTONIC, &monotonic_timespec );
+    return (int64_t)monotonic_timespec.tv_sec * 1000000000 + monotonic_timespec.tv_nsec;
+#else // windows
+    static LARGE_INTEGER count, frequency = { 0 };
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency( &frequency );
+    QueryPerformanceCounter( &count );
+    return (int64_t)(count.QuadPart / frequency.QuadPart) * 1000000000 +
+        (int64_t)(count.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#endif
+}
 
-    // Generate the ISO 8601 timestamp from the seconds since the epoch
-    char timestamp[] = "yyyy-mm-ddThh:mm:ss";
-    std::time_t tp_time_t = std::chrono::system_clock::to_time_t( std::chrono::system_clock::time_point( tp_seconds_since_epoch ) );
-#ifdef _MSC_VER
-#pragma warning (disable: 4996)
+// System time in nanoseconds since the epoch
+static int64_t Get_Time_Realtime_ns()
+{
+#ifdef __unix__
+    struct timespec realtime_timespec;
+    clock_gettime( CLOCK_REALTIME, &realtime_timespec );
+    return (int64_t)realtime_timespec.tv_sec * 1000000000 + realtime_timespec.tv_nsec;
+#else // windows
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
 #endif
-    if (strftime( timestamp, sizeof( timestamp ), "%FT%T", std::gmtime( &tp_time_t ) ) == 0)
-        return "";
+}
 
-    // Add the fractional milliseconds with leading zeros and return
-    std::string milliseconds = std::to_string( tp_fractional_nanoseconds.count() / 1000000 );
-    return std::string( timestamp ) + "." + std::string( 3 - milliseconds.length(), '0' ) + milliseconds + "Z";
+int64_t Get_Time_UTC_ns()
+{
+    // The offset follows the system clock when it is stepped (by NTP or GNSS), but between
+    // measurements the time advances with the monotonic clock alone, so the times of detections
+    // made close together keep their order and spacing. Racing threads may both measure it, which is harmless.
+    // nextMeasurement is released after offset is stored, so a thread that sees it skip the measurement sees the
+    // offset that goes with it, rather than the initial zero.
+    static std::atomic<int64_t> offset( 0 );
+    static std::atomic<int64_t> nextMeasurement( 0 );
+    const int64_t measurementInterval = 1000000000;
+
+    int64_t monotonic = Get_Time_Monotonic_ns();
+    if (monotonic >= nextMeasurement.load( std::memory_order_acquire ))
+    {
+        // Taken between two monotonic readings, the system time is paired with their midpoint
+        int64_t realtime = Get_Time_Realtime_ns();
+        int64_t after = Get_Time_Monotonic_ns();
+        offset.store( realtime - monotonic / 2 - after / 2, std::memory_order_relaxed );
+        nextMeasurement.store( after + measurementInterval, std::memory_order_release );
+        monotonic = after;
+    }
+    return monotonic + offset.load( std::memory_order_relaxed );
 }
 
 bool Network_Link_Down( std::string hostname )
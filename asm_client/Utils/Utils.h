@@ -6,8 +6,8 @@
 #pragma once
 
 #include <time.h>
+#include <stdint.h>
 #include <string>
-#include <chrono>
 
 // Sleep for the given period in milliseconds. Causes a thread switch, so may sleep longer on a busy CPU.
 void Sleep_ms( int period );
@@ -15,8 +15,9 @@ void Sleep_ms( int period );
 // Return the time in seconds since an unspecified start point.
 double Get_Time_Monotonic();
 
-// Return the system time as an ISO 8601 formatted string with fractional seconds
-std::string Get_Timestamp( std::chrono::system_clock::time_point tp );
+// Return the UTC time in nanoseconds since the epoch. This is read from the monotonic clock and
+// mapped to UTC by an offset to the system clock, which is measured again about once a second.
+int64_t Get_Time_UTC_ns();
 
 // Returns true if the network interface associated with the address is known to be down
 bool Network_Link_Down( std::string hostname );
\ No newline at end of file